@@ -0,0 +1,530 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <cstdlib>
+#include <iostream>
+#include <locale>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <semaphore>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "game/movement.h"
+#include "game/networking/clockSync.h"
+#include "game/networking/datagram.h"
+#include "game/networking/networking.h"
+#include "game/role.h"
+#include "game/server.h"
+#include "game/tickLoop.h"
+#include "util/commandLine.h"
+#include "util/exceptions/formatException.h"
+#include "util/exceptions/socketException.h"
+#include "util/exceptions/stopFlag.h"
+#include "util/histogram.h"
+#include "util/scopeGuard.h"
+#include "util/threadPool.h"
+
+using namespace std;
+using namespace nlohmann;
+using namespace airewar::game;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace {
+constexpr unsigned MAX_BOTS = 10'000;
+/** how often each bot measures its round trip */
+constexpr chrono::seconds PING_INTERVAL = chrono::seconds(1);
+/** how long to sleep between checks while waiting for a ping or the server */
+constexpr chrono::milliseconds WAIT_INTERVAL = chrono::milliseconds(100);
+/** how often to log progress */
+constexpr chrono::seconds PROGRESS_INTERVAL = chrono::seconds(5);
+/** bots per room of a server run in this process */
+constexpr unsigned ROOM_SIZE =
+    RoomSettings::MAX_PLAYERS + RoomSettings::MAX_SPECTATORS;
+/** every room of a server run in this process shares one map */
+constexpr uint64_t SEED = 0;
+
+using Clock = chrono::steady_clock;
+
+/** what to load, and how hard */
+struct Settings final {
+  /** nothing to run a server in this process */
+  optional<string> host;
+  uint16_t port = networking::PORT;
+  string room;
+  string password;
+  unsigned bots = 100;
+  /** bots started per second */
+  unsigned ramp = 50;
+  /** seconds to keep going once every bot has started */
+  unsigned duration = 30;
+  /** inputs each bot sends per second */
+  unsigned inputRate = 30;
+  /** ticks per second of a server run in this process */
+  unsigned tickRate = ServerSettings().tickRate;
+};
+
+/** what the bots saw, summed as each one finishes */
+struct Results final {
+  /** connecting and handshaking, not counting waiting for a turn */
+  Histogram handshake;
+  /** from starting to learning the seed */
+  Histogram join;
+  /** from starting to the first pong, which waits on the server's map */
+  Histogram ready;
+  Histogram rtt;
+  uint64_t joined = 0;
+  /** wrong password, or no such room */
+  uint64_t refused = 0;
+  /** no slot left */
+  uint64_t full = 0;
+  map<string, uint64_t> errors;
+  networking::Statistics traffic;
+  uint64_t inputs = 0;
+
+  Results &operator+=(Results const &other) {
+    handshake += other.handshake;
+    join += other.join;
+    ready += other.ready;
+    rtt += other.rtt;
+    joined += other.joined;
+    refused += other.refused;
+    full += other.full;
+    for (auto const &[message, count] : other.errors) errors[message] += count;
+    traffic += other.traffic;
+    inputs += other.inputs;
+    return *this;
+  }
+};
+
+/** a bot's input stream, stepped by the ticker */
+struct Player final {
+  networking::Datagram datagram;
+  mt19937 rng;
+  Input input;
+  uint64_t inputs;
+
+  Player(networking::DatagramKeys const &keys, size_t id)
+      : datagram(keys), rng(static_cast<unsigned>(id)), input(), inputs(0) {
+    input.throttle = 0.5f;
+  }
+
+  /** send the next tick's controls - a wandering turn, and a throttle held
+   * for a while before it changes */
+  void step() {
+    normal_distribution<float> wander(0.0f, 0.15f);
+    uniform_real_distribution<float> control(-1.0f, 1.0f);
+    bernoulli_distribution change(0.02);
+    ++input.sequence;
+    input.turn = clamp(input.turn * 0.9f + wander(rng), -1.0f, 1.0f);
+    if (change(rng)) input.throttle = control(rng);
+    datagram.send(networking::Datagram::Channel::UNRELIABLE_SEQUENCED,
+                  encodeInput(input));
+    ++inputs;
+
+    // nothing to do with what the server sends yet
+    while (datagram.receive()) {
+    }
+  }
+};
+
+json summary(Histogram const &histogram) {
+  json result;
+  result["count"] = histogram.count();
+  result["meanUs"] =
+      chrono::duration<double, micro>(histogram.mean()).count();
+  result["p50Us"] = histogram.percentile(0.5).count();
+  result["p99Us"] = histogram.percentile(0.99).count();
+  result["maxUs"] = chrono::duration<double, micro>(histogram.max()).count();
+  return result;
+}
+
+json summary(TickStatistics const &statistics) {
+  json result;
+  result["ticks"] = statistics.ticks;
+  result["overruns"] = statistics.overruns;
+  result["skipped"] = statistics.skipped;
+  result["lateness"] = summary(statistics.lateness);
+  result["input"] = summary(statistics.input);
+  result["simulate"] = summary(statistics.simulate);
+  result["broadcast"] = summary(statistics.broadcast);
+  result["total"] = summary(statistics.total);
+  return result;
+}
+
+json summary(networking::Statistics const &statistics, double seconds) {
+  json result;
+  result["connections"] = statistics.connections;
+  result["bytesSent"] = statistics.bytesSent;
+  result["bytesReceived"] = statistics.bytesReceived;
+  result["bytesSentPerSecond"] =
+      static_cast<double>(statistics.bytesSent) / seconds;
+  result["bytesReceivedPerSecond"] =
+      static_cast<double>(statistics.bytesReceived) / seconds;
+  result["messagesDropped"] = statistics.messagesDropped;
+  return result;
+}
+
+/**
+ * hundreds of headless clients, each on its own thread like a game::Client,
+ * with one ticker sending every bot's inputs over a shared datagram socket
+ */
+class LoadGenerator final {
+ public:
+  explicit LoadGenerator(Settings const &settings_)
+      : settings(settings_),
+        network(networking::Network::system()),
+        stop(false),
+        handshakes(static_cast<ptrdiff_t>(ThreadPool::defaultSize())),
+        inProcess(),
+        datagrams(),
+        resultsMutex(),
+        results(),
+        playersMutex(),
+        players(),
+        ticks(settings_.inputRate,
+              {[this]() { datagrams->receive(); },
+               [this](uint64_t) {
+                 scoped_lock lock(playersMutex);
+                 for (Player *player : players) player->step();
+               },
+               [this]() { datagrams->send(); }}),
+        ticker(),
+        bots() {}
+
+  json run() {
+    if (!settings.host) startServer();
+    string host = settings.host.value_or("localhost");
+    datagrams = network.connectDatagrams(host, settings.port);
+    ticker = thread([this]() { runTicks(); });
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastProgress = start;
+    auto progress = [this, &lastProgress]() {
+      if (Clock::now() - lastProgress < PROGRESS_INTERVAL) return;
+      lastProgress = Clock::now();
+      scoped_lock lock(playersMutex);
+      clog << bots.size() << " bots started, " << players.size()
+           << " playing" << endl;
+    };
+
+    // spread the handshakes out, as real players would
+    chrono::microseconds rampInterval =
+        chrono::microseconds(1'000'000) / settings.ramp;
+    for (size_t id = 0; id < settings.bots && !interrupted(); ++id) {
+      this_thread::sleep_until(start + rampInterval * id);
+      bots.emplace_back([this, id, host]() { runBot(id, host); });
+      progress();
+    }
+    Clock::time_point end =
+        Clock::now() + chrono::seconds(settings.duration);
+    while (!interrupted() && Clock::now() < end && !stop) {
+      this_thread::sleep_for(INTERRUPT_POLL_INTERVAL);
+      progress();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    stop = true;
+    for (thread &bot : bots) bot.join();
+    ticker.join();
+
+    json report;
+    report["bots"] = bots.size();
+    report["seconds"] = seconds;
+    report["outcomes"]["joined"] = results.joined;
+    report["outcomes"]["refused"] = results.refused;
+    report["outcomes"]["full"] = results.full;
+    uint64_t failed = 0;
+    for (auto const &[message, count] : results.errors) failed += count;
+    report["outcomes"]["failed"] = failed;
+    report["errors"] = results.errors;
+    report["latency"]["handshake"] = summary(results.handshake);
+    report["latency"]["join"] = summary(results.join);
+    report["latency"]["ready"] = summary(results.ready);
+    report["latency"]["rtt"] = summary(results.rtt);
+    report["traffic"] = summary(results.traffic, seconds);
+    report["inputs"]["sent"] = results.inputs;
+    report["inputs"]["perSecond"] =
+        static_cast<double>(results.inputs) / seconds;
+    report["loadgenTicks"] = summary(ticks.getStatistics());
+    if (inProcess) {
+      report["server"]["ticks"] = summary(inProcess->getTickStatistics());
+      report["server"]["traffic"] =
+          summary(inProcess->getStatistics(), seconds);
+      inProcess.reset();
+    }
+    return report;
+  }
+
+ private:
+  Settings const &settings;
+  networking::Network &network;
+  atomic_bool stop;
+  /**
+   * limits key derivations in flight - each takes tens of megabytes, and
+   * would otherwise all start at once
+   */
+  counting_semaphore<> handshakes;
+  unique_ptr<Server> inProcess;
+
+  unique_ptr<networking::DatagramSocket> datagrams;
+  mutex resultsMutex;
+  Results results;
+  /** guards players, and every player's inputs */
+  mutex playersMutex;
+  vector<Player *> players;
+  TickLoop ticks;
+  thread ticker;
+
+  vector<thread> bots;
+
+  /** a server with enough rooms for every bot */
+  void startServer() {
+    wstring_convert<codecvt_utf8<char32_t>, char32_t> converter;
+    vector<RoomSettings> rooms;
+    for (unsigned cnt = 0; cnt * ROOM_SIZE < settings.bots; ++cnt) {
+      RoomSettings room;
+      room.name = roomOf(cnt * ROOM_SIZE);
+      room.password = converter.from_bytes(settings.password);
+      room.players = RoomSettings::MAX_PLAYERS;
+      room.spectators = RoomSettings::MAX_SPECTATORS;
+      room.seed = SEED;
+      rooms.push_back(room);
+    }
+    ServerSettings serverSettings;
+    serverSettings.port = settings.port;
+    serverSettings.tickRate = settings.tickRate;
+    inProcess = make_unique<Server>(rooms, network, serverSettings);
+
+    while (inProcess->state == Server::State::STARTING)
+      this_thread::sleep_for(WAIT_INTERVAL);
+    if (inProcess->state == Server::State::ERROR)
+      throw SocketException("Could not start server: " +
+                            inProcess->errorMessage);
+  }
+
+  string roomOf(size_t id) const {
+    if (settings.host) return settings.room;
+    return "load" + to_string(id / ROOM_SIZE);
+  }
+
+  void runTicks() noexcept {
+    try {
+      ticks.run(stop);
+    } catch (SocketException const &e) {
+      clog << "ticker failed: " << static_cast<string>(e) << endl;
+      stop = true;
+    }
+  }
+
+  void runBot(size_t id, string const &host) noexcept {
+    Clock::time_point start = Clock::now();
+    Results mine;
+    unique_ptr<networking::Connection> connection;
+    try {
+      optional<networking::Ticket> ticket;
+      bool handshaken;
+      {
+        // connect only once we can handshake - the server handshakes in the
+        // order it accepts, and would otherwise wait on bots still queued here
+        handshakes.acquire();
+        ScopeGuard release([this]() { handshakes.release(); });
+        Clock::time_point connecting = Clock::now();
+        connection = network.connect(host, settings.port, stop);
+        handshaken =
+            connection->handshake(roomOf(id), settings.password, ticket);
+        mine.handshake.record(Clock::now() - connecting);
+      }
+      if (!handshaken) {
+        ++mine.refused;
+      } else {
+        uint8_t role;
+        *connection >> role;
+        if (role > static_cast<uint8_t>(Role::SPECTATOR))
+          throw FormatException("unknown role from server");
+        if (static_cast<Role>(role) == Role::NONE) {
+          ++mine.full;
+        } else {
+          uint64_t seed;
+          *connection >> seed;
+          mine.join.record(Clock::now() - start);
+          ++mine.joined;
+          play(*connection, id, start, mine);
+        }
+      }
+    } catch (SocketException const &e) {
+      ++mine.errors[static_cast<string>(e)];
+    } catch (FormatException const &e) {
+      ++mine.errors[e.what()];
+    } catch (StopFlag const &) {
+    }
+
+    if (connection) mine.traffic += connection->getStatistics();
+    scoped_lock lock(resultsMutex);
+    results += mine;
+  }
+
+  /** send inputs and measure round trips until stopped */
+  void play(networking::Connection &connection, size_t id,
+            Clock::time_point start, Results &mine) {
+    Player player(connection.getDatagramKeys(), id);
+    // an empty datagram gives the server this bot's address before any input
+    player.datagram.send(networking::Datagram::Channel::RELIABLE_ORDERED, {});
+    {
+      scoped_lock lock(playersMutex);
+      datagrams->attach(player.datagram);
+      players.push_back(&player);
+    }
+    ScopeGuard leave([this, &player, &mine]() {
+      scoped_lock lock(playersMutex);
+      erase(players, &player);
+      datagrams->detach(player.datagram);
+      mine.inputs += player.inputs;
+    });
+
+    networking::ClockSync clock;
+    bool first = true;
+    while (!stop) {
+      Clock::time_point sent = Clock::now();
+      clock.ping(connection);
+      connection.flush();
+      // the server pings back - answer while waiting for our pong
+      while (clock.receive(connection) !=
+             networking::ClockSync::Message::PONG)
+        connection.flush();
+      Clock::time_point received = Clock::now();
+      if (first)
+        mine.ready.record(received - start);
+      else
+        mine.rtt.record(received - sent);
+      first = false;
+
+      while (!stop && Clock::now() < sent + PING_INTERVAL)
+        this_thread::sleep_for(WAIT_INTERVAL);
+    }
+  }
+};
+
+void usage(ostream &out, char const *name) {
+  out << "Usage: " << name << " [options]\n"
+      << "Loads an AireWar server with headless bots, and reports what they "
+         "saw.\n\n"
+      << "  --host HOST           server to load; without it, one is run in\n"
+      << "                        this process, with rooms for every bot\n"
+      << "  --port PORT           TCP and UDP port (default "
+      << networking::PORT << ")\n"
+      << "  --room NAME           room to join on --host (default the "
+         "default room)\n"
+      << "  --password PASSWORD   password to give; defaults to\n"
+      << "                        $AIREWAR_PASSWORD, or no password\n"
+      << "  --bots N              bots to run, 1 to " << MAX_BOTS
+      << " (default " << Settings().bots << ")\n"
+      << "  --ramp N              bots started per second (default "
+      << Settings().ramp << ")\n"
+      << "  --duration N          seconds to run once every bot has started\n"
+      << "                        (default " << Settings().duration << ")\n"
+      << "  --input-rate N        inputs each bot sends per second, 1 to "
+      << ServerSettings::MAX_TICK_RATE << " (default "
+      << Settings().inputRate << ")\n"
+      << "  --tick-rate N         ticks per second of a server run in this\n"
+      << "                        process, 1 to "
+      << ServerSettings::MAX_TICK_RATE << " (default "
+      << Settings().tickRate << ")\n"
+      << "  --help                show this message" << endl;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  if (char const *fromEnvironment = getenv("AIREWAR_PASSWORD"); fromEnvironment)
+    settings.password = fromEnvironment;
+
+  optional<int> exitStatus = parseOptions(
+      argc, argv, usage, [&settings](string_view option, string_view value) {
+        bool valid = true;
+        if (option == "--host") {
+          settings.host = value;
+        } else if (option == "--port") {
+          optional<uint16_t> port = parseNumber<uint16_t>(value, UINT16_MAX);
+          valid = port.has_value();
+          if (valid) settings.port = *port;
+        } else if (option == "--room") {
+          valid = value.length() <= networking::MAX_ROOM_LENGTH;
+          settings.room = value;
+        } else if (option == "--password") {
+          settings.password = value;
+        } else if (option == "--bots") {
+          optional<unsigned> bots = parseNumber(value, MAX_BOTS);
+          valid = bots.has_value() && *bots != 0;
+          if (valid) settings.bots = *bots;
+        } else if (option == "--ramp") {
+          optional<unsigned> ramp = parseNumber(value, MAX_BOTS);
+          valid = ramp.has_value() && *ramp != 0;
+          if (valid) settings.ramp = *ramp;
+        } else if (option == "--duration") {
+          optional<unsigned> duration = parseNumber(value, UINT32_MAX);
+          valid = duration.has_value();
+          if (valid) settings.duration = *duration;
+        } else if (option == "--input-rate") {
+          optional<unsigned> inputRate =
+              parseNumber(value, ServerSettings::MAX_TICK_RATE);
+          valid = inputRate.has_value() && *inputRate != 0;
+          if (valid) settings.inputRate = *inputRate;
+        } else if (option == "--tick-rate") {
+          optional<unsigned> tickRate =
+              parseNumber(value, ServerSettings::MAX_TICK_RATE);
+          valid = tickRate.has_value() && *tickRate != 0;
+          if (valid) settings.tickRate = *tickRate;
+        } else {
+          return OptionStatus::UNKNOWN;
+        }
+        return valid ? OptionStatus::VALID : OptionStatus::INVALID;
+      });
+  if (exitStatus) return *exitStatus;
+
+  if (sodium_init() == -1) {
+    cerr << "ERROR: Could not initialize libsodium" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // stop early, still reporting, on SIGINT and SIGTERM
+  catchSignals();
+
+  try {
+    LoadGenerator generator(settings);
+    cout << generator.run().dump(2) << endl;
+    return EXIT_SUCCESS;
+  } catch (SocketException const &e) {
+    cerr << "Load generation failed: " << static_cast<string>(e) << endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,171 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <vector>
+
+#include "game/map.h"
+#include "game/movement.h"
+#include "game/snapshot.h"
+#include "util/exceptions/formatException.h"
+#include "util/geometry.h"
+
+using namespace std;
+using namespace nlohmann;
+using namespace airewar::game;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace {
+constexpr unsigned LOBBY_SIZES[] = {2, 4, 8, 16, 32, 64, 128};
+constexpr size_t TICKS = 300;
+constexpr float TICK_LENGTH = 1.0f / 30.0f;
+/** ticks before a client's acknowledgement reaches the server */
+constexpr uint32_t ACK_DELAY = 3;
+
+using Clock = chrono::steady_clock;
+
+/** bytes of heap in use, by the whole process */
+double heapBytes() { return static_cast<double>(mallinfo2().uordblks); }
+
+/** every player flying about at random */
+class Match final {
+ public:
+  explicit Match(unsigned players) : rng(players), states(), tick(0) {
+    uniform_real_distribution<float> lat(-1.0f, 1.0f);
+    uniform_real_distribution<float> lon(-3.0f, 3.0f);
+    for (unsigned cnt = 0; cnt < players; ++cnt)
+      states.push_back(EntityState{
+          sphericalToCartesian(lat(rng), lon(rng), Map::RADIUS), 0.0f,
+          200.0f});
+  }
+
+  Snapshot step() {
+    uniform_real_distribution<float> control(-1.0f, 1.0f);
+    Snapshot snapshot;
+    snapshot.tick = ++tick;
+    for (uint32_t id = 0; id < states.size(); ++id) {
+      states[id] = simulate(states[id],
+                            Input{tick, control(rng), control(rng)},
+                            TICK_LENGTH);
+      snapshot.entities[id] = QuantizedState::quantize(states[id]);
+    }
+    return snapshot;
+  }
+
+ private:
+  mt19937 rng;
+  vector<EntityState> states;
+  uint32_t tick;
+};
+
+/**
+ * the snapshot encoding a server does for a lobby, with every client's
+ * encoder working alone or sharing encodings through a SnapshotBroadcast
+ *
+ * only the encoding is timed - no server, session, or socket is involved;
+ * airewar-loadgen measures a whole server's ticks
+ */
+json lobby(unsigned players, bool shared) {
+  Match match(players);
+  vector<SnapshotEncoder> encoders(players);
+  // nothing else runs alongside, so growth from here is what the encoders
+  // hold on to
+  double baseHeap = heapBytes();
+
+  Clock::duration busy = Clock::duration::zero();
+  size_t bytes = 0;
+  size_t encodings = 0;
+  for (size_t cnt = 0; cnt < TICKS; ++cnt) {
+    Snapshot snapshot = match.step();
+    Clock::time_point start = Clock::now();
+    if (shared) {
+      SnapshotBroadcast broadcast(move(snapshot));
+      for (SnapshotEncoder &encoder : encoders)
+        bytes += encoder.encode(broadcast).size();
+      encodings += broadcast.size();
+    } else {
+      for (SnapshotEncoder &encoder : encoders)
+        bytes += encoder.encode(snapshot).size();
+      encodings += encoders.size();
+    }
+    busy += Clock::now() - start;
+
+    uint32_t tick = static_cast<uint32_t>(cnt + 1);
+    if (tick > ACK_DELAY)
+      for (SnapshotEncoder &encoder : encoders)
+        encoder.acknowledge(tick - ACK_DELAY);
+  }
+
+  double ticks = static_cast<double>(TICKS);
+  json result;
+  result["encodeUs"] = chrono::duration<double, micro>(busy).count() / ticks;
+  result["bytesPerTick"] = static_cast<double>(bytes) / ticks;
+  result["bytesPerClientPerTick"] =
+      static_cast<double>(bytes) / ticks / players;
+  result["encodingsPerTick"] = static_cast<double>(encodings) / ticks;
+  // the encoders' histories are still alive here
+  result["encoderHeapBytesPerClient"] = (heapBytes() - baseHeap) / players;
+  return result;
+}
+
+/** how a cost grows with lobby size - 1 is linear, below 1 sub-linear */
+double exponent(json const &small, json const &large, char const *key) {
+  double sizes = static_cast<double>(LOBBY_SIZES[size(LOBBY_SIZES) - 1]) /
+                 static_cast<double>(LOBBY_SIZES[0]);
+  return log(large[key].get<double>() / small[key].get<double>()) /
+         log(sizes);
+}
+}  // namespace
+
+int main() {
+  try {
+    json report;
+    for (bool shared : {false, true}) {
+      json runs = json::array();
+      for (unsigned players : LOBBY_SIZES) {
+        json run = lobby(players, shared);
+        run["players"] = players;
+        runs.push_back(run);
+      }
+
+      json scaling;
+      for (char const *key :
+           {"encodeUs", "bytesPerClientPerTick", "encoderHeapBytesPerClient"})
+        scaling[key] = exponent(runs.front(), runs.back(), key);
+      json &section = report[shared ? "shared" : "perClient"];
+      section["lobbies"] = runs;
+      section["scalingExponent"] = scaling;
+    }
+
+    cout << report.dump(2) << endl;
+    return EXIT_SUCCESS;
+  } catch (FormatException const &e) {
+    cerr << "Benchmark failed: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,315 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "game/networking/loopback/networking.h"
+#include "game/networking/message.h"
+#include "game/networking/networking.h"
+#include "util/exceptions/socketException.h"
+#include "util/exceptions/stopFlag.h"
+
+using namespace std;
+using namespace nlohmann;
+using namespace airewar::game::networking;
+using namespace airewar::util::exceptions;
+
+namespace {
+constexpr size_t SERIALIZATION_OPS = 1'000'000;
+constexpr size_t THROUGHPUT_CHUNK_SIZE = 64 * 1024;
+constexpr size_t THROUGHPUT_CHUNKS = 1024;
+constexpr size_t BROADCAST_PEERS = 32;
+constexpr size_t BROADCAST_VALUES = 256;
+constexpr size_t BROADCASTS = 200;
+constexpr size_t FULL_HANDSHAKES = 10;
+constexpr size_t RESUMED_HANDSHAKES = 200;
+constexpr size_t ROUND_TRIPS = 2000;
+
+constexpr char const *PASSWORD = "benchmark";
+
+using Clock = chrono::steady_clock;
+
+double seconds(Clock::duration duration) {
+  return chrono::duration<double>(duration).count();
+}
+
+/** p50/p99/mean of a set of latencies, in microseconds */
+json percentiles(vector<Clock::duration> samples) {
+  sort(samples.begin(), samples.end());
+  auto micros = [](Clock::duration duration) {
+    return chrono::duration<double, micro>(duration).count();
+  };
+  Clock::duration total = Clock::duration(0);
+  for (Clock::duration sample : samples) total += sample;
+
+  json result;
+  result["samples"] = samples.size();
+  result["p50Us"] = micros(samples[samples.size() * 50 / 100]);
+  result["p99Us"] =
+      micros(samples[min(samples.size() - 1, samples.size() * 99 / 100)]);
+  result["meanUs"] = micros(total) / static_cast<double>(samples.size());
+  return result;
+}
+
+/** write then read back SERIALIZATION_OPS copies of a value */
+template <typename T>
+json serialization(Connection &writer, Connection &reader, T const &value) {
+  Clock::time_point start = Clock::now();
+  for (size_t cnt = 0; cnt < SERIALIZATION_OPS; ++cnt) writer << value;
+  writer.flush();
+  Clock::duration writeTime = Clock::now() - start;
+
+  start = Clock::now();
+  T read;
+  for (size_t cnt = 0; cnt < SERIALIZATION_OPS; ++cnt) reader >> read;
+  Clock::duration readTime = Clock::now() - start;
+
+  json result;
+  result["writeOpsPerSec"] = static_cast<double>(SERIALIZATION_OPS) /
+                             seconds(writeTime);
+  result["readOpsPerSec"] = static_cast<double>(SERIALIZATION_OPS) /
+                            seconds(readTime);
+  return result;
+}
+
+json serializationAll(Connection &writer, Connection &reader) {
+  json result;
+  result["bool"] = serialization(writer, reader, true);
+  result["uint8"] = serialization(writer, reader, uint8_t{0x12});
+  result["uint16"] = serialization(writer, reader, uint16_t{0x1234});
+  result["uint32"] = serialization(writer, reader, uint32_t{0x12345678});
+  result["uint64"] =
+      serialization(writer, reader, uint64_t{0x123456789abcdef0});
+  result["int32"] = serialization(writer, reader, int32_t{-12345678});
+  result["int64"] = serialization(writer, reader, int64_t{-0x123456789abcdef0});
+  result["float"] = serialization(writer, reader, 1.5f);
+  result["double"] = serialization(writer, reader, 1.5);
+  result["char32"] = serialization(writer, reader, U'é');
+  result["u8string"] = serialization(writer, reader, u8string(u8"player name"));
+  result["u32string"] =
+      serialization(writer, reader, u32string(U"player name"));
+  return result;
+}
+
+/**
+ * queue a snapshot for BROADCAST_PEERS peers, serialized for each peer or
+ * once and shared
+ *
+ * every copy goes through the one writer, standing in for many connections
+ */
+json broadcast(Connection &writer, Connection &reader) {
+  auto drain = [&writer, &reader]() {
+    writer.flush();
+    uint32_t read;
+    for (size_t cnt = 0; cnt < BROADCAST_PEERS * BROADCAST_VALUES; ++cnt)
+      reader >> read;
+  };
+
+  Clock::duration perPeerTime = Clock::duration::zero();
+  for (size_t round = 0; round < BROADCASTS; ++round) {
+    Clock::time_point start = Clock::now();
+    for (size_t peer = 0; peer < BROADCAST_PEERS; ++peer)
+      for (uint32_t value = 0; value < BROADCAST_VALUES; ++value)
+        writer << value;
+    perPeerTime += Clock::now() - start;
+    drain();
+  }
+
+  Clock::duration sharedTime = Clock::duration::zero();
+  for (size_t round = 0; round < BROADCASTS; ++round) {
+    Clock::time_point start = Clock::now();
+    MessageBuilder builder;
+    for (uint32_t value = 0; value < BROADCAST_VALUES; ++value)
+      builder << value;
+    Message message = builder.build();
+    for (size_t peer = 0; peer < BROADCAST_PEERS; ++peer) writer << message;
+    sharedTime += Clock::now() - start;
+    drain();
+  }
+
+  json result;
+  result["perPeerBroadcastsPerSec"] =
+      static_cast<double>(BROADCASTS) / seconds(perPeerTime);
+  result["sharedBroadcastsPerSec"] =
+      static_cast<double>(BROADCASTS) / seconds(sharedTime);
+  return result;
+}
+
+/** encrypted bytes per second through send and recv */
+json throughput(Connection &writer, Connection &reader) {
+  vector<uint8_t> chunk(THROUGHPUT_CHUNK_SIZE);
+  randombytes_buf(chunk.data(), chunk.size());
+
+  Clock::time_point start = Clock::now();
+  for (size_t cnt = 0; cnt < THROUGHPUT_CHUNKS; ++cnt)
+    writer << span<uint8_t const>(chunk);
+  writer.flush();
+  Clock::duration sendTime = Clock::now() - start;
+
+  start = Clock::now();
+  span<uint8_t const> read;
+  for (size_t cnt = 0; cnt < THROUGHPUT_CHUNKS; ++cnt) reader >> read;
+  Clock::duration recvTime = Clock::now() - start;
+
+  double bytes = static_cast<double>(THROUGHPUT_CHUNK_SIZE * THROUGHPUT_CHUNKS);
+  json result;
+  result["sendBytesPerSec"] = bytes / seconds(sendTime);
+  result["recvBytesPerSec"] = bytes / seconds(recvTime);
+  return result;
+}
+
+/**
+ * serve handshakes and echoes over TCP until stopped
+ *
+ * each client sends how many pings it will make, then makes them
+ */
+void echoServer(Server &server, atomic_bool const &stop) {
+  TicketKey ticketKey;
+  try {
+    while (!stop) {
+      unique_ptr<Connection> connection = server.accept();
+      if (!connection) continue;
+      try {
+        if (!connection->handshake(PASSWORD, ticketKey)) continue;
+        uint32_t pings;
+        *connection >> pings;
+        for (uint32_t cnt = 0; cnt < pings; ++cnt) {
+          uint32_t ping;
+          *connection >> ping;
+          *connection << ping;
+          connection->flush();
+        }
+      } catch (SocketException const &) {
+        // client went away - wait for the next one
+      }
+    }
+  } catch (StopFlag const &) {
+  }
+}
+
+json handshakes(atomic_bool const &stop) {
+  vector<Clock::duration> full;
+  for (size_t cnt = 0; cnt < FULL_HANDSHAKES; ++cnt) {
+    unique_ptr<Connection> client =
+        Connection::makeClient("localhost", PORT, stop);
+    optional<Ticket> ticket;
+    Clock::time_point start = Clock::now();
+    if (!client->handshake(PASSWORD, ticket))
+      throw SocketException("Handshake failed");
+    full.push_back(Clock::now() - start);
+    *client << uint32_t{0};
+    client->flush();
+  }
+
+  vector<Clock::duration> resumed;
+  optional<Ticket> ticket;
+  for (size_t cnt = 0; cnt < RESUMED_HANDSHAKES + 1; ++cnt) {
+    unique_ptr<Connection> client =
+        Connection::makeClient("localhost", PORT, stop);
+    bool resuming = ticket.has_value();
+    Clock::time_point start = Clock::now();
+    if (!client->handshake(PASSWORD, ticket))
+      throw SocketException("Handshake failed");
+    if (resuming) resumed.push_back(Clock::now() - start);
+    *client << uint32_t{0};
+    client->flush();
+  }
+
+  json result;
+  result["full"] = percentiles(move(full));
+  result["resumed"] = percentiles(move(resumed));
+  return result;
+}
+
+json roundTrips(atomic_bool const &stop) {
+  unique_ptr<Connection> client =
+      Connection::makeClient("localhost", PORT, stop);
+  optional<Ticket> ticket;
+  if (!client->handshake(PASSWORD, ticket))
+    throw SocketException("Handshake failed");
+  *client << static_cast<uint32_t>(ROUND_TRIPS);
+  client->flush();
+
+  vector<Clock::duration> samples;
+  for (uint32_t cnt = 0; cnt < ROUND_TRIPS; ++cnt) {
+    Clock::time_point start = Clock::now();
+    *client << cnt;
+    client->flush();
+    uint32_t pong;
+    *client >> pong;
+    samples.push_back(Clock::now() - start);
+  }
+  return percentiles(move(samples));
+}
+}  // namespace
+
+int main() {
+  if (sodium_init() == -1) {
+    cerr << "Could not initialize libsodium" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    json report;
+    atomic_bool stop(false);
+
+    {
+      loopback::Network network(loopback::Conditions{});
+      auto [writer, reader] = network.connectedPair(stop);
+      report["serialization"] = serializationAll(*writer, *reader);
+      report["broadcast"] = broadcast(*writer, *reader);
+      report["throughput"] = throughput(*writer, *reader);
+    }
+
+    {
+      unique_ptr<Server> server = Server::makeServer(PORT, PASSWORD, stop);
+      thread serverThread([&server, &stop]() { echoServer(*server, stop); });
+      try {
+        report["handshake"] = handshakes(stop);
+        report["roundTrip"] = roundTrips(stop);
+      } catch (...) {
+        stop = true;
+        serverThread.join();
+        throw;
+      }
+      stop = true;
+      serverThread.join();
+    }
+
+    cout << report.dump(2) << endl;
+    return EXIT_SUCCESS;
+  } catch (SocketException const &e) {
+    cerr << "Benchmark failed: " << static_cast<string>(e) << endl;
+    return EXIT_FAILURE;
+  }
+}
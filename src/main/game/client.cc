@@ -20,10 +20,15 @@
 #include "game/client.h"
 
 #include <codecvt>
+#include <future>
 #include <locale>
+#include <map>
+#include <mutex>
+#include <optional>
 
-#include "options.h"
+#include "game/mapCache.h"
 #include "sodium.h"
+#include "util/exceptions/formatException.h"
 #include "util/exceptions/socketException.h"
 #include "util/exceptions/stopFlag.h"
 
@@ -32,56 +37,135 @@ using namespace airewar::util::exceptions;
 using namespace airewar::game::networking;
 
 namespace airewar::game {
-Client::Client(u32string const &address, u32string const &password) noexcept
+namespace {
+/** resumption tickets from previous connections, by "host/room" address */
+map<u32string, Ticket> tickets;
+mutex ticketMutex;
+
+/** clock samples taken before the game starts */
+constexpr size_t CLOCK_SYNC_PINGS = 8;
+
+/** how often datagrams are sent and received - the server's default */
+constexpr unsigned DATAGRAM_RATE = 30;
+}  // namespace
+
+Client::Client(u32string const &address, u32string const &password,
+               networking::Network &network) noexcept
     : map(),
       state(State::STARTING),
       errorMessage(),
+      role(Role::NONE),
+      clock(),
       address(address),
       password(password),
+      network(network),
       stop(false),
       connection(),
+      datagrams(),
+      datagram(),
+      ticks(DATAGRAM_RATE, {[this]() { datagrams->receive(); },
+                            [](uint64_t) {},
+                            [this]() { datagrams->send(); }}),
+      ticker(),
       thread([this]() { return run(); }) {}
 
 Client::~Client() noexcept {
   stop = true;
   thread.join();
+  if (ticker.joinable()) ticker.join();
 }
 
 void Client::run() noexcept {
   try {
     wstring_convert<codecvt_utf8<char32_t>, char32_t> converter;
     string addressStr = converter.to_bytes(address);
-    connection = networking::Connection::makeClient(converter.to_bytes(address),
-                                                    networking::PORT, stop);
+    // "host/room" joins a room on a server hosting several
+    string room;
+    if (size_t slash = addressStr.find('/'); slash != string::npos) {
+      room = addressStr.substr(slash + 1);
+      addressStr.resize(slash);
+    }
+    connection = network.connect(addressStr, networking::PORT, stop);
 
-    if (!connection->handshake(converter.to_bytes(password))) {
+    optional<Ticket> ticket;
+    {
+      scoped_lock lock(ticketMutex);
+      if (auto found = tickets.find(address); found != tickets.end()) {
+        ticket = found->second;
+        tickets.erase(found);
+      }
+    }
+
+    if (!connection->handshake(room, converter.to_bytes(password), ticket)) {
       errorMessage = "Incorrect password";
       state = State::ERROR;
       return;
     }
 
-    bool hasSlot;
-    *connection >> hasSlot;
-    if (!hasSlot) {
+    {
+      scoped_lock lock(ticketMutex);
+      tickets.insert_or_assign(address, *ticket);
+    }
+
+    // the server learns where to send datagrams from our first one, which is
+    // resent until the server has attached our session and acked it
+    datagrams = network.connectDatagrams(addressStr, networking::PORT);
+    datagram = make_unique<Datagram>(connection->getDatagramKeys());
+    datagrams->attach(*datagram);
+    datagram->send(Datagram::Channel::RELIABLE_ORDERED, {});
+    ticker = std::thread([this]() { runTicks(); });
+
+    uint8_t joinedAs;
+    *connection >> joinedAs;
+    if (joinedAs > static_cast<uint8_t>(Role::SPECTATOR))
+      throw FormatException("unknown role from server");
+    if (static_cast<Role>(joinedAs) == Role::NONE) {
       errorMessage = "No slot available";
       state = State::ERROR;
       return;
     }
+    role = static_cast<Role>(joinedAs);
 
     uint64_t seed;
     *connection >> seed;
+    // the server holds us until its own map is done, so build ours meanwhile
+    future<MapCache::Handle> generating = async(
+        launch::async, [seed]() { return MapCache::shared().get(seed); });
+
+    // settle on a shared timebase before anything needs one
+    for (size_t cnt = 0; cnt < CLOCK_SYNC_PINGS; ++cnt) {
+      clock.ping(*connection);
+      connection->flush();
+      // the server pings back - answer while waiting for our pong
+      while (clock.receive(*connection) != ClockSync::Message::PONG)
+        connection->flush();
+    }
+    *connection >> networking::Connection::Channel::DEFAULT;
     state = State::GENERATING_MAP;
-    map.generate(seed);
+    // a server in this process will have shared its map
+    map = generating.get();
 
     // TODO: rest of game logic
   } catch (SocketException const &e) {
     errorMessage = static_cast<string>(e);
     state = State::ERROR;
     return;
+  } catch (FormatException const &e) {
+    errorMessage = e.what();
+    state = State::ERROR;
+    return;
   } catch (StopFlag const &) {
     return;
   }
 }
 
+void Client::runTicks() noexcept {
+  try {
+    ticks.run(stop);
+  } catch (SocketException const &) {
+    // the connection notices a dead server too, and reports it
+  }
+}
+
 unique_ptr<Client> client;
 }  // namespace airewar::game
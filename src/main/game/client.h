@@ -25,13 +25,18 @@
 #include <string>
 #include <thread>
 
-#include "game/map.h"
+#include "game/mapCache.h"
+#include "game/networking/clockSync.h"
+#include "game/networking/datagram.h"
 #include "game/networking/networking.h"
+#include "game/role.h"
+#include "game/tickLoop.h"
 
 namespace airewar::game {
 class Client final {
  public:
-  Map map;
+  /** set once the server has said which map to play on */
+  MapCache::Handle map;
 
   enum class State {
     STARTING,
@@ -41,9 +46,14 @@ class Client final {
   };
   std::atomic<State> state;
   std::string errorMessage;
+  /** what the server let us join as - NONE until it says */
+  std::atomic<Role> role;
+  /** the server's clock, as seen from here */
+  networking::ClockSync clock;
 
-  Client(std::u32string const &address,
-         std::u32string const &password) noexcept;
+  /** @param address a host, or "host/room" to join a particular room */
+  Client(std::u32string const &address, std::u32string const &password,
+         networking::Network &network = networking::Network::system()) noexcept;
   Client(Client const &) noexcept = delete;
   Client(Client &&) noexcept = delete;
 
@@ -55,12 +65,19 @@ class Client final {
  private:
   std::u32string address;
   std::u32string password;
+  networking::Network &network;
   std::atomic_bool stop;
   std::unique_ptr<networking::Connection> connection;
+  std::unique_ptr<networking::DatagramSocket> datagrams;
+  std::unique_ptr<networking::Datagram> datagram;
+  /** keeps the datagram socket moving while run blocks on the connection */
+  TickLoop ticks;
+  std::thread ticker;
 
   std::thread thread;
 
   void run() noexcept;
+  void runTicks() noexcept;
 };
 
 extern std::unique_ptr<Client> client;
@@ -0,0 +1,128 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/interpolation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "game/map.h"
+#include "game/movement.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+using namespace std;
+using namespace glm;
+
+namespace airewar::game {
+namespace {
+/** standard deviations' worth of jitter added to the delay, roughly */
+constexpr int JITTER_MARGIN = 3;
+/** smoothing for the transit time and jitter (as in RFC 3550) */
+constexpr int TRANSIT_GAIN = 16;
+constexpr int INTERVAL_GAIN = 8;
+
+EntityState blend(EntityState const &from, EntityState const &to,
+                  float t) noexcept {
+  float heading =
+      from.heading + remainder(to.heading - from.heading, two_pi<float>()) * t;
+  if (heading < 0.0f) heading += two_pi<float>();
+  if (heading >= two_pi<float>()) heading -= two_pi<float>();
+  return EntityState{
+      Map::RADIUS * normalize(mix(from.position, to.position, t)),
+      heading,
+      mix(from.speed, to.speed, t),
+  };
+}
+}  // namespace
+
+Interpolator::Interpolator(Clock::duration tickLength) noexcept
+    : tickLength(tickLength),
+      frames(),
+      transit(),
+      lastTransit(Clock::duration::zero()),
+      jitterEstimate(Clock::duration::zero()),
+      interval(tickLength) {}
+
+void Interpolator::push(Snapshot const &snapshot, Clock::time_point arrival) {
+  Clock::duration time = snapshot.tick * tickLength;
+  // late duplicates and reorderings have nothing to add
+  if (!frames.empty() && time <= frames.back().time) return;
+
+  Clock::duration thisTransit = arrival.time_since_epoch() - time;
+  if (!transit) {
+    transit = thisTransit;
+  } else {
+    jitterEstimate +=
+        (chrono::abs(thisTransit - lastTransit) - jitterEstimate) /
+        TRANSIT_GAIN;
+    *transit += (thisTransit - *transit) / TRANSIT_GAIN;
+    interval += (time - frames.back().time - interval) / INTERVAL_GAIN;
+  }
+  lastTransit = thisTransit;
+
+  Frame frame{time, {}};
+  for (auto const &[id, state] : snapshot.entities)
+    frame.entities.emplace(id, state.dequantize());
+  frames.push_back(move(frame));
+  if (frames.size() > BUFFER_SIZE) frames.pop_front();
+}
+
+map<uint32_t, EntityState> Interpolator::sample(Clock::time_point now) {
+  if (frames.empty()) return {};
+
+  Clock::duration renderTime = now.time_since_epoch() - *transit - delay();
+  // keep the newest frame at or before the render time, and everything after
+  while (frames.size() >= 2 && frames[1].time <= renderTime) frames.pop_front();
+
+  Frame const &from = frames.front();
+  if (renderTime <= from.time) return from.entities;
+
+  map<uint32_t, EntityState> entities;
+  if (frames.size() == 1) {
+    // the next snapshot is late - carry on as we were, for a while
+    float ahead = chrono::duration<float>(
+                      std::min(renderTime - from.time, MAX_EXTRAPOLATION))
+                      .count();
+    for (auto const &[id, state] : from.entities)
+      entities.emplace(id, simulate(state, Input{}, ahead));
+    return entities;
+  }
+
+  Frame const &to = frames[1];
+  float t = chrono::duration<float>(renderTime - from.time) /
+            chrono::duration<float>(to.time - from.time);
+  for (auto const &[id, state] : to.entities) {
+    auto old = from.entities.find(id);
+    entities.emplace(id, old == from.entities.end()
+                             ? state
+                             : blend(old->second, state, t));
+  }
+  return entities;
+}
+
+Interpolator::Clock::duration Interpolator::delay() const noexcept {
+  return std::clamp(interval + JITTER_MARGIN * jitterEstimate, MIN_DELAY,
+                    MAX_DELAY);
+}
+
+Interpolator::Clock::duration Interpolator::jitter() const noexcept {
+  return jitterEstimate;
+}
+}  // namespace airewar::game
@@ -0,0 +1,93 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_INTERPOLATION_H_
+#define AIREWAR_GAME_INTERPOLATION_H_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+
+#include "game/snapshot.h"
+
+namespace airewar::game {
+/**
+ * renders remote entities a little in the past, between the server
+ * snapshots either side
+ *
+ * the delay behind the newest snapshot is one snapshot interval plus a
+ * margin for the measured jitter, so smooth motion doesn't need a high
+ * send rate; if a snapshot is late anyway, entities are briefly
+ * extrapolated
+ */
+class Interpolator final {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr Clock::duration MIN_DELAY = std::chrono::milliseconds(20);
+  static constexpr Clock::duration MAX_DELAY = std::chrono::milliseconds(500);
+  /** how far past the newest snapshot entities are extrapolated */
+  static constexpr Clock::duration MAX_EXTRAPOLATION =
+      std::chrono::milliseconds(250);
+  /** snapshots buffered at most */
+  static constexpr size_t BUFFER_SIZE = 32;
+
+  /** @param tickLength server time between ticks */
+  explicit Interpolator(Clock::duration tickLength) noexcept;
+  Interpolator(Interpolator const &) noexcept = default;
+  Interpolator(Interpolator &&) noexcept = default;
+
+  ~Interpolator() noexcept = default;
+
+  Interpolator &operator=(Interpolator const &) noexcept = default;
+  Interpolator &operator=(Interpolator &&) noexcept = default;
+
+  /** buffer a snapshot that arrived at the given time */
+  void push(Snapshot const &snapshot, Clock::time_point arrival);
+
+  /** every entity's state as it should be drawn at time now */
+  std::map<uint32_t, EntityState> sample(Clock::time_point now);
+
+  /** current delay behind the newest snapshot */
+  Clock::duration delay() const noexcept;
+  /** smoothed variation in snapshot transit times */
+  Clock::duration jitter() const noexcept;
+
+ private:
+  struct Frame final {
+    /** server time of the snapshot */
+    Clock::duration time;
+    std::map<uint32_t, EntityState> entities;
+  };
+
+  Clock::duration tickLength;
+  std::deque<Frame> frames;
+
+  /** arrival minus server time, smoothed - maps server time to ours */
+  std::optional<Clock::duration> transit;
+  Clock::duration lastTransit = Clock::duration::zero();
+  Clock::duration jitterEstimate = Clock::duration::zero();
+  /** server time between snapshots, smoothed */
+  Clock::duration interval;
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_INTERPOLATION_H_
@@ -0,0 +1,117 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/mapCache.h"
+
+#include <exception>
+
+using namespace std;
+
+namespace airewar::game {
+MapCache::MapCache() noexcept : mutex(), entries() {}
+
+shared_future<MapCache::Handle> MapCache::request(
+    uint64_t seed, util::ThreadPool &workers, function<void()> onReady) {
+  pair<shared_future<Handle>, shared_ptr<promise<Handle>>> found =
+      find(seed, onReady);
+  if (found.second)
+    workers.post([this, seed, generating = move(found.second)]() {
+      generate(seed, *generating);
+    });
+  // not taken, so the map is already done
+  if (onReady) onReady();
+  return found.first;
+}
+
+MapCache::Handle MapCache::get(uint64_t seed) {
+  function<void()> onReady;
+  pair<shared_future<Handle>, shared_ptr<promise<Handle>>> found =
+      find(seed, onReady);
+  if (found.second) generate(seed, *found.second);
+  return found.first.get();
+}
+
+size_t MapCache::size() noexcept {
+  scoped_lock lock(mutex);
+  size_t count = 0;
+  for (auto const &[seed, entry] : entries)
+    if (entry.pending.valid() || !entry.map.expired()) ++count;
+  return count;
+}
+
+MapCache &MapCache::shared() noexcept {
+  static MapCache cache;
+  return cache;
+}
+
+pair<shared_future<MapCache::Handle>, shared_ptr<promise<MapCache::Handle>>>
+MapCache::find(uint64_t seed, function<void()> &onReady) {
+  scoped_lock lock(mutex);
+  erase_if(entries, [](auto const &entry) {
+    return !entry.second.pending.valid() && entry.second.map.expired();
+  });
+
+  Entry &entry = entries[seed];
+  if (Handle map = entry.map.lock(); map) {
+    promise<Handle> ready;
+    ready.set_value(move(map));
+    return {ready.get_future().share(), nullptr};
+  }
+  if (onReady) entry.onReady.push_back(move(onReady));
+  onReady = nullptr;
+  if (entry.pending.valid()) return {entry.pending, nullptr};
+
+  shared_ptr<promise<Handle>> generating = make_shared<promise<Handle>>();
+  entry.pending = generating->get_future().share();
+  return {entry.pending, move(generating)};
+}
+
+void MapCache::generate(uint64_t seed, promise<Handle> &promise) noexcept {
+  Handle map;
+  try {
+    shared_ptr<Map> generated = make_shared<Map>();
+    generated->generate(seed);
+    map = move(generated);
+  } catch (...) {
+    vector<function<void()>> onReady;
+    {
+      scoped_lock lock(mutex);
+      onReady = move(entries[seed].onReady);
+      entries.erase(seed);
+    }
+    // whoever is woken reads the future, so it must be ready first
+    promise.set_exception(current_exception());
+    for (function<void()> &callback : onReady) callback();
+    return;
+  }
+
+  // the cache's copy of the future would keep the map alive forever
+  vector<function<void()>> onReady;
+  {
+    scoped_lock lock(mutex);
+    Entry &entry = entries[seed];
+    entry.map = map;
+    entry.pending = shared_future<Handle>();
+    onReady = move(entry.onReady);
+    entry.onReady.clear();
+  }
+  promise.set_value(move(map));
+  for (function<void()> &callback : onReady) callback();
+}
+}  // namespace airewar::game
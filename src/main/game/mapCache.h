@@ -0,0 +1,104 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_MAPCACHE_H_
+#define AIREWAR_GAME_MAPCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "game/map.h"
+#include "util/threadPool.h"
+
+namespace airewar::game {
+/**
+ * generated maps, shared by everything that asks for the same seed
+ *
+ * maps are immutable once generated, so a match can hold one without
+ * locking; the cache only holds weak references, and a map is freed as soon
+ * as the last match or client using it lets go
+ */
+class MapCache final {
+ public:
+  using Handle = std::shared_ptr<Map const>;
+
+  MapCache() noexcept;
+  MapCache(MapCache const &) noexcept = delete;
+  MapCache(MapCache &&) noexcept = delete;
+
+  ~MapCache() noexcept = default;
+
+  MapCache &operator=(MapCache const &) noexcept = delete;
+  MapCache &operator=(MapCache &&) noexcept = delete;
+
+  /**
+   * the map for a seed, generated as a job on workers unless it's already
+   * alive or being generated
+   *
+   * @param onReady run once the map is done, just after the future becomes
+   * ready - right away if it already is, and otherwise on the generating
+   * thread, so it must not block
+   */
+  std::shared_future<Handle> request(uint64_t seed, util::ThreadPool &workers,
+                                     std::function<void()> onReady = {});
+
+  /** the map for a seed, generated on this thread if need be */
+  Handle get(uint64_t seed);
+
+  /** number of seeds with a map alive or being generated */
+  size_t size() noexcept;
+
+  /** the cache shared by everything in this process */
+  static MapCache &shared() noexcept;
+
+ private:
+  struct Entry final {
+    std::weak_ptr<Map const> map;
+    /** set while the map is being generated */
+    std::shared_future<Handle> pending;
+    /** run once it's generated */
+    std::vector<std::function<void()>> onReady;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<uint64_t, Entry> entries;
+
+  /**
+   * find the map or its generation, or else register a new generation
+   *
+   * @param onReady taken to be run with the generation, if there is one
+   * @return the map to wait on, and a promise if the caller has to generate
+   * it
+   */
+  std::pair<std::shared_future<Handle>, std::shared_ptr<std::promise<Handle>>>
+  find(uint64_t seed, std::function<void()> &onReady);
+
+  /** generate a map and hand it to everyone waiting on it */
+  void generate(uint64_t seed, std::promise<Handle> &promise) noexcept;
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_MAPCACHE_H_
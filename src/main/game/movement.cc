@@ -0,0 +1,104 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/movement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "game/map.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "util/bitPacking.h"
+#include "util/exceptions/formatException.h"
+
+using namespace std;
+using namespace glm;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game {
+namespace {
+/** north and east along the surface, at the point above unit vector up */
+pair<vec3, vec3> surfaceFrame(vec3 const &up) noexcept {
+  vec3 north = vec3{0.0f, 1.0f, 0.0f} - up * up.y;
+  // north is every way at the poles - use the prime meridian
+  if (length(north) < 1e-6f)
+    north = up.y > 0.0f ? vec3{0.0f, 0.0f, -1.0f} : vec3{0.0f, 0.0f, 1.0f};
+  north = normalize(north);
+  return {north, cross(north, up)};
+}
+
+/** a control in [-1, 1] as one of 2 * INPUT_STEPS + 1 steps */
+uint64_t controlToStep(float control) noexcept {
+  return static_cast<uint64_t>(
+      lround(std::clamp(control, -1.0f, 1.0f) * INPUT_STEPS) + INPUT_STEPS);
+}
+
+float stepToControl(uint64_t step) {
+  if (step > 2 * INPUT_STEPS) throw FormatException("control out of range");
+  return static_cast<float>(static_cast<int>(step) - INPUT_STEPS) /
+         INPUT_STEPS;
+}
+}  // namespace
+
+vector<uint8_t> encodeInput(Input const &input) {
+  BitWriter out;
+  out.writeVarint(input.sequence);
+  out.write(controlToStep(input.turn), 8);
+  out.write(controlToStep(input.throttle), 8);
+  return out.bytes();
+}
+
+Input decodeInput(span<uint8_t const> data) {
+  BitReader in(data);
+  Input input;
+  uint64_t sequence = in.readVarint();
+  if (sequence > UINT32_MAX) throw FormatException("input sequence too large");
+  input.sequence = static_cast<uint32_t>(sequence);
+  input.turn = stepToControl(in.read(8));
+  input.throttle = stepToControl(in.read(8));
+  return input;
+}
+
+EntityState simulate(EntityState const &state, Input const &input,
+                     float dt) noexcept {
+  float heading =
+      state.heading + std::clamp(input.turn, -1.0f, 1.0f) * TURN_RATE * dt;
+  float speed = std::clamp(
+      state.speed + std::clamp(input.throttle, -1.0f, 1.0f) * ACCELERATION * dt,
+      0.0f, QuantizedState::MAX_SPEED);
+
+  // follow the great circle along the heading
+  vec3 up = normalize(state.position);
+  auto [north, east] = surfaceFrame(up);
+  vec3 direction = cos(heading) * north + sin(heading) * east;
+  float angle = speed * dt / Map::RADIUS;
+  vec3 position = Map::RADIUS * (cos(angle) * up + sin(angle) * direction);
+
+  // the heading drifts as the local north changes
+  vec3 forward = cos(angle) * direction - sin(angle) * up;
+  auto [newNorth, newEast] = surfaceFrame(normalize(position));
+  heading = atan2(dot(forward, newEast), dot(forward, newNorth));
+  if (heading < 0.0f) heading += two_pi<float>();
+
+  return EntityState{position, heading, speed};
+}
+}  // namespace airewar::game
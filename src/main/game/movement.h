@@ -0,0 +1,63 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_MOVEMENT_H_
+#define AIREWAR_GAME_MOVEMENT_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "game/snapshot.h"
+
+namespace airewar::game {
+/** one tick of a player's controls */
+struct Input final {
+  /** numbers the player's inputs, so the server can say which it applied */
+  uint32_t sequence = 0;
+  /** -1 (full left) to 1 (full right) */
+  float turn = 0.0f;
+  /** -1 (full brake) to 1 (full throttle) */
+  float throttle = 0.0f;
+};
+
+/** steps either side of zero an input's turn and throttle are sent in */
+constexpr int INPUT_STEPS = 127;
+
+/** an input as sent to the server - the sequence, then a byte per control */
+std::vector<uint8_t> encodeInput(Input const &input);
+/** @throws FormatException if data isn't an encoded input */
+Input decodeInput(std::span<uint8_t const> data);
+
+/** radians per second at full turn */
+constexpr float TURN_RATE = 1.0f;
+/** meters per second squared at full throttle */
+constexpr float ACCELERATION = 50.0f;
+
+/**
+ * advance an entity by dt seconds under the given controls
+ *
+ * the server and the predicting client both run this, so it must depend on
+ * nothing but its arguments
+ */
+EntityState simulate(EntityState const &state, Input const &input,
+                     float dt) noexcept;
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_MOVEMENT_H_
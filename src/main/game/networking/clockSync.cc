@@ -0,0 +1,180 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/clockSync.h"
+
+#include <algorithm>
+
+#include "util/exceptions/formatException.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking {
+namespace {
+uint64_t stamp(ClockSync::Clock::time_point time) noexcept {
+  return static_cast<uint64_t>(
+      chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch())
+          .count());
+}
+
+/** difference between two stamps, which may be from different clocks */
+ClockSync::Clock::duration between(uint64_t from, uint64_t to) noexcept {
+  return chrono::duration_cast<ClockSync::Clock::duration>(
+      chrono::nanoseconds(static_cast<int64_t>(to - from)));
+}
+
+double seconds(ClockSync::Clock::duration duration) noexcept {
+  return chrono::duration<double>(duration).count();
+}
+}  // namespace
+
+void ClockSync::ping(Connection &connection) {
+  uint64_t sent = stamp(Clock::now());
+  // never dropped or coalesced - a peer waiting on its pong would stall
+  connection.put(Connection::Channel::CONTROL, [sent](Connection &writer) {
+    writer << static_cast<uint8_t>(Message::PING) << sent;
+  });
+  outstanding = true;
+}
+
+ClockSync::Message ClockSync::receive(Connection &connection) {
+  uint8_t type;
+  connection >> Connection::Channel::CONTROL >> type;
+  switch (type) {
+    case static_cast<uint8_t>(Message::PING): {
+      uint64_t sent;
+      connection >> sent;
+      answer(connection, sent);
+      return Message::PING;
+    }
+    case static_cast<uint8_t>(Message::PONG): {
+      uint64_t sent;
+      uint64_t peerReceived;
+      uint64_t peerSent;
+      connection >> sent >> peerReceived >> peerSent;
+      learn(sent, peerReceived, peerSent, Clock::now());
+      return Message::PONG;
+    }
+    default: {
+      throw FormatException("unknown control message");
+    }
+  }
+}
+
+Task<void> ClockSync::serve(Connection &connection) {
+  connection >> Connection::Channel::CONTROL;
+  while (true) {
+    switch (co_await connection.read<uint8_t>()) {
+      case static_cast<uint8_t>(Message::PING): {
+        answer(connection, co_await connection.read<uint64_t>());
+        if (!outstanding) ping(connection);
+        co_await connection.drain();
+        break;
+      }
+      case static_cast<uint8_t>(Message::PONG): {
+        uint64_t sent = co_await connection.read<uint64_t>();
+        uint64_t peerReceived = co_await connection.read<uint64_t>();
+        uint64_t peerSent = co_await connection.read<uint64_t>();
+        learn(sent, peerReceived, peerSent, Clock::now());
+        break;
+      }
+      default: {
+        throw FormatException("unknown control message");
+      }
+    }
+  }
+}
+
+optional<ClockSync::Clock::duration> ClockSync::rtt() const noexcept {
+  Sample const *sample = best();
+  if (!sample) return nullopt;
+  return sample->rtt;
+}
+
+optional<ClockSync::Clock::duration> ClockSync::offset() const noexcept {
+  Sample const *sample = best();
+  if (!sample) return nullopt;
+  return sample->offset;
+}
+
+double ClockSync::drift() const noexcept {
+  if (filtered.size() < 2) return 0.0;
+
+  // least squares slope of offset against time
+  Clock::time_point origin = filtered.front().received;
+  double meanTime = 0.0;
+  double meanOffset = 0.0;
+  for (size_t cnt = 0; cnt < filtered.size(); ++cnt) {
+    meanTime += seconds(filtered[cnt].received - origin);
+    meanOffset += seconds(filtered[cnt].offset);
+  }
+  meanTime /= static_cast<double>(filtered.size());
+  meanOffset /= static_cast<double>(filtered.size());
+
+  double covariance = 0.0;
+  double variance = 0.0;
+  for (size_t cnt = 0; cnt < filtered.size(); ++cnt) {
+    double time = seconds(filtered[cnt].received - origin) - meanTime;
+    covariance += time * (seconds(filtered[cnt].offset) - meanOffset);
+    variance += time * time;
+  }
+  return variance == 0.0 ? 0.0 : covariance / variance;
+}
+
+optional<ClockSync::Clock::time_point> ClockSync::peerTime(
+    Clock::time_point local) const noexcept {
+  Sample const *sample = best();
+  if (!sample) return nullopt;
+  return local + sample->offset +
+         chrono::duration_cast<Clock::duration>(chrono::duration<double>(
+             drift() * seconds(local - sample->received)));
+}
+
+void ClockSync::answer(Connection &connection, uint64_t sent) {
+  // answered as soon as it's read, so received and sent are the same
+  uint64_t now = stamp(Clock::now());
+  connection.put(Connection::Channel::CONTROL, [sent, now](Connection &writer) {
+    writer << static_cast<uint8_t>(Message::PONG) << sent << now << now;
+  });
+}
+
+void ClockSync::learn(uint64_t sent, uint64_t peerReceived, uint64_t peerSent,
+                      Clock::time_point received) noexcept {
+  outstanding = false;
+  uint64_t arrived = stamp(received);
+  Clock::duration rtt =
+      max(between(sent, arrived) - between(peerReceived, peerSent),
+          Clock::duration::zero());
+  Clock::duration offset =
+      (between(sent, peerReceived) + between(arrived, peerSent)) / 2;
+  samples.push_back(Sample{received, rtt, offset});
+
+  Sample const *sample = best();
+  if (filtered.empty() || filtered.back().received != sample->received)
+    filtered.push_back(*sample);
+}
+
+ClockSync::Sample const *ClockSync::best() const noexcept {
+  Sample const *found = nullptr;
+  for (size_t cnt = 0; cnt < samples.size(); ++cnt)
+    if (!found || samples[cnt].rtt < found->rtt) found = &samples[cnt];
+  return found;
+}
+}  // namespace airewar::game::networking
@@ -0,0 +1,117 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_CLOCKSYNC_H_
+#define AIREWAR_GAME_NETWORKING_CLOCKSYNC_H_
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "game/networking/networking.h"
+#include "game/networking/task.h"
+#include "util/ringBuffer.h"
+
+namespace airewar::game::networking {
+/**
+ * estimates the round trip time, and the offset and drift between our clock
+ * and the peer's, from pings on the control channel
+ *
+ * each ping is stamped when sent, and its pong with when the peer received
+ * and answered it, as in NTP; queueing delays only ever add to the round
+ * trip, so the sample with the smallest recent round trip is trusted most
+ */
+class ClockSync final {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /** what a control channel message is */
+  enum class Message : uint8_t {
+    PING,
+    PONG,
+  };
+
+  /** recent samples the minimum round trip is picked from */
+  static constexpr size_t WINDOW_SIZE = 8;
+  /** filtered offsets the drift is fitted to */
+  static constexpr size_t DRIFT_SAMPLES = 32;
+
+  ClockSync() noexcept = default;
+  ClockSync(ClockSync const &) noexcept = default;
+  ClockSync(ClockSync &&) noexcept = default;
+
+  ~ClockSync() noexcept = default;
+
+  ClockSync &operator=(ClockSync const &) noexcept = default;
+  ClockSync &operator=(ClockSync &&) noexcept = default;
+
+  /** queue a ping on the control channel */
+  void ping(Connection &connection);
+
+  /**
+   * read one message from the control channel, answering a ping or learning
+   * from a pong
+   *
+   * leaves the connection reading from the control channel
+   *
+   * @return what the message was
+   */
+  Message receive(Connection &connection);
+
+  /**
+   * answer pings and learn from pongs until the connection closes, on a
+   * connection driven by a reactor
+   *
+   * each answered ping is followed by one of our own, if none is
+   * outstanding, so both ends get samples
+   */
+  Task<void> serve(Connection &connection);
+
+  /** smallest recent round trip */
+  std::optional<Clock::duration> rtt() const noexcept;
+  /** the peer's clock minus ours, from the best recent sample */
+  std::optional<Clock::duration> offset() const noexcept;
+  /** how fast the peer's clock gains on ours, in seconds per second */
+  double drift() const noexcept;
+  /** what the peer's clock reads when ours reads local */
+  std::optional<Clock::time_point> peerTime(
+      Clock::time_point local) const noexcept;
+
+ private:
+  struct Sample final {
+    /** when the pong arrived, by our clock */
+    Clock::time_point received;
+    Clock::duration rtt;
+    Clock::duration offset;
+  };
+
+  util::RingBuffer<Sample, WINDOW_SIZE> samples;
+  /** the best sample of each window, for fitting the drift */
+  util::RingBuffer<Sample, DRIFT_SAMPLES> filtered;
+  bool outstanding = false;
+
+  /** answer a ping sent at the peer's time sent */
+  void answer(Connection &connection, uint64_t sent);
+  void learn(uint64_t sent, uint64_t peerReceived, uint64_t peerSent,
+             Clock::time_point received) noexcept;
+  Sample const *best() const noexcept;
+};
+}  // namespace airewar::game::networking
+
+#endif  // AIREWAR_GAME_NETWORKING_CLOCKSYNC_H_
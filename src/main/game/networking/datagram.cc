@@ -0,0 +1,355 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/datagram.h"
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "util/exceptions/socketException.h"
+
+#ifdef __linux__
+#include "game/networking/linux/datagram.h"
+#elif
+#error "operating system not supported/recognized"
+#endif
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking {
+namespace {
+/** session id, then packet number - sent in the clear, but authenticated */
+constexpr size_t HEADER_SIZE = sizeof(uint64_t) + sizeof(uint64_t);
+constexpr size_t ACK_SIZE = sizeof(uint32_t);
+/** channel, sequence number, length */
+constexpr size_t MESSAGE_HEADER_SIZE =
+    sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t);
+constexpr size_t MAX_PLAINTEXT_SIZE = Datagram::MAX_PACKET_SIZE - HEADER_SIZE -
+                                      crypto_aead_chacha20poly1305_ietf_ABYTES;
+
+/** reliable messages held for reordering before the peer is cut off */
+constexpr size_t MAX_OUT_OF_ORDER = 1024;
+
+constexpr size_t REPLAY_WINDOW_SIZE = 64;
+
+void putU16(vector<uint8_t> &buf, uint16_t data) {
+  buf.push_back(data >> 8 & 0xff);
+  buf.push_back(data >> 0 & 0xff);
+}
+
+void putU32(vector<uint8_t> &buf, uint32_t data) {
+  buf.push_back(data >> 24 & 0xff);
+  buf.push_back(data >> 16 & 0xff);
+  buf.push_back(data >> 8 & 0xff);
+  buf.push_back(data >> 0 & 0xff);
+}
+
+void putU64(uint8_t *buf, uint64_t data) {
+  for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+    buf[cnt] = data >> (8 * (sizeof(uint64_t) - 1 - cnt)) & 0xff;
+}
+
+uint16_t getU16(uint8_t const *buf) {
+  return static_cast<uint16_t>(buf[0] << 8 | buf[1]);
+}
+
+uint32_t getU32(uint8_t const *buf) {
+  return static_cast<uint32_t>(buf[0]) << 24 |
+         static_cast<uint32_t>(buf[1]) << 16 |
+         static_cast<uint32_t>(buf[2]) << 8 | static_cast<uint32_t>(buf[3]);
+}
+
+uint64_t getU64(uint8_t const *buf) {
+  uint64_t data = 0;
+  for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+    data = data << 8 | buf[cnt];
+  return data;
+}
+
+/** is sequence number a after b, allowing for wraparound? */
+bool after(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) > 0; }
+
+array<unsigned char, crypto_aead_chacha20poly1305_ietf_NPUBBYTES> nonceFor(
+    uint64_t packet) {
+  array<unsigned char, crypto_aead_chacha20poly1305_ietf_NPUBBYTES> nonce = {};
+  putU64(nonce.data() + nonce.size() - sizeof(uint64_t), packet);
+  return nonce;
+}
+}  // namespace
+
+Datagram::Datagram(DatagramKeys const &keys_) noexcept
+    : mutex(),
+      keys(keys_),
+      nextPacket(1),
+      highestPacket(0),
+      replayWindow(0),
+      nextUnreliable(0),
+      lastUnreliable(),
+      unreliable(),
+      nextReliable(0),
+      unacked(),
+      expectedReliable(0),
+      outOfOrder(),
+      ackDue(false),
+      delivered() {}
+
+Datagram::~Datagram() noexcept {
+  sodium_memzero(keys.sendKey.data(), keys.sendKey.size());
+  sodium_memzero(keys.recvKey.data(), keys.recvKey.size());
+}
+
+uint64_t Datagram::getSession() const noexcept { return keys.session; }
+
+size_t Datagram::maxMessageSize() noexcept {
+  return MAX_PLAINTEXT_SIZE - ACK_SIZE - MESSAGE_HEADER_SIZE;
+}
+
+void Datagram::send(Channel channel, vector<uint8_t> const &message) {
+  if (message.size() > maxMessageSize())
+    throw SocketException("Datagram message too large");
+
+  scoped_lock lock(mutex);
+  switch (channel) {
+    case Channel::UNRELIABLE_SEQUENCED: {
+      unreliable.push_back(message);
+      break;
+    }
+    case Channel::RELIABLE_ORDERED: {
+      if (unacked.size() >= MAX_UNACKED)
+        throw SocketException("Datagram peer stopped acknowledging");
+      unacked.push_back(Pending{nextReliable++, message, nullopt});
+      break;
+    }
+  }
+}
+
+optional<pair<Datagram::Channel, vector<uint8_t>>> Datagram::receive() {
+  scoped_lock lock(mutex);
+  if (delivered.empty()) return nullopt;
+
+  pair<Channel, vector<uint8_t>> message = move(delivered.front());
+  delivered.pop_front();
+  return message;
+}
+
+vector<vector<uint8_t>> Datagram::outgoing(
+    chrono::steady_clock::time_point now) {
+  scoped_lock lock(mutex);
+
+  vector<vector<uint8_t>> packets;
+  vector<uint8_t> plaintext;
+  putU32(plaintext, expectedReliable);
+
+  auto append = [this, &packets, &plaintext](Channel channel, uint32_t sequence,
+                                             vector<uint8_t> const &message) {
+    if (plaintext.size() + MESSAGE_HEADER_SIZE + message.size() >
+        MAX_PLAINTEXT_SIZE) {
+      packets.push_back(seal(plaintext));
+      plaintext.clear();
+      putU32(plaintext, expectedReliable);
+    }
+    plaintext.push_back(static_cast<uint8_t>(channel));
+    putU32(plaintext, sequence);
+    putU16(plaintext, static_cast<uint16_t>(message.size()));
+    plaintext.insert(plaintext.end(), message.begin(), message.end());
+  };
+
+  for (Pending &pending : unacked) {
+    if (!pending.sent || now - *pending.sent >= RETRANSMIT_TIMEOUT) {
+      append(Channel::RELIABLE_ORDERED, pending.sequence, pending.message);
+      pending.sent = now;
+    }
+  }
+  for (vector<uint8_t> const &message : unreliable)
+    append(Channel::UNRELIABLE_SEQUENCED, nextUnreliable++, message);
+  unreliable.clear();
+
+  // every packet carries an ack, so only send an empty one if we owe an ack
+  if (plaintext.size() > ACK_SIZE || (packets.empty() && ackDue))
+    packets.push_back(seal(plaintext));
+  ackDue = false;
+
+  return packets;
+}
+
+bool Datagram::incoming(uint8_t const *packet, size_t length) {
+  if (length <
+      HEADER_SIZE + ACK_SIZE + crypto_aead_chacha20poly1305_ietf_ABYTES)
+    return false;
+  if (getU64(packet) != keys.session) return false;
+
+  scoped_lock lock(mutex);
+
+  // check for replays before spending time decrypting
+  uint64_t number = getU64(packet + sizeof(uint64_t));
+  if (number == 0) return false;
+  if (number <= highestPacket) {
+    uint64_t age = highestPacket - number;
+    if (age >= REPLAY_WINDOW_SIZE || (replayWindow >> age & 1) != 0)
+      return false;
+  }
+
+  vector<uint8_t> plaintext(length - HEADER_SIZE -
+                            crypto_aead_chacha20poly1305_ietf_ABYTES);
+  array<unsigned char, crypto_aead_chacha20poly1305_ietf_NPUBBYTES> nonce =
+      nonceFor(number);
+  if (crypto_aead_chacha20poly1305_ietf_decrypt(
+          plaintext.data(), nullptr, nullptr, packet + HEADER_SIZE,
+          length - HEADER_SIZE, packet, HEADER_SIZE, nonce.data(),
+          keys.recvKey.data()) != 0)
+    return false;
+
+  // check every message before changing any state
+  struct Parsed final {
+    Channel channel;
+    uint32_t sequence;
+    size_t offset;
+    uint16_t size;
+  };
+  vector<Parsed> messages;
+  size_t newOutOfOrder = 0;
+  size_t curr = ACK_SIZE;
+  while (curr != plaintext.size()) {
+    if (plaintext.size() - curr < MESSAGE_HEADER_SIZE) return false;
+    uint8_t channel = plaintext[curr];
+    uint32_t sequence = getU32(plaintext.data() + curr + 1);
+    uint16_t size = getU16(plaintext.data() + curr + 5);
+    curr += MESSAGE_HEADER_SIZE;
+    if (plaintext.size() - curr < size) return false;
+
+    switch (channel) {
+      case static_cast<uint8_t>(Channel::UNRELIABLE_SEQUENCED): {
+        break;
+      }
+      case static_cast<uint8_t>(Channel::RELIABLE_ORDERED): {
+        // may overcount, since some may arrive in order after all
+        if (after(sequence, expectedReliable) && !outOfOrder.contains(sequence))
+          ++newOutOfOrder;
+        break;
+      }
+      default: {
+        return false;
+      }
+    }
+    messages.push_back(
+        Parsed{static_cast<Channel>(channel), sequence, curr, size});
+    curr += size;
+  }
+  if (outOfOrder.size() + newOutOfOrder > MAX_OUT_OF_ORDER) return false;
+
+  if (number > highestPacket) {
+    uint64_t shift = number - highestPacket;
+    replayWindow = shift >= REPLAY_WINDOW_SIZE ? 0 : replayWindow << shift;
+    replayWindow |= 1;
+    highestPacket = number;
+  } else {
+    replayWindow |= uint64_t{1} << (highestPacket - number);
+  }
+
+  uint32_t ack = getU32(plaintext.data());
+  while (!unacked.empty() && after(ack, unacked.front().sequence))
+    unacked.pop_front();
+
+  for (Parsed const &header : messages) {
+    auto begin = plaintext.begin() + static_cast<ptrdiff_t>(header.offset);
+    vector<uint8_t> message(begin, begin + header.size);
+    switch (header.channel) {
+      case Channel::UNRELIABLE_SEQUENCED: {
+        if (!lastUnreliable || after(header.sequence, *lastUnreliable)) {
+          lastUnreliable = header.sequence;
+          delivered.emplace_back(Channel::UNRELIABLE_SEQUENCED, move(message));
+        }
+        break;
+      }
+      case Channel::RELIABLE_ORDERED: {
+        ackDue = true;
+        if (header.sequence == expectedReliable) {
+          delivered.emplace_back(Channel::RELIABLE_ORDERED, move(message));
+          ++expectedReliable;
+          for (auto next = outOfOrder.find(expectedReliable);
+               next != outOfOrder.end();
+               next = outOfOrder.find(expectedReliable)) {
+            delivered.emplace_back(Channel::RELIABLE_ORDERED,
+                                   move(next->second));
+            outOfOrder.erase(next);
+            ++expectedReliable;
+          }
+        } else if (after(header.sequence, expectedReliable)) {
+          outOfOrder.emplace(header.sequence, move(message));
+        }
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+optional<uint64_t> Datagram::sessionOf(uint8_t const *packet,
+                                       size_t length) noexcept {
+  if (length < HEADER_SIZE) return nullopt;
+  return getU64(packet);
+}
+
+vector<uint8_t> Datagram::seal(vector<uint8_t> const &plaintext) {
+  vector<uint8_t> packet(HEADER_SIZE + plaintext.size() +
+                         crypto_aead_chacha20poly1305_ietf_ABYTES);
+  uint64_t number = nextPacket++;
+  putU64(packet.data(), keys.session);
+  putU64(packet.data() + sizeof(uint64_t), number);
+
+  array<unsigned char, crypto_aead_chacha20poly1305_ietf_NPUBBYTES> nonce =
+      nonceFor(number);
+  crypto_aead_chacha20poly1305_ietf_encrypt(
+      packet.data() + HEADER_SIZE, nullptr, plaintext.data(), plaintext.size(),
+      packet.data(), HEADER_SIZE, nullptr, nonce.data(), keys.sendKey.data());
+  return packet;
+}
+
+void DatagramSocket::update() {
+  receive();
+  send();
+}
+
+void DatagramSocket::attach(Datagram &session) {
+  scoped_lock lock(sessionMutex);
+  sessions.insert_or_assign(session.getSession(), &session);
+}
+
+void DatagramSocket::detach(Datagram const &session) {
+  scoped_lock lock(sessionMutex);
+  sessions.erase(session.getSession());
+}
+
+#ifdef __linux__
+unique_ptr<DatagramSocket> DatagramSocket::makeClient(string const &host,
+                                                      uint16_t port) {
+  return make_unique<linux::DatagramSocket>(host, port);
+}
+
+unique_ptr<DatagramSocket> DatagramSocket::makeServer(uint16_t port) {
+  return make_unique<linux::DatagramSocket>(port);
+}
+#elif
+#error "operating system not supported/recognized"
+#endif
+}  // namespace airewar::game::networking
@@ -0,0 +1,186 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_DATAGRAM_H_
+#define AIREWAR_GAME_NETWORKING_DATAGRAM_H_
+
+#include <sodium.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace airewar::game::networking {
+/**
+ * keys for a datagram session, exported from a handshaken Connection
+ *
+ * both ends of the same Connection get the same session id
+ */
+struct DatagramKeys final {
+  std::array<unsigned char, crypto_aead_chacha20poly1305_ietf_KEYBYTES> sendKey;
+  std::array<unsigned char, crypto_aead_chacha20poly1305_ietf_KEYBYTES> recvKey;
+  uint64_t session;
+};
+
+/**
+ * one end of an encrypted datagram session
+ *
+ * each packet is sealed with the packet number as its nonce, and carries any
+ * number of messages; nothing here touches a socket - a DatagramSocket moves
+ * the packets
+ */
+class Datagram final {
+ public:
+  enum class Channel : uint8_t {
+    /** may be lost; older messages arriving after newer ones are dropped */
+    UNRELIABLE_SEQUENCED = 0,
+    /** retransmitted until acknowledged, delivered in order */
+    RELIABLE_ORDERED = 1,
+  };
+
+  /** largest packet on the wire - small enough to avoid fragmentation */
+  static constexpr size_t MAX_PACKET_SIZE = 1200;
+
+  /** how long to wait for an ack before resending a reliable message */
+  static constexpr std::chrono::milliseconds RETRANSMIT_TIMEOUT =
+      std::chrono::milliseconds(200);
+
+  /** reliable messages awaiting an ack before sending more is refused */
+  static constexpr size_t MAX_UNACKED = 1024;
+
+  explicit Datagram(DatagramKeys const &keys) noexcept;
+  Datagram(Datagram const &) noexcept = delete;
+  Datagram(Datagram &&) noexcept = delete;
+
+  ~Datagram() noexcept;
+
+  Datagram &operator=(Datagram const &) noexcept = delete;
+  Datagram &operator=(Datagram &&) noexcept = delete;
+
+  uint64_t getSession() const noexcept;
+
+  /** largest message that fits in one packet */
+  static size_t maxMessageSize() noexcept;
+
+  /**
+   * queue a message for the next update
+   *
+   * @throws SocketException if the message can't fit in a packet, or the peer
+   * has stopped acknowledging reliable messages
+   */
+  void send(Channel channel, std::vector<uint8_t> const &message);
+
+  /** @return the next delivered message, if any */
+  std::optional<std::pair<Channel, std::vector<uint8_t>>> receive();
+
+  /** sealed packets to send now - new messages, resends and acks */
+  std::vector<std::vector<uint8_t>> outgoing(
+      std::chrono::steady_clock::time_point now);
+
+  /**
+   * open and process one received packet
+   *
+   * a packet is either processed whole or not at all
+   *
+   * @return false if the packet was forged, replayed or malformed
+   */
+  bool incoming(uint8_t const *packet, size_t length);
+
+  /** session a received packet claims to belong to */
+  static std::optional<uint64_t> sessionOf(uint8_t const *packet,
+                                           size_t length) noexcept;
+
+ private:
+  struct Pending final {
+    uint32_t sequence;
+    std::vector<uint8_t> message;
+    std::optional<std::chrono::steady_clock::time_point> sent;
+  };
+
+  std::mutex mutex;
+
+  DatagramKeys keys;
+
+  uint64_t nextPacket;
+  uint64_t highestPacket;
+  uint64_t replayWindow;
+
+  uint32_t nextUnreliable;
+  std::optional<uint32_t> lastUnreliable;
+  std::deque<std::vector<uint8_t>> unreliable;
+
+  uint32_t nextReliable;
+  std::deque<Pending> unacked;
+  uint32_t expectedReliable;
+  std::map<uint32_t, std::vector<uint8_t>> outOfOrder;
+  bool ackDue;
+
+  std::deque<std::pair<Channel, std::vector<uint8_t>>> delivered;
+
+  std::vector<uint8_t> seal(std::vector<uint8_t> const &plaintext);
+};
+
+/**
+ * moves packets between a UDP socket and the sessions attached to it
+ *
+ * a client socket carries one session to its server; a server socket
+ * carries every session, telling them apart by the session id in each packet
+ */
+class DatagramSocket {
+ public:
+  DatagramSocket() noexcept = default;
+  DatagramSocket(DatagramSocket const &) noexcept = delete;
+  DatagramSocket(DatagramSocket &&) noexcept = delete;
+
+  virtual ~DatagramSocket() noexcept = default;
+
+  DatagramSocket &operator=(DatagramSocket const &) noexcept = delete;
+  DatagramSocket &operator=(DatagramSocket &&) noexcept = delete;
+
+  void attach(Datagram &session);
+  void detach(Datagram const &session);
+
+  /** hand everything waiting to its session; never blocks */
+  virtual void receive() = 0;
+  /** send everything the sessions have due; never blocks */
+  virtual void send() = 0;
+  /** receive, then send */
+  void update();
+
+  static std::unique_ptr<DatagramSocket> makeClient(std::string const &host,
+                                                    uint16_t port);
+  static std::unique_ptr<DatagramSocket> makeServer(uint16_t port);
+
+ protected:
+  std::mutex sessionMutex;
+  std::unordered_map<uint64_t, Datagram *> sessions;
+};
+}  // namespace airewar::game::networking
+
+#endif  // AIREWAR_GAME_NETWORKING_DATAGRAM_H_
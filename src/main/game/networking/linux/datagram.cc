@@ -0,0 +1,236 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifdef __linux__
+
+#include "game/networking/linux/datagram.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/exceptions/socketException.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking::linux {
+namespace {
+/** packets moved per recvmmsg/sendmmsg call */
+constexpr size_t BATCH_SIZE = 32;
+}  // namespace
+
+DatagramSocket::DatagramSocket(string const &address, uint16_t port)
+    : fd(), connected(true), peers() {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICSERV;
+
+  string portStr = to_string(port);
+  struct addrinfo *rawResult;
+  if (int s = getaddrinfo(address.c_str(), portStr.c_str(), &hints, &rawResult);
+      s != 0)
+    throw SocketException("Could not get address info: "s + gai_strerror(s));
+
+  unique_ptr<struct addrinfo, decltype(&freeaddrinfo)> result(rawResult,
+                                                              freeaddrinfo);
+  for (struct addrinfo *curr = result.get(); curr != nullptr && !fd;
+       curr = curr->ai_next) {
+    FD attempt(socket(curr->ai_family, curr->ai_socktype | SOCK_NONBLOCK,
+                      curr->ai_protocol));
+    if (!attempt) continue;
+
+    // connecting a datagram socket just fixes the destination
+    if (connect(attempt.get(), curr->ai_addr, curr->ai_addrlen) == 0)
+      fd = move(attempt);
+  }
+
+  if (!fd)
+    throw SocketException("Could not open datagram socket: "s +
+                          strerror(errno));
+}
+
+DatagramSocket::DatagramSocket(uint16_t port)
+    : fd(), connected(false), peers() {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+  string portStr = to_string(port);
+  struct addrinfo *rawResult;
+  if (int s = getaddrinfo(nullptr, portStr.c_str(), &hints, &rawResult); s != 0)
+    throw SocketException("Could not get address info: "s + gai_strerror(s));
+
+  unique_ptr<struct addrinfo, decltype(&freeaddrinfo)> result(rawResult,
+                                                              freeaddrinfo);
+  for (struct addrinfo *curr = result.get(); curr != nullptr && !fd;
+       curr = curr->ai_next) {
+    FD attempt(socket(curr->ai_family, curr->ai_socktype | SOCK_NONBLOCK,
+                      curr->ai_protocol));
+    if (!attempt) continue;
+
+    if (bind(attempt.get(), curr->ai_addr, curr->ai_addrlen) == 0)
+      fd = move(attempt);
+  }
+
+  if (!fd) throw SocketException("Could not bind to port: "s + strerror(errno));
+}
+
+void DatagramSocket::receive() {
+  vector<uint8_t> buffers(BATCH_SIZE * Datagram::MAX_PACKET_SIZE);
+  array<struct iovec, BATCH_SIZE> iovecs;
+  array<struct sockaddr_storage, BATCH_SIZE> addresses;
+  array<struct mmsghdr, BATCH_SIZE> messages;
+
+  while (true) {
+    memset(messages.data(), 0, sizeof(messages));
+    for (size_t cnt = 0; cnt < BATCH_SIZE; ++cnt) {
+      iovecs[cnt].iov_base = buffers.data() + cnt * Datagram::MAX_PACKET_SIZE;
+      iovecs[cnt].iov_len = Datagram::MAX_PACKET_SIZE;
+      messages[cnt].msg_hdr.msg_iov = &iovecs[cnt];
+      messages[cnt].msg_hdr.msg_iovlen = 1;
+      messages[cnt].msg_hdr.msg_name = &addresses[cnt];
+      messages[cnt].msg_hdr.msg_namelen = sizeof(addresses[cnt]);
+    }
+
+    int received =
+        recvmmsg(fd.get(), messages.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (received == -1) {
+      switch (int errnoSave = errno; errnoSave) {
+        case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+#endif
+        case ECONNREFUSED: {
+          // nothing more to read, or an ICMP error for an earlier send
+          return;
+        }
+        case EINTR: {
+          continue;
+        }
+        default: {
+          throw SocketException("Read failed: "s + strerror(errnoSave));
+        }
+      }
+    }
+
+    scoped_lock lock(sessionMutex);
+    for (int cnt = 0; cnt < received; ++cnt) {
+      if ((messages[cnt].msg_hdr.msg_flags & MSG_TRUNC) != 0) continue;
+
+      uint8_t const *packet = buffers.data() + cnt * Datagram::MAX_PACKET_SIZE;
+      size_t length = messages[cnt].msg_len;
+      optional<uint64_t> id = Datagram::sessionOf(packet, length);
+      if (!id) continue;
+      auto session = sessions.find(*id);
+      if (session == sessions.end()) continue;
+
+      // only authentic packets may move a session to a new address
+      if (session->second->incoming(packet, length) && !connected)
+        peers.insert_or_assign(*id, addresses[cnt]);
+    }
+
+    if (static_cast<size_t>(received) < BATCH_SIZE) return;
+  }
+}
+
+void DatagramSocket::send() {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  vector<vector<uint8_t>> packets;
+  vector<struct sockaddr_storage> destinations;
+  {
+    scoped_lock lock(sessionMutex);
+    erase_if(peers, [this](auto const &peer) {
+      return !sessions.contains(peer.first);
+    });
+
+    for (auto const &[id, session] : sessions) {
+      struct sockaddr_storage destination;
+      memset(&destination, 0, sizeof(destination));
+      if (!connected) {
+        // can't reply until the client has sent us something
+        auto peer = peers.find(id);
+        if (peer == peers.end()) continue;
+        destination = peer->second;
+      }
+
+      for (vector<uint8_t> &packet : session->outgoing(now)) {
+        packets.push_back(move(packet));
+        destinations.push_back(destination);
+      }
+    }
+  }
+
+  array<struct iovec, BATCH_SIZE> iovecs;
+  array<struct mmsghdr, BATCH_SIZE> messages;
+  size_t curr = 0;
+  while (curr != packets.size()) {
+    size_t batch = min(BATCH_SIZE, packets.size() - curr);
+    memset(messages.data(), 0, sizeof(messages));
+    for (size_t cnt = 0; cnt < batch; ++cnt) {
+      iovecs[cnt].iov_base = packets[curr + cnt].data();
+      iovecs[cnt].iov_len = packets[curr + cnt].size();
+      messages[cnt].msg_hdr.msg_iov = &iovecs[cnt];
+      messages[cnt].msg_hdr.msg_iovlen = 1;
+      if (!connected) {
+        messages[cnt].msg_hdr.msg_name = &destinations[curr + cnt];
+        messages[cnt].msg_hdr.msg_namelen = sizeof(destinations[curr + cnt]);
+      }
+    }
+
+    int sent = sendmmsg(fd.get(), messages.data(), static_cast<unsigned>(batch),
+                        MSG_DONTWAIT);
+    if (sent == -1) {
+      switch (int errnoSave = errno; errnoSave) {
+        case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+#endif
+        case ECONNREFUSED: {
+          // drop the rest - lost datagrams are expected, and reliable
+          // messages get resent
+          return;
+        }
+        case EINTR: {
+          continue;
+        }
+        default: {
+          throw SocketException("Write failed: "s + strerror(errnoSave));
+        }
+      }
+    }
+
+    curr += static_cast<size_t>(sent);
+  }
+}
+}  // namespace airewar::game::networking::linux
+
+#endif  // __linux__
@@ -0,0 +1,62 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifdef __linux__
+
+#ifndef AIREWAR_GAME_NETWORKING_LINUX_DATAGRAM_H_
+#define AIREWAR_GAME_NETWORKING_LINUX_DATAGRAM_H_
+
+#include <sys/socket.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "game/networking/datagram.h"
+#include "game/networking/linux/networking.h"
+
+namespace airewar::game::networking::linux {
+class DatagramSocket final : public airewar::game::networking::DatagramSocket {
+ public:
+  /** client socket, connected to the server */
+  DatagramSocket(std::string const &address, uint16_t port);
+  /** server socket, accepting packets for any attached session */
+  explicit DatagramSocket(uint16_t port);
+  DatagramSocket(DatagramSocket const &) noexcept = delete;
+  DatagramSocket(DatagramSocket &&) noexcept = delete;
+
+  ~DatagramSocket() noexcept override = default;
+
+  DatagramSocket &operator=(DatagramSocket const &) noexcept = delete;
+  DatagramSocket &operator=(DatagramSocket &&) noexcept = delete;
+
+  void receive() override;
+  void send() override;
+
+ private:
+  FD fd;
+  bool connected;
+
+  /** where each session's last authentic packet came from (server only) */
+  std::unordered_map<uint64_t, struct sockaddr_storage> peers;
+};
+}  // namespace airewar::game::networking::linux
+
+#endif  // AIREWAR_GAME_NETWORKING_LINUX_DATAGRAM_H_
+
+#endif  // __linux__
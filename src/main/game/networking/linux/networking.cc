@@ -22,6 +22,8 @@
 #include "game/networking/linux/networking.h"
 
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -29,8 +31,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -137,6 +141,8 @@ Connection::Connection(string const &address, uint16_t port,
     throw SocketException("Could not connect to server: "s + strerror(errno));
 }
 
+Connection::~Connection() noexcept { flushQuietly(); }
+
 void Connection::sendRaw(void const *data, size_t length) {
   struct pollfd fds;
   memset(&fds, 0, sizeof(fds));
@@ -147,6 +153,7 @@ void Connection::sendRaw(void const *data, size_t length) {
   while (curr != length) {
     int pollResult = poll(&fds, 1, POLL_TIMEOUT);
     if (stop) throw StopFlag();
+    checkDeadline();
 
     switch (pollResult) {
       case 0: {
@@ -191,6 +198,7 @@ void Connection::recvRaw(void *data, size_t length) {
   while (curr != length) {
     int pollResult = poll(&fds, 1, POLL_TIMEOUT);
     if (stop) throw StopFlag();
+    checkDeadline();
 
     switch (pollResult) {
       case 0: {
@@ -199,6 +207,8 @@ void Connection::recvRaw(void *data, size_t length) {
       case 1: {
         ssize_t sizeRead = ::recv(
             fd.get(), reinterpret_cast<char *>(data) + curr, length - curr, 0);
+        if (sizeRead == 0)
+          throw closedByPeer("Read");
         if (sizeRead == -1) {
           switch (int errnoSave = errno; errnoSave) {
             case EAGAIN:
@@ -224,8 +234,67 @@ void Connection::recvRaw(void *data, size_t length) {
   }
 }
 
-Server::Server(uint16_t port, string const &password, atomic_bool const &stop)
-    : password(password), stop(stop) {
+size_t Connection::trySendRaw(void const *data, size_t length) {
+  while (true) {
+    ssize_t sizeSent = ::send(fd.get(), data, length, 0);
+    if (sizeSent != -1) return static_cast<size_t>(sizeSent);
+
+    switch (int errnoSave = errno; errnoSave) {
+      case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#endif
+      case EINPROGRESS: {
+        return 0;
+      }
+      case EINTR: {
+        continue;
+      }
+      default: {
+        throw SocketException("Write failed: "s + strerror(errnoSave));
+      }
+    }
+  }
+}
+
+size_t Connection::tryRecvRaw(void *data, size_t length) {
+  while (true) {
+    ssize_t sizeRead = ::recv(fd.get(), data, length, 0);
+    if (sizeRead == 0)
+      throw closedByPeer("Read");
+    if (sizeRead != -1) return static_cast<size_t>(sizeRead);
+
+    switch (int errnoSave = errno; errnoSave) {
+      case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#endif
+      case EINPROGRESS: {
+        return 0;
+      }
+      case EINTR: {
+        continue;
+      }
+      default: {
+        throw SocketException("Read failed: "s + strerror(errnoSave));
+      }
+    }
+  }
+}
+
+int Connection::descriptor() noexcept { return fd.get(); }
+
+optional<chrono::microseconds> Connection::rtt() noexcept {
+  struct tcp_info info;
+  socklen_t infoLength = sizeof(info);
+  if (getsockopt(fd.get(), IPPROTO_TCP, TCP_INFO, &info, &infoLength) != 0)
+    return nullopt;
+  return chrono::microseconds(info.tcpi_rtt);
+}
+
+Server::Server(uint16_t port_, string const &password, atomic_bool const &stop,
+               bool reusePort)
+    : port(port_), password(password), stop(stop), backlog() {
   struct addrinfo hints;
   memset(&hints, 0, sizeof(hints));
   hints.ai_family = AF_UNSPEC;
@@ -249,6 +318,9 @@ Server::Server(uint16_t port, string const &password, atomic_bool const &stop)
     if (setsockopt(attempt.get(), SOL_SOCKET, SO_REUSEADDR, &one,
                    sizeof(one)) != 0)
       continue;
+    if (reusePort && setsockopt(attempt.get(), SOL_SOCKET, SO_REUSEPORT, &one,
+                                sizeof(one)) != 0)
+      continue;
 
     if (bind(attempt.get(), curr->ai_addr, curr->ai_addrlen) == 0)
       fd = move(attempt);
@@ -256,32 +328,80 @@ Server::Server(uint16_t port, string const &password, atomic_bool const &stop)
 
   if (!fd) throw SocketException("Could not bind to port: "s + strerror(errno));
 
+  // port 0 lets the system pick one
+  struct sockaddr_storage address;
+  socklen_t addressLength = sizeof(address);
+  if (getsockname(fd.get(), reinterpret_cast<struct sockaddr *>(&address),
+                  &addressLength) != 0)
+    throw SocketException("Could not get bound port: "s + strerror(errno));
+  if (address.ss_family == AF_INET6)
+    port = ntohs(reinterpret_cast<struct sockaddr_in6 *>(&address)->sin6_port);
+  else
+    port = ntohs(reinterpret_cast<struct sockaddr_in *>(&address)->sin_port);
+
   if (listen(fd.get(), SOMAXCONN) != 0)
     throw SocketException("Could not listen on port: "s + strerror(errno));
 }
 
+uint16_t Server::getPort() const noexcept { return port; }
+
 unique_ptr<airewar::game::networking::Connection> Server::accept() {
-  struct pollfd fds;
-  memset(&fds, 0, sizeof(fds));
-  fds.fd = fd.get();
-  fds.events = POLLIN;
-  int pollResult = poll(&fds, 1, POLL_TIMEOUT);
-  if (stop) throw StopFlag();
+  if (backlog.empty()) {
+    struct pollfd fds;
+    memset(&fds, 0, sizeof(fds));
+    fds.fd = fd.get();
+    fds.events = POLLIN;
+    int pollResult = poll(&fds, 1, POLL_TIMEOUT);
+    if (stop) throw StopFlag();
 
-  switch (pollResult) {
-    case 0: {
-      return nullptr;
-    }
-    case 1: {
-      if (int retval = accept4(fd.get(), nullptr, nullptr, SOCK_NONBLOCK);
-          retval != -1) {
-        return make_unique<Connection>(FD(retval), stop);
-      } else {
-        throw SocketException("Accept failed: "s + strerror(errno));
+    switch (pollResult) {
+      case 0: {
+        return nullptr;
+      }
+      case 1: {
+        acceptAll();
+        // another listener sharing the port may have taken it
+        if (backlog.empty()) return nullptr;
+        break;
+      }
+      default: {
+        throw SocketException("Poll failed: "s + strerror(errno));
       }
     }
-    default: {
-      throw SocketException("Poll failed: "s + strerror(errno));
+  }
+
+  unique_ptr<Connection> accepted = move(backlog.front());
+  backlog.pop_front();
+  return accepted;
+}
+
+void Server::acceptAll() {
+  // take everything that's waiting, not just one connection per wake-up
+  while (true) {
+    int retval = accept4(fd.get(), nullptr, nullptr, SOCK_NONBLOCK);
+    if (retval != -1) {
+      backlog.push_back(make_unique<Connection>(FD(retval), stop));
+      continue;
+    }
+
+    switch (int errnoSave = errno; errnoSave) {
+      case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#endif
+      {
+        return;
+      }
+      case EINTR:
+      case ECONNABORTED: {
+        continue;
+      }
+      default: {
+        // hand out what we have - the error will come back next time
+        if (backlog.empty())
+          throw SocketException("Accept failed: "s + strerror(errnoSave));
+        return;
+      }
     }
   }
 }
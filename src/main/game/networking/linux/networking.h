@@ -22,7 +22,10 @@
 #ifndef AIREWAR_GAME_NETWORKING_LINUX_NETWORKING_H_
 #define AIREWAR_GAME_NETWORKING_LINUX_NETWORKING_H_
 
+#include <chrono>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include "game/networking/networking.h"
@@ -57,14 +60,20 @@ class Connection : public airewar::game::networking::Connection {
   Connection(Connection const &) noexcept = delete;
   Connection(Connection &&) noexcept = default;
 
-  ~Connection() noexcept override = default;
+  ~Connection() noexcept override;
 
   Connection &operator=(Connection const &) noexcept = delete;
   Connection &operator=(Connection &&) noexcept = default;
 
+  /** the socket, for a reactor to watch */
+  int descriptor() noexcept;
+
  protected:
   void sendRaw(void const *data, size_t length) override;
   void recvRaw(void *data, size_t length) override;
+  size_t trySendRaw(void const *data, size_t length) override;
+  size_t tryRecvRaw(void *data, size_t length) override;
+  std::optional<std::chrono::microseconds> rtt() noexcept override;
 
  private:
   FD fd;
@@ -73,8 +82,14 @@ class Connection : public airewar::game::networking::Connection {
 
 class Server : public airewar::game::networking::Server {
  public:
-  explicit Server(uint16_t port, std::string const &password,
-                  std::atomic_bool const &stop);
+  /**
+   * listen on a port
+   *
+   * @param reusePort whether other listeners may bind the same port, with
+   * the kernel spreading connections between them
+   */
+  Server(uint16_t port, std::string const &password,
+         std::atomic_bool const &stop, bool reusePort);
   Server(Server const &) noexcept = delete;
   Server(Server &&) noexcept = default;
 
@@ -84,11 +99,18 @@ class Server : public airewar::game::networking::Server {
   Server &operator=(Server &&) noexcept = default;
 
   std::unique_ptr<airewar::game::networking::Connection> accept() override;
+  uint16_t getPort() const noexcept override;
 
  private:
   FD fd;
+  uint16_t port;
   std::string const &password;
   std::atomic_bool const &stop;
+  /** connections accepted by an earlier call, not yet handed out */
+  std::deque<std::unique_ptr<Connection>> backlog;
+
+  /** accept until the listen queue is empty */
+  void acceptAll();
 };
 }  // namespace airewar::game::networking::linux
 
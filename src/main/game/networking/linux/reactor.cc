@@ -0,0 +1,151 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifdef __linux__
+
+#include "game/networking/linux/reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+
+#include "util/exceptions/socketException.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking::linux {
+namespace {
+/** events handled per epoll_wait call */
+constexpr size_t MAX_EVENTS = 64;
+}  // namespace
+
+Reactor::Reactor(util::ThreadPool &workers)
+    : airewar::game::networking::Reactor(workers),
+      epoll(epoll_create1(EPOLL_CLOEXEC)),
+      event(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      watchers() {
+  if (!epoll)
+    throw SocketException("Could not create reactor: "s + strerror(errno));
+  if (!event)
+    throw SocketException("Could not create reactor: "s + strerror(errno));
+
+  struct epoll_event wakeup;
+  memset(&wakeup, 0, sizeof(wakeup));
+  wakeup.events = EPOLLIN;
+  wakeup.data.fd = event.get();
+  if (epoll_ctl(epoll.get(), EPOLL_CTL_ADD, event.get(), &wakeup) != 0)
+    throw SocketException("Could not create reactor: "s + strerror(errno));
+}
+
+Reactor::~Reactor() noexcept { waitForOffloads(); }
+
+void Reactor::watch(airewar::game::networking::Connection &connection,
+                    Direction direction, coroutine_handle<> handle) {
+  Connection *socket = dynamic_cast<Connection *>(&connection);
+  if (socket == nullptr)
+    throw SocketException("Connection can't be watched by this reactor");
+
+  int fd = socket->descriptor();
+  Watchers &watching = watchers[fd];
+  switch (direction) {
+    case Direction::READ: {
+      watching.reader = handle;
+      break;
+    }
+    case Direction::WRITE: {
+      watching.writer = handle;
+      break;
+    }
+  }
+  arm(fd, watching);
+}
+
+vector<coroutine_handle<>> Reactor::wait(chrono::milliseconds timeout) {
+  array<struct epoll_event, MAX_EVENTS> events;
+  int numEvents = epoll_wait(epoll.get(), events.data(), MAX_EVENTS,
+                             static_cast<int>(timeout.count()));
+  if (numEvents == -1) {
+    if (errno == EINTR) return {};
+    throw SocketException("Poll failed: "s + strerror(errno));
+  }
+
+  vector<coroutine_handle<>> ready;
+  for (int cnt = 0; cnt < numEvents; ++cnt) {
+    int fd = events[cnt].data.fd;
+    if (fd == event.get()) {
+      uint64_t count;
+      while (read(event.get(), &count, sizeof(count)) > 0) {
+      }
+      continue;
+    }
+
+    auto found = watchers.find(fd);
+    if (found == watchers.end()) continue;
+    Watchers &watching = found->second;
+
+    // errors wake everyone - their next read or write throws
+    uint32_t flags = events[cnt].events;
+    if ((flags & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0 &&
+        watching.reader) {
+      ready.push_back(watching.reader);
+      watching.reader = nullptr;
+    }
+    if ((flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0 && watching.writer) {
+      ready.push_back(watching.writer);
+      watching.writer = nullptr;
+    }
+
+    if (watching.reader || watching.writer)
+      arm(fd, watching);
+    else
+      watchers.erase(found);
+  }
+  return ready;
+}
+
+void Reactor::wake() noexcept {
+  uint64_t one = 1;
+  // can only fail if the counter is saturated, which still wakes the reactor
+  [[maybe_unused]] ssize_t written = write(event.get(), &one, sizeof(one));
+}
+
+void Reactor::arm(int fd, Watchers const &watching) {
+  struct epoll_event interest;
+  memset(&interest, 0, sizeof(interest));
+  interest.events = EPOLLONESHOT | EPOLLRDHUP;
+  if (watching.reader) interest.events |= EPOLLIN;
+  if (watching.writer) interest.events |= EPOLLOUT;
+  interest.data.fd = fd;
+
+  // one-shot registrations stay in the set once they fire, so most watches
+  // are modifications; a closed and reused descriptor needs adding again
+  if (epoll_ctl(epoll.get(), EPOLL_CTL_MOD, fd, &interest) == 0) return;
+  if (errno == ENOENT &&
+      epoll_ctl(epoll.get(), EPOLL_CTL_ADD, fd, &interest) == 0)
+    return;
+  throw SocketException("Could not watch connection: "s + strerror(errno));
+}
+}  // namespace airewar::game::networking::linux
+
+#endif  // __linux__
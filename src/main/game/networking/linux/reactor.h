@@ -0,0 +1,70 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifdef __linux__
+
+#ifndef AIREWAR_GAME_NETWORKING_LINUX_REACTOR_H_
+#define AIREWAR_GAME_NETWORKING_LINUX_REACTOR_H_
+
+#include <chrono>
+#include <coroutine>
+#include <unordered_map>
+#include <vector>
+
+#include "game/networking/linux/networking.h"
+#include "game/networking/reactor.h"
+
+namespace airewar::game::networking::linux {
+/** a reactor for linux::Connections, waiting with epoll */
+class Reactor final : public airewar::game::networking::Reactor {
+ public:
+  explicit Reactor(util::ThreadPool &workers);
+  Reactor(Reactor const &) noexcept = delete;
+  Reactor(Reactor &&) noexcept = delete;
+
+  ~Reactor() noexcept override;
+
+  Reactor &operator=(Reactor const &) noexcept = delete;
+  Reactor &operator=(Reactor &&) noexcept = delete;
+
+ protected:
+  void watch(airewar::game::networking::Connection &connection,
+             Direction direction, std::coroutine_handle<> handle) override;
+  std::vector<std::coroutine_handle<>> wait(
+      std::chrono::milliseconds timeout) override;
+  void wake() noexcept override;
+
+ private:
+  struct Watchers final {
+    std::coroutine_handle<> reader;
+    std::coroutine_handle<> writer;
+  };
+
+  FD epoll;
+  /** eventfd that wake signals */
+  FD event;
+  std::unordered_map<int, Watchers> watchers;
+
+  void arm(int fd, Watchers const &watching);
+};
+}  // namespace airewar::game::networking::linux
+
+#endif  // AIREWAR_GAME_NETWORKING_LINUX_REACTOR_H_
+
+#endif  // __linux__
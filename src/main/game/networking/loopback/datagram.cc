@@ -0,0 +1,94 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/loopback/datagram.h"
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace airewar::game::networking::loopback {
+DatagramSocket::DatagramSocket(shared_ptr<Link> out_,
+                               shared_ptr<Link> in_) noexcept
+    : out(move(out_)), in(move(in_)), port(), peers() {}
+
+DatagramSocket::DatagramSocket(shared_ptr<DatagramPort> port_) noexcept
+    : out(), in(), port(move(port_)), peers() {}
+
+DatagramSocket::~DatagramSocket() noexcept {
+  if (out) out->close();
+  if (in) in->close();
+}
+
+void DatagramSocket::receive() {
+  if (port) {
+    vector<pair<shared_ptr<Link>, shared_ptr<Link>>> clients;
+    {
+      scoped_lock lock(port->mutex);
+      erase_if(port->peers, [](auto const &peer) {
+        return peer.first->drained();
+      });
+      clients = port->peers;
+    }
+    for (auto const &[toServer, toClient] : clients)
+      receiveAll(*toServer, toClient);
+  } else {
+    receiveAll(*in, out);
+  }
+}
+
+void DatagramSocket::receiveAll(Link &link, shared_ptr<Link> const &replyTo) {
+  for (optional<vector<uint8_t>> packet = link.pop(chrono::milliseconds(0));
+       packet; packet = link.pop(chrono::milliseconds(0))) {
+    scoped_lock lock(sessionMutex);
+    optional<uint64_t> id = Datagram::sessionOf(packet->data(), packet->size());
+    if (!id) continue;
+    auto session = sessions.find(*id);
+    if (session == sessions.end()) continue;
+
+    // only authentic packets may move a session to a new client
+    if (session->second->incoming(packet->data(), packet->size()) && port)
+      peers.insert_or_assign(*id, replyTo);
+  }
+}
+
+void DatagramSocket::send() {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  scoped_lock lock(sessionMutex);
+  erase_if(peers,
+           [this](auto const &peer) { return !sessions.contains(peer.first); });
+
+  for (auto const &[id, session] : sessions) {
+    shared_ptr<Link> destination = out;
+    if (port) {
+      // can't reply until the client has sent us something
+      auto peer = peers.find(id);
+      if (peer == peers.end()) continue;
+      destination = peer->second;
+    }
+
+    for (vector<uint8_t> &packet : session->outgoing(now))
+      destination->push(move(packet));
+  }
+}
+}  // namespace airewar::game::networking::loopback
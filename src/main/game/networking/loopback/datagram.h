@@ -0,0 +1,69 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_LOOPBACK_DATAGRAM_H_
+#define AIREWAR_GAME_NETWORKING_LOOPBACK_DATAGRAM_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "game/networking/datagram.h"
+#include "game/networking/loopback/link.h"
+
+namespace airewar::game::networking::loopback {
+/** the links from every client socket to a server's port */
+struct DatagramPort final {
+  std::mutex mutex;
+  /** towards the server, then towards the client */
+  std::vector<std::pair<std::shared_ptr<Link>, std::shared_ptr<Link>>> peers;
+};
+
+class DatagramSocket final : public airewar::game::networking::DatagramSocket {
+ public:
+  /** client socket, with its own links to the server */
+  DatagramSocket(std::shared_ptr<Link> out, std::shared_ptr<Link> in) noexcept;
+  /** server socket, reading from every client of the port */
+  explicit DatagramSocket(std::shared_ptr<DatagramPort> port) noexcept;
+  DatagramSocket(DatagramSocket const &) noexcept = delete;
+  DatagramSocket(DatagramSocket &&) noexcept = delete;
+
+  ~DatagramSocket() noexcept override;
+
+  DatagramSocket &operator=(DatagramSocket const &) noexcept = delete;
+  DatagramSocket &operator=(DatagramSocket &&) noexcept = delete;
+
+  void receive() override;
+  void send() override;
+
+ private:
+  std::shared_ptr<Link> out;
+  std::shared_ptr<Link> in;
+  std::shared_ptr<DatagramPort> port;
+
+  /** where each session's last authentic packet came from (server only) */
+  std::unordered_map<uint64_t, std::shared_ptr<Link>> peers;
+
+  void receiveAll(Link &link, std::shared_ptr<Link> const &replyTo);
+};
+}  // namespace airewar::game::networking::loopback
+
+#endif  // AIREWAR_GAME_NETWORKING_LOOPBACK_DATAGRAM_H_
@@ -0,0 +1,133 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/loopback/link.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace airewar::game::networking::loopback {
+Link::Link(Conditions const &conditions_, bool stream_) noexcept
+    : mutex(),
+      arrived(),
+      conditions(conditions_),
+      stream(stream_),
+      closed(false),
+      rng(conditions_.seed),
+      linkFree(),
+      lastArrival(),
+      inFlight(),
+      waker() {}
+
+void Link::push(vector<uint8_t> packet) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  {
+    scoped_lock lock(mutex);
+    if (closed) return;
+
+    // packets queue up behind each other for the link's bandwidth
+    chrono::steady_clock::time_point sent = max(now, linkFree);
+    if (conditions.bandwidth != 0)
+      sent += chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::nanoseconds(packet.size() * 1'000'000'000 /
+                              conditions.bandwidth));
+    linkFree = sent;
+
+    chrono::steady_clock::time_point arrival = sent + conditions.latency;
+    if (conditions.jitter.count() != 0)
+      arrival += chrono::microseconds(uniform_int_distribution<int64_t>(
+          0, conditions.jitter.count())(rng));
+
+    bool lost = bernoulli_distribution(conditions.loss)(rng);
+    if (stream) {
+      if (lost)
+        arrival += max<chrono::steady_clock::duration>(MIN_RETRANSMIT_TIMEOUT,
+                                                       2 * conditions.latency);
+      arrival = max(arrival, lastArrival);
+      lastArrival = arrival;
+    } else {
+      if (lost) return;
+      if (bernoulli_distribution(conditions.reorder)(rng))
+        arrival += conditions.latency;
+    }
+
+    inFlight.emplace(arrival, move(packet));
+    if (waker) waker();
+  }
+  arrived.notify_all();
+}
+
+optional<vector<uint8_t>> Link::pop(chrono::milliseconds timeout) {
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + timeout;
+
+  unique_lock lock(mutex);
+  while (true) {
+    chrono::steady_clock::time_point wakeup = deadline;
+    if (!inFlight.empty()) {
+      auto first = inFlight.begin();
+      if (first->first <= chrono::steady_clock::now()) {
+        vector<uint8_t> packet = move(first->second);
+        inFlight.erase(first);
+        return packet;
+      }
+      wakeup = min(wakeup, first->first);
+    } else if (closed) {
+      return nullopt;
+    }
+
+    if (chrono::steady_clock::now() >= deadline) return nullopt;
+    arrived.wait_until(lock, wakeup);
+  }
+}
+
+void Link::close() noexcept {
+  {
+    scoped_lock lock(mutex);
+    closed = true;
+    if (waker) waker();
+  }
+  arrived.notify_all();
+}
+
+bool Link::drained() noexcept {
+  scoped_lock lock(mutex);
+  return closed && inFlight.empty();
+}
+
+bool Link::isClosed() noexcept {
+  scoped_lock lock(mutex);
+  return closed;
+}
+
+optional<chrono::steady_clock::time_point> Link::nextArrival() noexcept {
+  scoped_lock lock(mutex);
+  if (!inFlight.empty()) return inFlight.begin()->first;
+  // a closed, empty link returns straight away too
+  if (closed) return chrono::steady_clock::time_point::min();
+  return nullopt;
+}
+
+void Link::setWaker(function<void()> waker_) {
+  scoped_lock lock(mutex);
+  waker = move(waker_);
+}
+}  // namespace airewar::game::networking::loopback
@@ -0,0 +1,121 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_LOOPBACK_LINK_H_
+#define AIREWAR_GAME_NETWORKING_LOOPBACK_LINK_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace airewar::game::networking::loopback {
+/**
+ * what a simulated link does to the packets crossing it, in one direction
+ */
+struct Conditions final {
+  /** one-way delay before a packet arrives */
+  std::chrono::microseconds latency = std::chrono::microseconds(0);
+  /** extra delay, uniform between zero and this, per packet */
+  std::chrono::microseconds jitter = std::chrono::microseconds(0);
+  /** bytes per second the link can carry; zero is unlimited */
+  uint64_t bandwidth = 0;
+  /** chance a packet is lost - streams resend it after a timeout instead */
+  double loss = 0.0;
+  /** chance a datagram is held back an extra latency, arriving out of order */
+  double reorder = 0.0;
+  /** seeds the link's random choices, so a run can be reproduced */
+  uint64_t seed = 0;
+};
+
+/**
+ * one direction of a simulated link, carrying whole packets
+ *
+ * a stream link delivers in order, so a lost packet holds up everything
+ * behind it until it is resent, like TCP; a datagram link just drops it
+ */
+class Link final {
+ public:
+  /** shortest time a stream waits before resending a lost packet */
+  static constexpr std::chrono::milliseconds MIN_RETRANSMIT_TIMEOUT =
+      std::chrono::milliseconds(200);
+
+  Link(Conditions const &conditions, bool stream) noexcept;
+  Link(Link const &) noexcept = delete;
+  Link(Link &&) noexcept = delete;
+
+  ~Link() noexcept = default;
+
+  Link &operator=(Link const &) noexcept = delete;
+  Link &operator=(Link &&) noexcept = delete;
+
+  /** put a packet on the link; ignored once closed */
+  void push(std::vector<uint8_t> packet);
+
+  /**
+   * wait up to timeout for a packet to arrive
+   *
+   * @return the packet, or nothing if none arrived in time or the link is
+   * closed and empty
+   */
+  std::optional<std::vector<uint8_t>> pop(std::chrono::milliseconds timeout);
+
+  /** no more packets will be pushed; those in flight still arrive */
+  void close() noexcept;
+  /** closed, and nothing left to arrive */
+  bool drained() noexcept;
+  bool isClosed() noexcept;
+
+  /**
+   * when pop next returns without waiting - nothing if that's only once
+   * another packet is pushed
+   */
+  std::optional<std::chrono::steady_clock::time_point> nextArrival() noexcept;
+
+  /**
+   * call waker whenever a packet is pushed or the link closes, replacing any
+   * earlier waker; once this returns, the old waker is never called again
+   */
+  void setWaker(std::function<void()> waker);
+
+ private:
+  std::mutex mutex;
+  std::condition_variable arrived;
+
+  Conditions conditions;
+  bool stream;
+  bool closed;
+  std::mt19937_64 rng;
+
+  /** when the link finishes clocking out the last packet pushed */
+  std::chrono::steady_clock::time_point linkFree;
+  /** when the last stream packet arrives - later ones can't overtake it */
+  std::chrono::steady_clock::time_point lastArrival;
+  std::multimap<std::chrono::steady_clock::time_point, std::vector<uint8_t>>
+      inFlight;
+  std::function<void()> waker;
+};
+}  // namespace airewar::game::networking::loopback
+
+#endif  // AIREWAR_GAME_NETWORKING_LOOPBACK_LINK_H_
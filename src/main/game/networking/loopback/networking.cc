@@ -0,0 +1,281 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/loopback/networking.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "game/networking/loopback/reactor.h"
+#include "util/exceptions/socketException.h"
+#include "util/exceptions/stopFlag.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking::loopback {
+namespace {
+/** how long to wait before checking the stop flag again */
+constexpr chrono::milliseconds POLL_TIMEOUT = chrono::milliseconds(50);
+}  // namespace
+
+Connection::Connection(shared_ptr<Link> out_, shared_ptr<Link> in_,
+                       chrono::microseconds roundTrip_,
+                       atomic_bool const &stop_) noexcept
+    : out(move(out_)),
+      in(move(in_)),
+      roundTrip(roundTrip_),
+      stop(stop_),
+      pending(),
+      pendingPos(0) {}
+
+Connection::~Connection() noexcept {
+  flushQuietly();
+  out->close();
+  in->close();
+}
+
+void Connection::sendRaw(void const *data, size_t length) {
+  if (stop) throw StopFlag();
+  if (out->isClosed())
+    throw closedByPeer("Write");
+
+  uint8_t const *bytes = reinterpret_cast<uint8_t const *>(data);
+  out->push(vector<uint8_t>(bytes, bytes + length));
+}
+
+void Connection::recvRaw(void *data, size_t length) {
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(data);
+  size_t curr = 0;
+  while (curr != length) {
+    if (pendingPos == pending.size()) {
+      optional<vector<uint8_t>> packet = in->pop(POLL_TIMEOUT);
+      if (stop) throw StopFlag();
+      checkDeadline();
+      if (!packet) {
+        if (in->drained())
+          throw closedByPeer("Read");
+        continue;
+      }
+      pending = move(*packet);
+      pendingPos = 0;
+    }
+
+    size_t n = min(length - curr, pending.size() - pendingPos);
+    memcpy(bytes + curr, pending.data() + pendingPos, n);
+    curr += n;
+    pendingPos += n;
+  }
+}
+
+size_t Connection::trySendRaw(void const *data, size_t length) {
+  // links never fill up
+  sendRaw(data, length);
+  return length;
+}
+
+size_t Connection::tryRecvRaw(void *data, size_t length) {
+  if (pendingPos == pending.size()) {
+    optional<vector<uint8_t>> packet = in->pop(chrono::milliseconds(0));
+    if (!packet) {
+      if (in->drained())
+        throw closedByPeer("Read");
+      return 0;
+    }
+    pending = move(*packet);
+    pendingPos = 0;
+  }
+
+  size_t n = min(length, pending.size() - pendingPos);
+  memcpy(data, pending.data() + pendingPos, n);
+  pendingPos += n;
+  return n;
+}
+
+optional<chrono::microseconds> Connection::rtt() noexcept { return roundTrip; }
+
+optional<chrono::steady_clock::time_point> Connection::readableAt() noexcept {
+  if (pendingPos != pending.size())
+    return chrono::steady_clock::time_point::min();
+  return in->nextArrival();
+}
+
+shared_ptr<Link> const &Connection::incoming() const noexcept { return in; }
+
+Server::Server(shared_ptr<Listener> listener_, uint16_t port_,
+               chrono::microseconds roundTrip_,
+               atomic_bool const &stop_) noexcept
+    : listener(move(listener_)),
+      port(port_),
+      roundTrip(roundTrip_),
+      stop(stop_) {}
+
+uint16_t Server::getPort() const noexcept { return port; }
+
+unique_ptr<airewar::game::networking::Connection> Server::accept() {
+  unique_lock lock(listener->mutex);
+  listener->connected.wait_for(lock, POLL_TIMEOUT,
+                               [this]() { return !listener->backlog.empty(); });
+  if (stop) throw StopFlag();
+  if (listener->backlog.empty()) return nullptr;
+
+  auto [out, in] = move(listener->backlog.front());
+  listener->backlog.pop_front();
+  return make_unique<Connection>(move(out), move(in), roundTrip, stop);
+}
+
+Network::Network(Conditions const &conditions_) noexcept
+    : mutex(),
+      conditions(conditions_),
+      numLinks(0),
+      listeners(),
+      datagramPorts() {}
+
+unique_ptr<airewar::game::networking::Connection> Network::connect(
+    string const &, uint16_t port, atomic_bool const &stop) {
+  shared_ptr<Link> up;
+  shared_ptr<Link> down;
+  shared_ptr<Listener> listener;
+  {
+    scoped_lock lock(mutex);
+    auto found = listeners.find(port);
+    if (found != listeners.end()) listener = found->second.lock();
+    if (!listener)
+      throw SocketException("Could not connect to server: connection refused");
+    up = makeLink(true);
+    down = makeLink(true);
+  }
+
+  {
+    scoped_lock lock(listener->mutex);
+    listener->backlog.emplace_back(down, up);
+  }
+  listener->connected.notify_one();
+  return make_unique<Connection>(move(up), move(down), roundTrip(), stop);
+}
+
+unique_ptr<airewar::game::networking::Server> Network::listen(
+    uint16_t port, string const &, atomic_bool const &stop) {
+  scoped_lock lock(mutex);
+  if (auto found = listeners.find(port);
+      found != listeners.end() && !found->second.expired())
+    throw SocketException("Could not bind to port: address in use");
+
+  shared_ptr<Listener> listener = make_shared<Listener>();
+  listeners.insert_or_assign(port, listener);
+  return make_unique<Server>(move(listener), port, roundTrip(), stop);
+}
+
+unique_ptr<airewar::game::networking::DatagramSocket> Network::connectDatagrams(
+    string const &, uint16_t port) {
+  shared_ptr<Link> up;
+  shared_ptr<Link> down;
+  shared_ptr<DatagramPort> target;
+  {
+    scoped_lock lock(mutex);
+    up = makeLink(false);
+    down = makeLink(false);
+    target = datagramPort(port);
+  }
+
+  {
+    scoped_lock lock(target->mutex);
+    target->peers.emplace_back(up, down);
+  }
+  return make_unique<DatagramSocket>(move(up), move(down));
+}
+
+unique_ptr<airewar::game::networking::DatagramSocket> Network::listenDatagrams(
+    uint16_t port) {
+  scoped_lock lock(mutex);
+  return make_unique<DatagramSocket>(datagramPort(port));
+}
+
+unique_ptr<airewar::game::networking::Reactor> Network::makeReactor(
+    util::ThreadPool &workers) {
+  return make_unique<Reactor>(workers);
+}
+
+pair<unique_ptr<airewar::game::networking::Connection>,
+     unique_ptr<airewar::game::networking::Connection>>
+Network::connectedPair(atomic_bool const &stop) {
+  shared_ptr<Link> up;
+  shared_ptr<Link> down;
+  {
+    scoped_lock lock(mutex);
+    up = makeLink(true);
+    down = makeLink(true);
+  }
+  unique_ptr<airewar::game::networking::Connection> client =
+      make_unique<Connection>(up, down, roundTrip(), stop);
+  unique_ptr<airewar::game::networking::Connection> server =
+      make_unique<Connection>(down, up, roundTrip(), stop);
+
+  string const password = "password";
+  TicketKey ticketKey;
+  bool serverHandshaken = false;
+  exception_ptr serverError;
+  thread serverThread([&server, &password, &ticketKey, &serverHandshaken,
+                       &serverError]() {
+    try {
+      serverHandshaken = server->handshake(password, ticketKey);
+    } catch (...) {
+      serverError = current_exception();
+    }
+  });
+
+  optional<Ticket> ticket;
+  bool clientHandshaken;
+  try {
+    clientHandshaken = client->handshake(password, ticket);
+  } catch (...) {
+    // unblock the server end before waiting for it
+    client.reset();
+    serverThread.join();
+    throw;
+  }
+  serverThread.join();
+  if (serverError) rethrow_exception(serverError);
+  if (!clientHandshaken || !serverHandshaken)
+    throw SocketException("Handshake failed");
+  return {move(client), move(server)};
+}
+
+shared_ptr<Link> Network::makeLink(bool stream) {
+  Conditions linkConditions = conditions;
+  linkConditions.seed = conditions.seed + numLinks++;
+  return make_shared<Link>(linkConditions, stream);
+}
+
+shared_ptr<DatagramPort> Network::datagramPort(uint16_t port) {
+  shared_ptr<DatagramPort> &found = datagramPorts[port];
+  if (!found) found = make_shared<DatagramPort>();
+  return found;
+}
+
+chrono::microseconds Network::roundTrip() const noexcept {
+  return 2 * conditions.latency + conditions.jitter;
+}
+}  // namespace airewar::game::networking::loopback
@@ -0,0 +1,165 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_LOOPBACK_NETWORKING_H_
+#define AIREWAR_GAME_NETWORKING_LOOPBACK_NETWORKING_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "game/networking/loopback/datagram.h"
+#include "game/networking/loopback/link.h"
+#include "game/networking/networking.h"
+
+namespace airewar::game::networking::loopback {
+/** connections waiting to be accepted, as their server ends' links */
+struct Listener final {
+  std::mutex mutex;
+  std::condition_variable connected;
+  /** outgoing, then incoming, from the server's point of view */
+  std::deque<std::pair<std::shared_ptr<Link>, std::shared_ptr<Link>>> backlog;
+};
+
+class Connection final : public airewar::game::networking::Connection {
+ public:
+  Connection(std::shared_ptr<Link> out, std::shared_ptr<Link> in,
+             std::chrono::microseconds roundTrip,
+             std::atomic_bool const &stop) noexcept;
+  Connection(Connection const &) noexcept = delete;
+  Connection(Connection &&) noexcept = delete;
+
+  ~Connection() noexcept override;
+
+  Connection &operator=(Connection const &) noexcept = delete;
+  Connection &operator=(Connection &&) noexcept = delete;
+
+  /**
+   * when a read can next make progress, for a reactor to wait until - nothing
+   * if that's only once the peer sends more
+   */
+  std::optional<std::chrono::steady_clock::time_point> readableAt() noexcept;
+  /** the link reads come from, for a reactor to be woken by */
+  std::shared_ptr<Link> const &incoming() const noexcept;
+
+ protected:
+  void sendRaw(void const *data, size_t length) override;
+  void recvRaw(void *data, size_t length) override;
+  size_t trySendRaw(void const *data, size_t length) override;
+  size_t tryRecvRaw(void *data, size_t length) override;
+  std::optional<std::chrono::microseconds> rtt() noexcept override;
+
+ private:
+  std::shared_ptr<Link> out;
+  std::shared_ptr<Link> in;
+  std::chrono::microseconds roundTrip;
+  std::atomic_bool const &stop;
+
+  /** the rest of a packet only partly read */
+  std::vector<uint8_t> pending;
+  size_t pendingPos;
+};
+
+class Server final : public airewar::game::networking::Server {
+ public:
+  Server(std::shared_ptr<Listener> listener, uint16_t port,
+         std::chrono::microseconds roundTrip,
+         std::atomic_bool const &stop) noexcept;
+  Server(Server const &) noexcept = delete;
+  Server(Server &&) noexcept = delete;
+
+  ~Server() noexcept override = default;
+
+  Server &operator=(Server const &) noexcept = delete;
+  Server &operator=(Server &&) noexcept = delete;
+
+  std::unique_ptr<airewar::game::networking::Connection> accept() override;
+  uint16_t getPort() const noexcept override;
+
+ private:
+  std::shared_ptr<Listener> listener;
+  uint16_t port;
+  std::chrono::microseconds roundTrip;
+  std::atomic_bool const &stop;
+};
+
+/**
+ * a simulated network, in memory, where every link has the same conditions
+ *
+ * hosts are ignored - everything connects to whatever is listening on the
+ * port
+ */
+class Network final : public airewar::game::networking::Network {
+ public:
+  explicit Network(Conditions const &conditions) noexcept;
+  Network(Network const &) noexcept = delete;
+  Network(Network &&) noexcept = delete;
+
+  ~Network() noexcept override = default;
+
+  Network &operator=(Network const &) noexcept = delete;
+  Network &operator=(Network &&) noexcept = delete;
+
+  std::unique_ptr<airewar::game::networking::Connection> connect(
+      std::string const &host, uint16_t port,
+      std::atomic_bool const &stop) override;
+  std::unique_ptr<airewar::game::networking::Server> listen(
+      uint16_t port, std::string const &password,
+      std::atomic_bool const &stop) override;
+  std::unique_ptr<airewar::game::networking::DatagramSocket> connectDatagrams(
+      std::string const &host, uint16_t port) override;
+  std::unique_ptr<airewar::game::networking::DatagramSocket> listenDatagrams(
+      uint16_t port) override;
+  std::unique_ptr<airewar::game::networking::Reactor> makeReactor(
+      util::ThreadPool &workers) override;
+
+  /**
+   * both ends of a handshaken connection, client end first, made without a
+   * listener
+   *
+   * @throws SocketException if either end fails the handshake
+   */
+  std::pair<std::unique_ptr<airewar::game::networking::Connection>,
+            std::unique_ptr<airewar::game::networking::Connection>>
+  connectedPair(std::atomic_bool const &stop);
+
+ private:
+  std::mutex mutex;
+  Conditions conditions;
+  /** links made so far - each gets its own seed */
+  uint64_t numLinks;
+  std::map<uint16_t, std::weak_ptr<Listener>> listeners;
+  std::map<uint16_t, std::shared_ptr<DatagramPort>> datagramPorts;
+
+  std::shared_ptr<Link> makeLink(bool stream);
+  std::shared_ptr<DatagramPort> datagramPort(uint16_t port);
+  std::chrono::microseconds roundTrip() const noexcept;
+};
+}  // namespace airewar::game::networking::loopback
+
+#endif  // AIREWAR_GAME_NETWORKING_LOOPBACK_NETWORKING_H_
@@ -0,0 +1,118 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/loopback/reactor.h"
+
+#include <algorithm>
+#include <optional>
+
+#include "util/exceptions/socketException.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game::networking::loopback {
+Reactor::Reactor(util::ThreadPool &workers) noexcept
+    : airewar::game::networking::Reactor(workers),
+      mutex(),
+      woken(),
+      wakeup(false),
+      readers(),
+      writers(),
+      links() {}
+
+Reactor::~Reactor() noexcept {
+  waitForOffloads();
+  for (shared_ptr<Link> const &link : links) link->setWaker(nullptr);
+}
+
+void Reactor::watch(airewar::game::networking::Connection &connection,
+                    Direction direction, coroutine_handle<> handle) {
+  Connection *loopback = dynamic_cast<Connection *>(&connection);
+  if (loopback == nullptr)
+    throw SocketException("Connection can't be watched by this reactor");
+
+  switch (direction) {
+    case Direction::READ: {
+      readers.emplace_back(loopback, handle);
+      if (links.insert(loopback->incoming()).second)
+        loopback->incoming()->setWaker([this]() { wake(); });
+      break;
+    }
+    case Direction::WRITE: {
+      writers.push_back(handle);
+      break;
+    }
+  }
+}
+
+vector<coroutine_handle<>> Reactor::wait(chrono::milliseconds timeout) {
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + timeout;
+
+  vector<coroutine_handle<>> ready;
+  swap(ready, writers);
+  optional<chrono::steady_clock::time_point> next = collect(ready);
+  if (ready.empty()) {
+    unique_lock lock(mutex);
+    woken.wait_until(lock, next ? min(*next, deadline) : deadline,
+                     [this]() { return wakeup; });
+    lock.unlock();
+    collect(ready);
+  }
+
+  {
+    scoped_lock lock(mutex);
+    wakeup = false;
+  }
+
+  // links only this reactor still holds can't get any more packets
+  erase_if(links, [](shared_ptr<Link> const &link) {
+    if (link.use_count() != 1) return false;
+    link->setWaker(nullptr);
+    return true;
+  });
+  return ready;
+}
+
+void Reactor::wake() noexcept {
+  {
+    scoped_lock lock(mutex);
+    wakeup = true;
+  }
+  woken.notify_one();
+}
+
+optional<chrono::steady_clock::time_point> Reactor::collect(
+    vector<coroutine_handle<>> &ready) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  optional<chrono::steady_clock::time_point> next;
+  erase_if(readers, [&ready, &next, now](auto const &reader) {
+    optional<chrono::steady_clock::time_point> at =
+        reader.first->readableAt();
+    if (at && *at <= now) {
+      ready.push_back(reader.second);
+      return true;
+    }
+    if (at) next = next ? min(*next, *at) : *at;
+    return false;
+  });
+  return next;
+}
+}  // namespace airewar::game::networking::loopback
@@ -0,0 +1,78 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_LOOPBACK_REACTOR_H_
+#define AIREWAR_GAME_NETWORKING_LOOPBACK_REACTOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "game/networking/loopback/link.h"
+#include "game/networking/loopback/networking.h"
+#include "game/networking/reactor.h"
+
+namespace airewar::game::networking::loopback {
+/**
+ * a reactor for loopback::Connections, sleeping until the next packet in
+ * flight to a watched connection arrives
+ *
+ * links wake it when a packet is pushed, in case that one arrives sooner
+ */
+class Reactor final : public airewar::game::networking::Reactor {
+ public:
+  explicit Reactor(util::ThreadPool &workers) noexcept;
+  Reactor(Reactor const &) noexcept = delete;
+  Reactor(Reactor &&) noexcept = delete;
+
+  ~Reactor() noexcept override;
+
+  Reactor &operator=(Reactor const &) noexcept = delete;
+  Reactor &operator=(Reactor &&) noexcept = delete;
+
+ protected:
+  void watch(airewar::game::networking::Connection &connection,
+             Direction direction, std::coroutine_handle<> handle) override;
+  std::vector<std::coroutine_handle<>> wait(
+      std::chrono::milliseconds timeout) override;
+  void wake() noexcept override;
+
+ private:
+  std::mutex mutex;
+  std::condition_variable woken;
+  bool wakeup;
+
+  std::vector<std::pair<Connection *, std::coroutine_handle<>>> readers;
+  /** links never fill up, so writers are always ready */
+  std::vector<std::coroutine_handle<>> writers;
+  /** links that wake this reactor, held until nobody else uses them */
+  std::set<std::shared_ptr<Link>> links;
+
+  /** resume ready readers, and say when the next one will be */
+  std::optional<std::chrono::steady_clock::time_point> collect(
+      std::vector<std::coroutine_handle<>> &ready);
+};
+}  // namespace airewar::game::networking::loopback
+
+#endif  // AIREWAR_GAME_NETWORKING_LOOPBACK_REACTOR_H_
@@ -0,0 +1,314 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/message.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace airewar::game::networking {
+void encode(vector<uint8_t> &out, uint8_t data) {
+  out.push_back('b');
+  out.push_back(data);
+}
+
+void encode(vector<uint8_t> &out, uint16_t data) {
+  out.push_back('s');
+  out.push_back(data >> 8 & 0xff);
+  out.push_back(data >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, uint32_t data) {
+  out.push_back('i');
+  out.push_back(data >> 24 & 0xff);
+  out.push_back(data >> 16 & 0xff);
+  out.push_back(data >> 8 & 0xff);
+  out.push_back(data >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, uint64_t data) {
+  out.push_back('l');
+  out.push_back(data >> 56 & 0xff);
+  out.push_back(data >> 48 & 0xff);
+  out.push_back(data >> 40 & 0xff);
+  out.push_back(data >> 32 & 0xff);
+  out.push_back(data >> 24 & 0xff);
+  out.push_back(data >> 16 & 0xff);
+  out.push_back(data >> 8 & 0xff);
+  out.push_back(data >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, int8_t data) {
+  union {
+    uint8_t u;
+    int8_t i;
+  } u = {.i = data};
+  out.push_back('B');
+  out.push_back(u.u);
+}
+
+void encode(vector<uint8_t> &out, int16_t data) {
+  union {
+    uint16_t u;
+    int16_t i;
+  } u = {.i = data};
+  out.push_back('S');
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, int32_t data) {
+  union {
+    uint32_t u;
+    int32_t i;
+  } u = {.i = data};
+  out.push_back('I');
+  out.push_back(u.u >> 24 & 0xff);
+  out.push_back(u.u >> 16 & 0xff);
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, int64_t data) {
+  union {
+    uint64_t u;
+    int64_t i;
+  } u = {.i = data};
+  out.push_back('L');
+  out.push_back(u.u >> 56 & 0xff);
+  out.push_back(u.u >> 48 & 0xff);
+  out.push_back(u.u >> 40 & 0xff);
+  out.push_back(u.u >> 32 & 0xff);
+  out.push_back(u.u >> 24 & 0xff);
+  out.push_back(u.u >> 16 & 0xff);
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, float data) {
+  union {
+    uint32_t u;
+    float f;
+  } u = {.f = data};
+  out.push_back('F');
+  out.push_back(u.u >> 24 & 0xff);
+  out.push_back(u.u >> 16 & 0xff);
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, double data) {
+  union {
+    uint64_t u;
+    double d;
+  } u = {.d = data};
+  out.push_back('D');
+  out.push_back(u.u >> 56 & 0xff);
+  out.push_back(u.u >> 48 & 0xff);
+  out.push_back(u.u >> 40 & 0xff);
+  out.push_back(u.u >> 32 & 0xff);
+  out.push_back(u.u >> 24 & 0xff);
+  out.push_back(u.u >> 16 & 0xff);
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, char8_t data) {
+  union {
+    char8_t c;
+    uint8_t u;
+  } u = {.c = data};
+  out.push_back('c');
+  out.push_back(u.u);
+}
+
+void encode(vector<uint8_t> &out, char32_t data) {
+  union {
+    char32_t c;
+    uint32_t u;
+  } u = {.c = data};
+  out.push_back('C');
+  out.push_back(u.u >> 24 & 0xff);
+  out.push_back(u.u >> 16 & 0xff);
+  out.push_back(u.u >> 8 & 0xff);
+  out.push_back(u.u >> 0 & 0xff);
+}
+
+void encode(vector<uint8_t> &out, u8string const &data) {
+  uint64_t length = data.length();
+  out.push_back('u');
+  out.push_back(length >> 56 & 0xff);
+  out.push_back(length >> 48 & 0xff);
+  out.push_back(length >> 40 & 0xff);
+  out.push_back(length >> 32 & 0xff);
+  out.push_back(length >> 24 & 0xff);
+  out.push_back(length >> 16 & 0xff);
+  out.push_back(length >> 8 & 0xff);
+  out.push_back(length >> 0 & 0xff);
+  for_each(data.begin(), data.end(), [&out](char8_t c) {
+    union {
+      char8_t c;
+      uint8_t u;
+    } u = {.c = c};
+    out.push_back(u.u);
+  });
+}
+
+void encode(vector<uint8_t> &out, u32string const &data) {
+  uint64_t length = data.length();
+  out.push_back('U');
+  out.push_back(length >> 56 & 0xff);
+  out.push_back(length >> 48 & 0xff);
+  out.push_back(length >> 40 & 0xff);
+  out.push_back(length >> 32 & 0xff);
+  out.push_back(length >> 24 & 0xff);
+  out.push_back(length >> 16 & 0xff);
+  out.push_back(length >> 8 & 0xff);
+  out.push_back(length >> 0 & 0xff);
+  for_each(data.begin(), data.end(), [&out](char32_t c) {
+    union {
+      char32_t c;
+      uint32_t u;
+    } u = {.c = c};
+    out.push_back(u.u >> 24 & 0xff);
+    out.push_back(u.u >> 16 & 0xff);
+    out.push_back(u.u >> 8 & 0xff);
+    out.push_back(u.u >> 0 & 0xff);
+  });
+}
+
+void encode(vector<uint8_t> &out, bool data) {
+  out.push_back('o');
+  out.push_back(data ? 1 : 0);
+}
+
+void encode(vector<uint8_t> &out, span<uint8_t const> data) {
+  uint64_t length = data.size();
+  out.push_back('a');
+  out.push_back(length >> 56 & 0xff);
+  out.push_back(length >> 48 & 0xff);
+  out.push_back(length >> 40 & 0xff);
+  out.push_back(length >> 32 & 0xff);
+  out.push_back(length >> 24 & 0xff);
+  out.push_back(length >> 16 & 0xff);
+  out.push_back(length >> 8 & 0xff);
+  out.push_back(length >> 0 & 0xff);
+  out.insert(out.end(), data.begin(), data.end());
+}
+
+Message::Message(vector<uint8_t> bytes) noexcept
+    : data(make_shared<vector<uint8_t> const>(move(bytes))) {}
+
+span<uint8_t const> Message::bytes() const noexcept {
+  if (!data) return {};
+  return *data;
+}
+
+size_t Message::size() const noexcept { return data ? data->size() : 0; }
+
+bool Message::empty() const noexcept { return size() == 0; }
+
+MessageBuilder &MessageBuilder::operator<<(uint8_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(uint16_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(uint32_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(uint64_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(int8_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(int16_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(int32_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(int64_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(float data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(double data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(char8_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(char32_t data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(u8string const &data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(u32string const &data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(bool data) {
+  encode(buf, data);
+  return *this;
+}
+
+MessageBuilder &MessageBuilder::operator<<(span<uint8_t const> data) {
+  encode(buf, data);
+  return *this;
+}
+
+Message MessageBuilder::build() noexcept {
+  Message message(move(buf));
+  buf = vector<uint8_t>();
+  return message;
+}
+}  // namespace airewar::game::networking
@@ -0,0 +1,116 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_MESSAGE_H_
+#define AIREWAR_GAME_NETWORKING_MESSAGE_H_
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace airewar::game::networking {
+/**
+ * append the tagged encoding of a value to a buffer
+ *
+ * each value is a one byte type tag, then the value, big-endian; strings and
+ * arrays are prefixed with a 64 bit length
+ */
+void encode(std::vector<uint8_t> &out, uint8_t data);
+void encode(std::vector<uint8_t> &out, uint16_t data);
+void encode(std::vector<uint8_t> &out, uint32_t data);
+void encode(std::vector<uint8_t> &out, uint64_t data);
+void encode(std::vector<uint8_t> &out, int8_t data);
+void encode(std::vector<uint8_t> &out, int16_t data);
+void encode(std::vector<uint8_t> &out, int32_t data);
+void encode(std::vector<uint8_t> &out, int64_t data);
+void encode(std::vector<uint8_t> &out, float data);
+void encode(std::vector<uint8_t> &out, double data);
+void encode(std::vector<uint8_t> &out, char8_t data);
+void encode(std::vector<uint8_t> &out, char32_t data);
+void encode(std::vector<uint8_t> &out, std::u8string const &data);
+void encode(std::vector<uint8_t> &out, std::u32string const &data);
+void encode(std::vector<uint8_t> &out, bool data);
+void encode(std::vector<uint8_t> &out, std::span<uint8_t const> data);
+
+/**
+ * an encoded message, shared between every connection it's queued on
+ *
+ * serializing once and queueing the same bytes on many connections leaves
+ * only encryption to be done per peer
+ */
+class Message final {
+ public:
+  Message() noexcept = default;
+  explicit Message(std::vector<uint8_t> bytes) noexcept;
+  Message(Message const &) noexcept = default;
+  Message(Message &&) noexcept = default;
+
+  ~Message() noexcept = default;
+
+  Message &operator=(Message const &) noexcept = default;
+  Message &operator=(Message &&) noexcept = default;
+
+  std::span<uint8_t const> bytes() const noexcept;
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+ private:
+  std::shared_ptr<std::vector<uint8_t> const> data;
+};
+
+/** writes values into a message, the same way a connection would */
+class MessageBuilder final {
+ public:
+  MessageBuilder() noexcept = default;
+  MessageBuilder(MessageBuilder const &) noexcept = delete;
+  MessageBuilder(MessageBuilder &&) noexcept = default;
+
+  ~MessageBuilder() noexcept = default;
+
+  MessageBuilder &operator=(MessageBuilder const &) noexcept = delete;
+  MessageBuilder &operator=(MessageBuilder &&) noexcept = default;
+
+  MessageBuilder &operator<<(uint8_t data);
+  MessageBuilder &operator<<(uint16_t data);
+  MessageBuilder &operator<<(uint32_t data);
+  MessageBuilder &operator<<(uint64_t data);
+  MessageBuilder &operator<<(int8_t data);
+  MessageBuilder &operator<<(int16_t data);
+  MessageBuilder &operator<<(int32_t data);
+  MessageBuilder &operator<<(int64_t data);
+  MessageBuilder &operator<<(float data);
+  MessageBuilder &operator<<(double data);
+  MessageBuilder &operator<<(char8_t data);
+  MessageBuilder &operator<<(char32_t data);
+  MessageBuilder &operator<<(std::u8string const &data);
+  MessageBuilder &operator<<(std::u32string const &data);
+  MessageBuilder &operator<<(bool data);
+  MessageBuilder &operator<<(std::span<uint8_t const> data);
+
+  /** freeze what's been written so far; the builder starts over empty */
+  Message build() noexcept;
+
+ private:
+  std::vector<uint8_t> buf;
+};
+}  // namespace airewar::game::networking
+
+#endif  // AIREWAR_GAME_NETWORKING_MESSAGE_H_
@@ -22,10 +22,21 @@
 #include <sodium.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "util/exceptions/formatException.h"
 #include "util/exceptions/socketException.h"
+#include "util/scopeGuard.h"
 
 #ifdef __linux__
 #include "game/networking/linux/networking.h"
@@ -37,661 +48,1222 @@ using namespace std;
 using namespace airewar::util::exceptions;
 
 namespace airewar::game::networking {
-Connection::~Connection() noexcept {
+void Connection::flushQuietly() noexcept {
   try {
     flush();
   } catch (...) {
-    // swallow exception - this is a destructor
+    // swallow exception - this is called from destructors
   }
 }
 
+SocketException Connection::closedByPeer(string const &operation) {
+  peerClosed = true;
+  return SocketException(operation + " failed: connection closed by peer");
+}
+
 Connection &Connection::operator<<(uint8_t data) {
-  sendBuf.push_back('b');
-  sendBuf.push_back(data);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(uint16_t data) {
-  sendBuf.push_back('s');
-  sendBuf.push_back(data >> 8 & 0xff);
-  sendBuf.push_back(data >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(uint32_t data) {
-  sendBuf.push_back('i');
-  sendBuf.push_back(data >> 24 & 0xff);
-  sendBuf.push_back(data >> 16 & 0xff);
-  sendBuf.push_back(data >> 8 & 0xff);
-  sendBuf.push_back(data >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(uint64_t data) {
-  sendBuf.push_back('l');
-  sendBuf.push_back(data >> 56 & 0xff);
-  sendBuf.push_back(data >> 48 & 0xff);
-  sendBuf.push_back(data >> 40 & 0xff);
-  sendBuf.push_back(data >> 32 & 0xff);
-  sendBuf.push_back(data >> 24 & 0xff);
-  sendBuf.push_back(data >> 16 & 0xff);
-  sendBuf.push_back(data >> 8 & 0xff);
-  sendBuf.push_back(data >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(int8_t data) {
-  union {
-    uint8_t u;
-    int8_t i;
-  } u = {.i = data};
-  sendBuf.push_back('B');
-  sendBuf.push_back(u.u);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(int16_t data) {
-  union {
-    uint16_t u;
-    int16_t i;
-  } u = {.i = data};
-  sendBuf.push_back('S');
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(int32_t data) {
-  union {
-    uint32_t u;
-    int32_t i;
-  } u = {.i = data};
-  sendBuf.push_back('I');
-  sendBuf.push_back(u.u >> 24 & 0xff);
-  sendBuf.push_back(u.u >> 16 & 0xff);
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(int64_t data) {
-  union {
-    uint64_t u;
-    int64_t i;
-  } u = {.i = data};
-  sendBuf.push_back('L');
-  sendBuf.push_back(u.u >> 56 & 0xff);
-  sendBuf.push_back(u.u >> 48 & 0xff);
-  sendBuf.push_back(u.u >> 40 & 0xff);
-  sendBuf.push_back(u.u >> 32 & 0xff);
-  sendBuf.push_back(u.u >> 24 & 0xff);
-  sendBuf.push_back(u.u >> 16 & 0xff);
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(float data) {
-  union {
-    uint32_t u;
-    float f;
-  } u = {.f = data};
-  sendBuf.push_back('F');
-  sendBuf.push_back(u.u >> 24 & 0xff);
-  sendBuf.push_back(u.u >> 16 & 0xff);
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(double data) {
-  union {
-    uint64_t u;
-    double d;
-  } u = {.d = data};
-  sendBuf.push_back('D');
-  sendBuf.push_back(u.u >> 56 & 0xff);
-  sendBuf.push_back(u.u >> 48 & 0xff);
-  sendBuf.push_back(u.u >> 40 & 0xff);
-  sendBuf.push_back(u.u >> 32 & 0xff);
-  sendBuf.push_back(u.u >> 24 & 0xff);
-  sendBuf.push_back(u.u >> 16 & 0xff);
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(char8_t data) {
-  union {
-    char8_t c;
-    uint8_t u;
-  } u = {.c = data};
-  sendBuf.push_back('c');
-  sendBuf.push_back(u.u);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(char32_t data) {
-  union {
-    char32_t c;
-    uint32_t u;
-  } u = {.c = data};
-  sendBuf.push_back('C');
-  sendBuf.push_back(u.u >> 24 & 0xff);
-  sendBuf.push_back(u.u >> 16 & 0xff);
-  sendBuf.push_back(u.u >> 8 & 0xff);
-  sendBuf.push_back(u.u >> 0 & 0xff);
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(std::u8string data) {
-  uint64_t length = data.length();
-  sendBuf.push_back('u');
-  sendBuf.push_back(length >> 56 & 0xff);
-  sendBuf.push_back(length >> 48 & 0xff);
-  sendBuf.push_back(length >> 40 & 0xff);
-  sendBuf.push_back(length >> 32 & 0xff);
-  sendBuf.push_back(length >> 24 & 0xff);
-  sendBuf.push_back(length >> 16 & 0xff);
-  sendBuf.push_back(length >> 8 & 0xff);
-  sendBuf.push_back(length >> 0 & 0xff);
-  for_each(data.begin(), data.end(), [this](char8_t c) {
-    union {
-      char8_t c;
-      uint8_t u;
-    } u = {.c = c};
-    sendBuf.push_back(u.u);
-  });
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(std::u32string data) {
-  uint64_t length = data.length();
-  sendBuf.push_back('U');
-  sendBuf.push_back(length >> 56 & 0xff);
-  sendBuf.push_back(length >> 48 & 0xff);
-  sendBuf.push_back(length >> 40 & 0xff);
-  sendBuf.push_back(length >> 32 & 0xff);
-  sendBuf.push_back(length >> 24 & 0xff);
-  sendBuf.push_back(length >> 16 & 0xff);
-  sendBuf.push_back(length >> 8 & 0xff);
-  sendBuf.push_back(length >> 0 & 0xff);
-  for_each(data.begin(), data.end(), [this](char32_t c) {
-    union {
-      char32_t c;
-      uint32_t u;
-    } u = {.c = c};
-    sendBuf.push_back(u.u >> 24 & 0xff);
-    sendBuf.push_back(u.u >> 16 & 0xff);
-    sendBuf.push_back(u.u >> 8 & 0xff);
-    sendBuf.push_back(u.u >> 0 & 0xff);
-  });
+  encode(sendBuf(), data);
   return *this;
 }
 
 Connection &Connection::operator<<(bool data) {
-  sendBuf.push_back('o');
-  sendBuf.push_back(data ? 1 : 0);
+  encode(sendBuf(), data);
   return *this;
 }
 
-Connection &Connection::operator>>(uint8_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'b') throw FormatException("expected uint8_t");
+Connection &Connection::operator<<(std::span<uint8_t const> data) {
+  encode(sendBuf(), data);
+  return *this;
+}
 
-  wait(1);
-  data = recvBuf.front();
-  recvBuf.pop_front();
+Connection &Connection::operator<<(Message const &message) {
+  sendQueues[static_cast<size_t>(sendChannel)].push(message);
+  return *this;
+}
 
+Connection &Connection::operator>>(uint8_t &data) {
+  expect('b', "expected uint8_t");
+  data = *take(1);
   return *this;
 }
 
 Connection &Connection::operator>>(uint16_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 's') throw FormatException("expected uint16_t");
-
-  wait(2);
-  data = 0;
-  data |= static_cast<uint16_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  data |= static_cast<uint16_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  expect('s', "expected uint16_t");
+  data = static_cast<uint16_t>(takeUnsigned(2));
   return *this;
 }
 
 Connection &Connection::operator>>(uint32_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'i') throw FormatException("expected uint32_t");
-
-  wait(4);
-  data = 0;
-  data |= static_cast<uint32_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  data |= static_cast<uint32_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  data |= static_cast<uint32_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  data |= static_cast<uint32_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
+  expect('i', "expected uint32_t");
+  data = static_cast<uint32_t>(takeUnsigned(4));
   return *this;
 }
 
 Connection &Connection::operator>>(uint64_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'l') throw FormatException("expected uint64_t");
-
-  wait(8);
-  data = 0;
-  data |= static_cast<uint64_t>(recvBuf.front()) << 56;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 48;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 40;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 32;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  data |= static_cast<uint64_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
+  expect('l', "expected uint64_t");
+  data = takeUnsigned(8);
   return *this;
 }
 
 Connection &Connection::operator>>(int8_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'B') throw FormatException("expected int8_t");
-
-  wait(1);
+  expect('B', "expected int8_t");
   union {
     int8_t s;
     uint8_t u;
-  } u = {.u = 0};
-  u.u = recvBuf.front();
-  recvBuf.pop_front();
-
+  } u = {.u = *take(1)};
   data = u.s;
   return *this;
 }
 
 Connection &Connection::operator>>(int16_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'S') throw FormatException("expected int16_t");
-
-  wait(2);
+  expect('S', "expected int16_t");
   union {
     int16_t s;
     uint16_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint16_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint16_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = static_cast<uint16_t>(takeUnsigned(2))};
   data = u.s;
   return *this;
 }
 
 Connection &Connection::operator>>(int32_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'I') throw FormatException("expected int32_t");
-
-  wait(4);
+  expect('I', "expected int32_t");
   union {
     int32_t s;
     uint32_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = static_cast<uint32_t>(takeUnsigned(4))};
   data = u.s;
   return *this;
 }
 
 Connection &Connection::operator>>(int64_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'L') throw FormatException("expected int64_t");
-
-  wait(8);
+  expect('L', "expected int64_t");
   union {
     int64_t s;
     uint64_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 56;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 48;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 40;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 32;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = takeUnsigned(8)};
   data = u.s;
   return *this;
 }
 
 Connection &Connection::operator>>(float &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'F') throw FormatException("expected float");
-
-  wait(4);
+  expect('F', "expected float");
   union {
     float f;
     uint32_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = static_cast<uint32_t>(takeUnsigned(4))};
   data = u.f;
   return *this;
 }
 
 Connection &Connection::operator>>(double &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'D') throw FormatException("expected double");
-
-  wait(8);
+  expect('D', "expected double");
   union {
     double d;
     uint64_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 56;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 48;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 40;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 32;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint64_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = takeUnsigned(8)};
   data = u.d;
   return *this;
 }
 
 Connection &Connection::operator>>(char8_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'c') throw FormatException("expected char8_t");
-
-  wait(1);
-  data = recvBuf.front();
-  recvBuf.pop_front();
+  expect('c', "expected char8_t");
+  union {
+    char8_t c;
+    uint8_t u;
+  } u = {.u = *take(1)};
+  data = u.c;
   return *this;
 }
 
 Connection &Connection::operator>>(char32_t &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'C') throw FormatException("expected char32_t");
-
-  wait(4);
+  expect('C', "expected char32_t");
   union {
     char32_t c;
     uint32_t u;
-  } u = {.u = 0};
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  u.u |= static_cast<uint32_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
+  } u = {.u = static_cast<uint32_t>(takeUnsigned(4))};
   data = u.c;
   return *this;
 }
 
 Connection &Connection::operator>>(std::u8string &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'u') throw FormatException("expected std::u8string");
-
-  wait(8);
-  uint64_t size = 0;
-  size |= static_cast<uint64_t>(recvBuf.front()) << 56;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 48;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 40;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 32;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
-  wait(size);
-  data.clear();
-  for (size_t cnt = 0; cnt < size; ++cnt) {
-    union {
-      char8_t c;
-      uint8_t u;
-    } u = {.u = recvBuf.front()};
-    recvBuf.pop_front();
-    data += u.c;
-  }
+  u8string_view view;
+  *this >> view;
+  data.assign(view);
   return *this;
 }
 
 Connection &Connection::operator>>(std::u32string &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'U') throw FormatException("expected std::u32string");
-
-  wait(8);
-  uint64_t size = 0;
-  size |= static_cast<uint64_t>(recvBuf.front()) << 56;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 48;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 40;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 32;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 24;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 16;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 8;
-  recvBuf.pop_front();
-  size |= static_cast<uint64_t>(recvBuf.front()) << 0;
-  recvBuf.pop_front();
-
-  wait(size * 4);
-  data.clear();
+  expect('U', "expected std::u32string");
+  uint64_t size = takeLength(sizeof(char32_t));
+
+  // decode straight out of the receive buffer
+  uint8_t const *bytes = take(size * sizeof(char32_t));
+  data.resize(size);
   for (size_t cnt = 0; cnt < size; ++cnt) {
     union {
       char32_t c;
       uint32_t u;
-    } u = {.u = 0};
-    u.u |= static_cast<uint32_t>(recvBuf.front()) << 24;
-    recvBuf.pop_front();
-    u.u |= static_cast<uint32_t>(recvBuf.front()) << 16;
-    recvBuf.pop_front();
-    u.u |= static_cast<uint32_t>(recvBuf.front()) << 8;
-    recvBuf.pop_front();
-    u.u |= static_cast<uint32_t>(recvBuf.front()) << 0;
-    recvBuf.pop_front();
-    data += u.c;
+    } u = {.u = static_cast<uint32_t>(bytes[cnt * 4 + 0]) << 24 |
+                static_cast<uint32_t>(bytes[cnt * 4 + 1]) << 16 |
+                static_cast<uint32_t>(bytes[cnt * 4 + 2]) << 8 |
+                static_cast<uint32_t>(bytes[cnt * 4 + 3]) << 0};
+    data[cnt] = u.c;
   }
   return *this;
 }
 
 Connection &Connection::operator>>(bool &data) {
-  wait(1);
-  uint8_t type = recvBuf.front();
-  recvBuf.pop_front();
-  if (type != 'o') throw FormatException("expected bool");
+  expect('o', "expected bool");
+  data = *take(1) != 0;
+  return *this;
+}
+
+Connection &Connection::operator>>(std::u8string_view &data) {
+  expect('u', "expected std::u8string");
+  uint64_t size = takeLength(sizeof(char8_t));
+  data = u8string_view(reinterpret_cast<char8_t const *>(take(size)), size);
+  return *this;
+}
+
+Connection &Connection::operator>>(std::span<uint8_t const> &data) {
+  expect('a', "expected byte array");
+  uint64_t size = takeLength(sizeof(uint8_t));
+  data = span<uint8_t const>(take(size), size);
+  return *this;
+}
+
+void Connection::setMaxMessageSize(size_t size) noexcept {
+  maxMessageSize = size;
+}
+
+void Connection::setHandshakeTimeout(chrono::milliseconds timeout) noexcept {
+  handshakeTimeout = timeout;
+}
+
+Connection &Connection::operator<<(Channel channel) {
+  sendChannel = channel;
+  return *this;
+}
 
-  wait(1);
-  data = recvBuf.front() != 0;
-  recvBuf.pop_front();
+Connection &Connection::operator>>(Channel channel) {
+  recvChannel = channel;
   return *this;
 }
 
+void Connection::setWatermarks(size_t high, size_t low) noexcept {
+  highWatermark = high;
+  lowWatermark = low;
+}
+
+void Connection::setSlowConsumerHook(SlowConsumerHook hook) noexcept {
+  slowConsumerHook = move(hook);
+}
+
 Connection &Connection::flush() {
   send();
   return *this;
 }
 
 constexpr size_t PACKET_SIZE = 4096;
+
 constexpr size_t PLAINTEXT_SIZE =
     PACKET_SIZE - crypto_secretstream_xchacha20poly1305_ABYTES;
-constexpr size_t MESSAGE_SIZE = PLAINTEXT_SIZE - sizeof(uint16_t);
+constexpr size_t AES_PLAINTEXT_SIZE = PACKET_SIZE -
+                                      crypto_aead_aes256gcm_NPUBBYTES -
+                                      crypto_aead_aes256gcm_ABYTES;
+
+namespace {
+uint64_t elapsedNanos(chrono::steady_clock::time_point start) {
+  chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - start;
+  return static_cast<uint64_t>(
+      chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+}
+}  // namespace
+
+size_t Connection::plaintextSize() const noexcept {
+  switch (cipher) {
+    case Cipher::XCHACHA20POLY1305: {
+      return PLAINTEXT_SIZE;
+    }
+    case Cipher::AES256GCM: {
+      return AES_PLAINTEXT_SIZE;
+    }
+  }
+  return PLAINTEXT_SIZE;
+}
 
 void Connection::send() {
-  if (sendBuf.empty()) return;
+  finishOutbox();
+  array<unsigned char, PACKET_SIZE> ciphertext;
+  do {
+    while (seal(ciphertext.data())) sendTimed(ciphertext.data(), PACKET_SIZE);
+    releaseHeldBack();
+  } while (queued() != 0);
+}
 
-  unique_ptr<unsigned char[]> plaintext =
-      make_unique<unsigned char[]>(PLAINTEXT_SIZE);
-  uint16_t len = min(MESSAGE_SIZE, sendBuf.size());
-  plaintext[MESSAGE_SIZE + 0] = len >> 8 & 0xff;
-  plaintext[MESSAGE_SIZE + 1] = len >> 0 & 0xff;
-  for (uint16_t cnt = 0; cnt < len; ++cnt) {
-    plaintext[cnt] = sendBuf.front();
-    sendBuf.pop_front();
+size_t Connection::queued() const noexcept {
+  return queuedBytes() + (outbox.size() - outboxPos);
+}
+
+Connection::Pressure Connection::pressure() noexcept {
+  return pressure(queued());
+}
+
+Connection::Pressure Connection::pressure(size_t depth) noexcept {
+  if (depth > highWatermark)
+    congested = true;
+  else if (depth <= lowWatermark)
+    congested = false;
+  return congested ? Pressure::CONGESTED : Pressure::NORMAL;
+}
+
+Connection::Pressure Connection::trySend() {
+  while (true) {
+    if (outboxPos == outbox.size()) {
+      outbox.resize(PACKET_SIZE);
+      outboxPos = 0;
+      if (!seal(outbox.data())) {
+        outbox.clear();
+        break;
+      }
+    }
+
+    size_t sent =
+        trySendRaw(outbox.data() + outboxPos, outbox.size() - outboxPos);
+    counters.bytesSent.fetch_add(sent, memory_order_relaxed);
+    outboxPos += sent;
+    if (outboxPos != outbox.size()) break;
   }
-  unique_ptr<unsigned char[]> ciphertext =
-      make_unique<unsigned char[]>(PACKET_SIZE);
+  releaseHeldBack();
+  return pressure();
+}
 
-  crypto_secretstream_xchacha20poly1305_push(
-      &sendState, ciphertext.get(), nullptr, plaintext.get(), PLAINTEXT_SIZE,
-      nullptr, 0, crypto_secretstream_xchacha20poly1305_TAG_MESSAGE);
+void Connection::abandon() noexcept {
+  try {
+    trySend();
+  } catch (...) {
+    // the peer is going away regardless
+  }
+  for (size_t channel = 0; channel < NUM_CHANNELS; ++channel) {
+    sendQueues[channel] = SendQueue();
+    heldBack[channel] = SendQueue();
+  }
+  outbox.clear();
+  outboxPos = 0;
+}
 
-  sendRaw(ciphertext.get(), PACKET_SIZE);
+bool Connection::enqueue(Channel channel, SendQueue message) {
+  if (pressure(queued() + message.size()) == Pressure::CONGESTED)
+    return overloaded(channel, move(message));
 
-  return send();
+  sendQueues[static_cast<size_t>(channel)].append(move(message));
+  return true;
+}
+
+bool Connection::overloaded(Channel channel, SendQueue message) {
+  SlowConsumerAction action = slowConsumerHook
+                                  ? slowConsumerHook(channel, queued())
+                                  : SlowConsumerAction::COALESCE;
+  switch (action) {
+    case SlowConsumerAction::DROP: {
+      counters.messagesDropped.fetch_add(1, memory_order_relaxed);
+      return false;
+    }
+    case SlowConsumerAction::COALESCE: {
+      SendQueue &held = heldBack[static_cast<size_t>(channel)];
+      if (!held.empty())
+        counters.messagesDropped.fetch_add(1, memory_order_relaxed);
+      held = move(message);
+      return true;
+    }
+    case SlowConsumerAction::DISCONNECT: {
+      throw SocketException("Peer is not keeping up");
+    }
+  }
+  return false;
+}
+
+void Connection::releaseHeldBack() {
+  if (pressure() == Pressure::CONGESTED) return;
+  for (size_t channel = 0; channel < NUM_CHANNELS; ++channel)
+    sendQueues[channel].append(move(heldBack[channel]));
 }
 
 void Connection::recv() {
-  unique_ptr<unsigned char[]> ciphertext =
-      make_unique<unsigned char[]>(PACKET_SIZE);
-  recvRaw(ciphertext.get(), PACKET_SIZE);
+  array<unsigned char, PACKET_SIZE> ciphertext;
+  if (inboxFill != 0) {
+    // finish the frame a non-blocking read started
+    recvTimed(inbox.data() + inboxFill, PACKET_SIZE - inboxFill);
+    inboxFill = 0;
+    copy(inbox.begin(), inbox.end(), ciphertext.begin());
+  } else {
+    recvTimed(ciphertext.data(), PACKET_SIZE);
+  }
+  open(ciphertext.data());
+}
+
+bool Connection::seal(unsigned char *ciphertext) {
+  // each frame goes to the highest-priority channel with anything queued
+  auto channel =
+      find_if(sendQueues.begin(), sendQueues.end(),
+              [](SendQueue const &queue) { return !queue.empty(); });
+  if (channel == sendQueues.end()) return false;
 
+  size_t plaintextLength = plaintextSize();
+  size_t messageSize = plaintextLength - sizeof(uint8_t) - sizeof(uint16_t);
   unique_ptr<unsigned char[]> plaintext =
-      make_unique<unsigned char[]>(PLAINTEXT_SIZE);
+      make_unique<unsigned char[]>(plaintextLength);
+  uint16_t len = static_cast<uint16_t>(min(messageSize, channel->size()));
+  plaintext[messageSize + 0] =
+      static_cast<unsigned char>(channel - sendQueues.begin());
+  plaintext[messageSize + 1] = len >> 8 & 0xff;
+  plaintext[messageSize + 2] = len >> 0 & 0xff;
+  channel->take(plaintext.get(), len);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  switch (cipher) {
+    case Cipher::XCHACHA20POLY1305: {
+      crypto_secretstream_xchacha20poly1305_push(
+          &sendState, ciphertext, nullptr, plaintext.get(), plaintextLength,
+          nullptr, 0, crypto_secretstream_xchacha20poly1305_TAG_MESSAGE);
+      break;
+    }
+    case Cipher::AES256GCM: {
+      // explicit nonce: the frame counter, sent in the clear
+      memset(ciphertext, 0, crypto_aead_aes256gcm_NPUBBYTES);
+      for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+        ciphertext[cnt] = sendCounter >> (8 * (sizeof(uint64_t) - 1 - cnt)) &
+                          0xff;
+      ++sendCounter;
+      crypto_aead_aes256gcm_encrypt_afternm(
+          ciphertext + crypto_aead_aes256gcm_NPUBBYTES, nullptr,
+          plaintext.get(), plaintextLength, nullptr, 0, nullptr, ciphertext,
+          &sendAesState);
+      break;
+    }
+  }
+  counters.encryptNanos.fetch_add(elapsedNanos(start), memory_order_relaxed);
+  counters.framesSent.fetch_add(1, memory_order_relaxed);
+  counters.paddingSent.fetch_add(messageSize - len, memory_order_relaxed);
+  counters.sendQueued.store(queuedBytes(), memory_order_relaxed);
+  return true;
+}
 
-  if (crypto_secretstream_xchacha20poly1305_pull(
-          &recvState, plaintext.get(), nullptr, nullptr, ciphertext.get(),
-          PACKET_SIZE, nullptr, 0) == -1)
-    throw SocketException("Corrupted packet");
+void Connection::open(unsigned char const *ciphertext) {
+  size_t plaintextLength = plaintextSize();
+  size_t messageSize = plaintextLength - sizeof(uint8_t) - sizeof(uint16_t);
+  unique_ptr<unsigned char[]> plaintext =
+      make_unique<unsigned char[]>(plaintextLength);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  switch (cipher) {
+    case Cipher::XCHACHA20POLY1305: {
+      if (crypto_secretstream_xchacha20poly1305_pull(
+              &recvState, plaintext.get(), nullptr, nullptr, ciphertext,
+              PACKET_SIZE, nullptr, 0) == -1)
+        throw SocketException("Corrupted packet");
+      break;
+    }
+    case Cipher::AES256GCM: {
+      // frames must arrive in order - anything else is a replay or a drop
+      uint64_t counter = 0;
+      for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+        counter = counter << 8 | ciphertext[cnt];
+      if (counter != recvCounter) throw SocketException("Out of order packet");
+      ++recvCounter;
+
+      if (crypto_aead_aes256gcm_decrypt_afternm(
+              plaintext.get(), nullptr, nullptr,
+              ciphertext + crypto_aead_aes256gcm_NPUBBYTES,
+              PACKET_SIZE - crypto_aead_aes256gcm_NPUBBYTES, nullptr, 0,
+              ciphertext, &recvAesState) == -1)
+        throw SocketException("Corrupted packet");
+      break;
+    }
+  }
+  counters.decryptNanos.fetch_add(elapsedNanos(start), memory_order_relaxed);
+  counters.framesReceived.fetch_add(1, memory_order_relaxed);
 
+  uint8_t channel = plaintext[messageSize + 0];
+  if (channel >= NUM_CHANNELS) throw SocketException("Unknown channel");
   uint16_t len = 0;
-  len |= static_cast<uint16_t>(plaintext[MESSAGE_SIZE + 0]) << 8;
-  len |= static_cast<uint16_t>(plaintext[MESSAGE_SIZE + 1]) << 0;
-  for (uint16_t cnt = 0; cnt < len; ++cnt) {
-    recvBuf.push_back(plaintext[cnt]);
+  len |= static_cast<uint16_t>(plaintext[messageSize + 1]) << 8;
+  len |= static_cast<uint16_t>(plaintext[messageSize + 2]) << 0;
+  if (len > messageSize) throw SocketException("Corrupted packet");
+
+  // a channel nobody reads mustn't grow without bound
+  RecvBuffer &buf = recvBufs[channel];
+  if (buf.data.size() - buf.pos + len > maxMessageSize + PACKET_SIZE)
+    throw SocketException("Too much unread data on a channel");
+  buf.data.insert(buf.data.end(), plaintext.get(), plaintext.get() + len);
+  counters.recvBuffered.store(bufferedBytes(), memory_order_relaxed);
+}
+
+bool Connection::pump() {
+  inbox.resize(PACKET_SIZE);
+  size_t received =
+      tryRecvRaw(inbox.data() + inboxFill, PACKET_SIZE - inboxFill);
+  counters.bytesReceived.fetch_add(received, memory_order_relaxed);
+  inboxFill += received;
+  if (inboxFill != PACKET_SIZE) return false;
+
+  inboxFill = 0;
+  open(inbox.data());
+  return true;
+}
+
+void Connection::finishOutbox() {
+  if (outboxPos == outbox.size()) return;
+  sendTimed(outbox.data() + outboxPos, outbox.size() - outboxPos);
+  outbox.clear();
+  outboxPos = 0;
+}
+
+void Connection::setReactor(Reactor &reactor_) noexcept { reactor = &reactor_; }
+
+Task<void> Connection::drain() {
+  while (true) {
+    if (outboxPos == outbox.size()) {
+      outbox.resize(PACKET_SIZE);
+      outboxPos = 0;
+      if (!seal(outbox.data())) {
+        outbox.clear();
+        releaseHeldBack();
+        if (queued() == 0) co_return;
+        continue;
+      }
+    }
+
+    size_t sent =
+        trySendRaw(outbox.data() + outboxPos, outbox.size() - outboxPos);
+    counters.bytesSent.fetch_add(sent, memory_order_relaxed);
+    outboxPos += sent;
+    if (outboxPos != outbox.size())
+      co_await reactor->ready(*this, Reactor::Direction::WRITE);
   }
 }
 
-bool Connection::handshake(string const &password) {
-  unique_ptr<unsigned char[]> sendSalt =
-      make_unique<unsigned char[]>(crypto_pwhash_SALTBYTES);
-  randombytes_buf(sendSalt.get(), crypto_pwhash_SALTBYTES);
-  sendRaw(sendSalt.get(), crypto_pwhash_SALTBYTES);
-
-  unique_ptr<unsigned char[]> sendKey = make_unique<unsigned char[]>(
-      crypto_secretstream_xchacha20poly1305_KEYBYTES);
-  if (crypto_pwhash(
-          sendKey.get(), crypto_secretstream_xchacha20poly1305_KEYBYTES,
-          password.c_str(), password.length(), sendSalt.get(),
-          crypto_pwhash_OPSLIMIT_INTERACTIVE,
-          crypto_pwhash_MEMLIMIT_INTERACTIVE, crypto_pwhash_ALG_DEFAULT) != 0) {
-    throw SocketException("Failed to generate sending key");
+Statistics Connection::getStatistics() noexcept {
+  Statistics statistics;
+  statistics.connections = 1;
+  statistics.bytesSent = counters.bytesSent.load(memory_order_relaxed);
+  statistics.bytesReceived = counters.bytesReceived.load(memory_order_relaxed);
+  statistics.framesSent = counters.framesSent.load(memory_order_relaxed);
+  statistics.framesReceived =
+      counters.framesReceived.load(memory_order_relaxed);
+  statistics.paddingSent = counters.paddingSent.load(memory_order_relaxed);
+  statistics.encryptTime =
+      chrono::nanoseconds(counters.encryptNanos.load(memory_order_relaxed));
+  statistics.decryptTime =
+      chrono::nanoseconds(counters.decryptNanos.load(memory_order_relaxed));
+  statistics.sendBlockedTime =
+      chrono::nanoseconds(counters.sendBlockedNanos.load(memory_order_relaxed));
+  statistics.recvBlockedTime =
+      chrono::nanoseconds(counters.recvBlockedNanos.load(memory_order_relaxed));
+  statistics.messagesDropped =
+      counters.messagesDropped.load(memory_order_relaxed);
+  statistics.sendQueued = counters.sendQueued.load(memory_order_relaxed);
+  statistics.recvBuffered = counters.recvBuffered.load(memory_order_relaxed);
+  if (optional<chrono::microseconds> measured = rtt(); measured) {
+    statistics.rtt = *measured;
+    statistics.maxRtt = *measured;
+    statistics.rttSamples = 1;
   }
+  return statistics;
+}
+
+optional<chrono::microseconds> Connection::rtt() noexcept { return nullopt; }
+
+void Connection::checkDeadline() const {
+  if (deadline && chrono::steady_clock::now() >= *deadline)
+    throw SocketException("Handshake timed out");
+}
+
+void Connection::sendTimed(void const *data, size_t length) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  sendRaw(data, length);
+  counters.sendBlockedNanos.fetch_add(elapsedNanos(start),
+                                      memory_order_relaxed);
+  counters.bytesSent.fetch_add(length, memory_order_relaxed);
+}
+
+void Connection::recvTimed(void *data, size_t length) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  recvRaw(data, length);
+  counters.recvBlockedNanos.fetch_add(elapsedNanos(start),
+                                      memory_order_relaxed);
+  counters.bytesReceived.fetch_add(length, memory_order_relaxed);
+}
+
+uint64_t Connection::queuedBytes() const noexcept {
+  uint64_t queued = 0;
+  for (SendQueue const &queue : sendQueues) queued += queue.size();
+  return queued;
+}
+
+uint64_t Connection::bufferedBytes() const noexcept {
+  uint64_t buffered = 0;
+  for (RecvBuffer const &buf : recvBufs) buffered += buf.data.size() - buf.pos;
+  return buffered;
+}
+
+Statistics &Statistics::operator+=(Statistics const &other) noexcept {
+  connections += other.connections;
+  bytesSent += other.bytesSent;
+  bytesReceived += other.bytesReceived;
+  framesSent += other.framesSent;
+  framesReceived += other.framesReceived;
+  paddingSent += other.paddingSent;
+  encryptTime += other.encryptTime;
+  decryptTime += other.decryptTime;
+  sendBlockedTime += other.sendBlockedTime;
+  recvBlockedTime += other.recvBlockedTime;
+  messagesDropped += other.messagesDropped;
+  sendQueued += other.sendQueued;
+  recvBuffered += other.recvBuffered;
+  if (rttSamples + other.rttSamples != 0)
+    rtt = (rtt * rttSamples + other.rtt * other.rttSamples) /
+          (rttSamples + other.rttSamples);
+  rttSamples += other.rttSamples;
+  maxRtt = max(maxRtt, other.maxRtt);
+  return *this;
+}
+
+ostream &operator<<(ostream &out, Statistics const &statistics) {
+  auto millis = [](chrono::nanoseconds time) {
+    return chrono::duration_cast<chrono::milliseconds>(time).count();
+  };
+  return out << "connections=" << statistics.connections
+             << " bytesSent=" << statistics.bytesSent
+             << " bytesReceived=" << statistics.bytesReceived
+             << " framesSent=" << statistics.framesSent
+             << " framesReceived=" << statistics.framesReceived
+             << " paddingSent=" << statistics.paddingSent
+             << " encryptMs=" << millis(statistics.encryptTime)
+             << " decryptMs=" << millis(statistics.decryptTime)
+             << " sendBlockedMs=" << millis(statistics.sendBlockedTime)
+             << " recvBlockedMs=" << millis(statistics.recvBlockedTime)
+             << " messagesDropped=" << statistics.messagesDropped
+             << " sendQueued=" << statistics.sendQueued
+             << " recvBuffered=" << statistics.recvBuffered
+             << " rttUs=" << statistics.rtt.count()
+             << " maxRttUs=" << statistics.maxRtt.count();
+}
+
+namespace {
+/**
+ * first byte sent by the client, selecting the handshake to do, and the byte
+ * the server answers with, saying which handshake it did
+ */
+enum HandshakeMode : uint8_t {
+  FULL = 0,
+  RESUME = 1,
+};
+
+/** capability bits exchanged in the hello and the greeting */
+enum Capability : uint8_t {
+  CAP_AES256GCM = 1 << 0,
+};
+
+constexpr size_t SALT_SIZE = crypto_pwhash_SALTBYTES;
+constexpr size_t GREETING_SIZE = SALT_SIZE + 1;
+constexpr size_t KEY_SIZE = crypto_secretstream_xchacha20poly1305_KEYBYTES;
+constexpr size_t TRANSCRIPT_SIZE = crypto_generichash_BYTES;
+constexpr size_t CONFIRMATION_SIZE =
+    crypto_secretstream_xchacha20poly1305_HEADERBYTES + TRANSCRIPT_SIZE +
+    crypto_secretstream_xchacha20poly1305_ABYTES;
+
+/**
+ * derive both directional keys from the password
+ *
+ * one memory-hard hash over both salts gives a master key, which the
+ * directional keys are cheaply derived from - half the work of hashing once
+ * per direction, without a thread per handshake
+ *
+ * @param clientKey the client-to-server key
+ * @param serverKey the server-to-client key
+ */
+void derivePasswordKeys(string const &password,
+                        unsigned char const *clientSalt,
+                        unsigned char const *serverSalt,
+                        unsigned char *clientKey, unsigned char *serverKey) {
+  array<unsigned char, SALT_SIZE> salt;
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, nullptr, 0, salt.size());
+  crypto_generichash_update(&state, clientSalt, SALT_SIZE);
+  crypto_generichash_update(&state, serverSalt, SALT_SIZE);
+  crypto_generichash_final(&state, salt.data(), salt.size());
+
+  array<unsigned char, crypto_kdf_KEYBYTES> master;
+  if (crypto_pwhash(master.data(), master.size(), password.c_str(),
+                    password.length(), salt.data(),
+                    crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                    crypto_pwhash_MEMLIMIT_INTERACTIVE,
+                    crypto_pwhash_ALG_DEFAULT) != 0)
+    throw SocketException("Failed to generate session keys");
+  crypto_kdf_derive_from_key(clientKey, KEY_SIZE, 1, "password",
+                             master.data());
+  crypto_kdf_derive_from_key(serverKey, KEY_SIZE, 2, "password",
+                             master.data());
+  sodium_memzero(master.data(), master.size());
+}
+
+uint8_t localCapabilities() noexcept {
+  uint8_t capabilities = 0;
+  if (crypto_aead_aes256gcm_is_available() == 1)
+    capabilities |= CAP_AES256GCM;
+  return capabilities;
+}
+
+/**
+ * derive a directional key for a resumed session
+ *
+ * @param label distinguishes the client-to-server and server-to-client keys
+ */
+void deriveResumedKey(unsigned char *key, unsigned char const *secret,
+                      unsigned char const *clientSalt,
+                      unsigned char const *serverSalt, uint8_t label) {
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, secret, TICKET_SECRET_SIZE, KEY_SIZE);
+  crypto_generichash_update(&state, clientSalt, SALT_SIZE);
+  crypto_generichash_update(&state, serverSalt, SALT_SIZE);
+  crypto_generichash_update(&state, &label, 1);
+  crypto_generichash_final(&state, key, KEY_SIZE);
+}
 
-  unique_ptr<unsigned char[]> sendHeader = make_unique<unsigned char[]>(
-      crypto_secretstream_xchacha20poly1305_HEADERBYTES);
-  if (crypto_secretstream_xchacha20poly1305_init_push(
-          &sendState, sendHeader.get(), sendKey.get()) != 0)
+/**
+ * hash of everything sent in the clear, so the confirmations also detect
+ * tampering with the handshake
+ */
+array<unsigned char, TRANSCRIPT_SIZE> transcriptOf(
+    vector<unsigned char> const &hello,
+    array<unsigned char, GREETING_SIZE> const &greeting, uint8_t status) {
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, nullptr, 0, TRANSCRIPT_SIZE);
+  crypto_generichash_update(&state, hello.data(), hello.size());
+  crypto_generichash_update(&state, greeting.data(), greeting.size());
+  crypto_generichash_update(&state, &status, 1);
+
+  array<unsigned char, TRANSCRIPT_SIZE> transcript;
+  crypto_generichash_final(&state, transcript.data(), transcript.size());
+  return transcript;
+}
+
+/**
+ * the secret a ticket issued for this session stands in for
+ *
+ * both ends compute this from the session keys, so it never goes on the wire
+ */
+array<unsigned char, TICKET_SECRET_SIZE> resumptionSecret(
+    unsigned char const *clientKey, unsigned char const *serverKey) {
+  array<unsigned char, KEY_SIZE * 2> keys;
+  copy_n(clientKey, KEY_SIZE, keys.begin());
+  copy_n(serverKey, KEY_SIZE, keys.begin() + KEY_SIZE);
+
+  array<unsigned char, TICKET_SECRET_SIZE> secret;
+  crypto_generichash(secret.data(), secret.size(), keys.data(), keys.size(),
+                     nullptr, 0);
+  sodium_memzero(keys.data(), keys.size());
+  return secret;
+}
+}  // namespace
+
+TicketKey::TicketKey() noexcept { crypto_secretbox_keygen(key.data()); }
+
+TicketKey::~TicketKey() noexcept { sodium_memzero(key.data(), key.size()); }
+
+array<unsigned char, TICKET_SIZE> TicketKey::seal(
+    array<unsigned char, TICKET_SECRET_SIZE> const &secret,
+    chrono::seconds lifetime) const noexcept {
+  uint64_t expiry = chrono::duration_cast<chrono::seconds>(
+                        (chrono::system_clock::now() + lifetime)
+                            .time_since_epoch())
+                        .count();
+  array<unsigned char, TICKET_SECRET_SIZE + sizeof(uint64_t)> plaintext;
+  copy(secret.begin(), secret.end(), plaintext.begin());
+  for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+    plaintext[TICKET_SECRET_SIZE + cnt] =
+        expiry >> (8 * (sizeof(uint64_t) - 1 - cnt)) & 0xff;
+
+  array<unsigned char, TICKET_SIZE> sealed;
+  randombytes_buf(sealed.data(), crypto_secretbox_NONCEBYTES);
+  crypto_secretbox_easy(sealed.data() + crypto_secretbox_NONCEBYTES,
+                        plaintext.data(), plaintext.size(), sealed.data(),
+                        key.data());
+  sodium_memzero(plaintext.data(), plaintext.size());
+  return sealed;
+}
+
+optional<array<unsigned char, TICKET_SECRET_SIZE>> TicketKey::open(
+    array<unsigned char, TICKET_SIZE> const &sealed) const noexcept {
+  array<unsigned char, TICKET_SECRET_SIZE + sizeof(uint64_t)> plaintext;
+  if (crypto_secretbox_open_easy(
+          plaintext.data(), sealed.data() + crypto_secretbox_NONCEBYTES,
+          TICKET_SIZE - crypto_secretbox_NONCEBYTES, sealed.data(),
+          key.data()) != 0)
+    return nullopt;
+
+  uint64_t expiry = 0;
+  for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+    expiry = expiry << 8 | plaintext[TICKET_SECRET_SIZE + cnt];
+  uint64_t now = chrono::duration_cast<chrono::seconds>(
+                     chrono::system_clock::now().time_since_epoch())
+                     .count();
+  if (now >= expiry) return nullopt;
+
+  array<unsigned char, TICKET_SECRET_SIZE> secret;
+  copy_n(plaintext.begin(), TICKET_SECRET_SIZE, secret.begin());
+  sodium_memzero(plaintext.data(), plaintext.size());
+  return secret;
+}
+
+bool Connection::handshake(string const &password, optional<Ticket> &ticket) {
+  return handshake(string(), password, ticket);
+}
+
+bool Connection::handshake(string const &room, string const &password,
+                           optional<Ticket> &ticket) {
+  if (room.length() > MAX_ROOM_LENGTH)
+    throw SocketException("Room name too long");
+
+  // everything we have to say goes out at once, crossing the server's greeting
+  vector<unsigned char> hello;
+  hello.push_back(ticket ? RESUME : FULL);
+  hello.push_back(localCapabilities());
+  hello.push_back(static_cast<unsigned char>(room.length()));
+  hello.insert(hello.end(), room.begin(), room.end());
+  if (ticket)
+    hello.insert(hello.end(), ticket->sealed.begin(), ticket->sealed.end());
+  hello.resize(hello.size() + SALT_SIZE);
+  unsigned char *clientSalt = hello.data() + hello.size() - SALT_SIZE;
+  randombytes_buf(clientSalt, SALT_SIZE);
+  sendTimed(hello.data(), hello.size());
+
+  array<unsigned char, GREETING_SIZE> greeting;
+  recvTimed(greeting.data(), greeting.size());
+  unsigned char const *serverSalt = greeting.data();
+
+  array<unsigned char, KEY_SIZE> sendKey;
+  array<unsigned char, KEY_SIZE> recvKey;
+  uint8_t status = FULL;
+  if (ticket) {
+    // only the server knows if it still accepts the ticket
+    recvTimed(&status, 1);
+    switch (status) {
+      case FULL: {
+        derivePasswordKeys(password, clientSalt, serverSalt,
+                           sendKey.data(), recvKey.data());
+        break;
+      }
+      case RESUME: {
+        deriveResumedKey(sendKey.data(), ticket->secret.data(), clientSalt,
+                         serverSalt, 'c');
+        deriveResumedKey(recvKey.data(), ticket->secret.data(), clientSalt,
+                         serverSalt, 's');
+        break;
+      }
+      default: {
+        throw SocketException("Unknown handshake status");
+      }
+    }
+  } else {
+    derivePasswordKeys(password, clientSalt, serverSalt, sendKey.data(),
+                       recvKey.data());
+  }
+
+  array<unsigned char, TRANSCRIPT_SIZE> transcript =
+      transcriptOf(hello, greeting, status);
+  vector<unsigned char> flight;
+  appendConfirmation(flight, sendKey.data(), transcript);
+  startRecordLayer(hello[1] & greeting[SALT_SIZE], sendKey.data(),
+                   recvKey.data());
+  exportDatagramKeys(sendKey.data(), recvKey.data(), sendKey.data());
+  sendTimed(flight.data(), flight.size());
+
+  if (!ticket) {
+    uint8_t serverStatus;
+    recvTimed(&serverStatus, 1);
+    if (serverStatus != FULL)
+      throw SocketException("Unexpected handshake status");
+  }
+  if (!checkConfirmation(recvKey.data(), transcript)) return false;
+
+  Ticket next;
+  recvTimed(next.sealed.data(), TICKET_SIZE);
+  next.secret = resumptionSecret(sendKey.data(), recvKey.data());
+  ticket = next;
+  return true;
+}
+
+bool Connection::handshake(string const &password,
+                           TicketKey const &ticketKey) {
+  return handshake([&password, &ticketKey](string const &) {
+           return optional<Credentials>(Credentials{password, ticketKey});
+         })
+      .has_value();
+}
+
+optional<string> Connection::handshake(
+    function<optional<Credentials>(string const &room)> const &lookup) {
+  // the whole handshake has one deadline, however the client paces its bytes
+  deadline = chrono::steady_clock::now() + handshakeTimeout;
+  util::ScopeGuard clearDeadline([this]() { deadline = nullopt; });
+
+  // greet straight away, so the client's hello and our salt cross on the wire
+  array<unsigned char, GREETING_SIZE> greeting;
+  randombytes_buf(greeting.data(), SALT_SIZE);
+  greeting[SALT_SIZE] = localCapabilities();
+  sendTimed(greeting.data(), greeting.size());
+  unsigned char const *serverSalt = greeting.data();
+
+  vector<unsigned char> hello(3);
+  recvTimed(hello.data(), 3);
+  size_t prefix = 3 + hello[2];
+  switch (hello.front()) {
+    case FULL: {
+      hello.resize(prefix + SALT_SIZE);
+      break;
+    }
+    case RESUME: {
+      hello.resize(prefix + TICKET_SIZE + SALT_SIZE);
+      break;
+    }
+    default: {
+      throw SocketException("Unknown handshake mode");
+    }
+  }
+  recvTimed(hello.data() + 3, hello.size() - 3);
+  unsigned char const *clientSalt = hello.data() + hello.size() - SALT_SIZE;
+
+  string room(hello.begin() + 3, hello.begin() + prefix);
+  optional<Credentials> credentials = lookup(room);
+
+  // no such room - go through the motions with a password nobody knows
+  array<unsigned char, crypto_secretbox_KEYBYTES> decoyBytes;
+  string decoyPassword;
+  optional<TicketKey> decoyKey;
+  if (!credentials) {
+    randombytes_buf(decoyBytes.data(), decoyBytes.size());
+    decoyPassword.assign(decoyBytes.begin(), decoyBytes.end());
+    decoyKey.emplace();
+    credentials.emplace(Credentials{decoyPassword, *decoyKey});
+  }
+  string const &password = credentials->password;
+  TicketKey const &ticketKey = credentials->ticketKey;
+
+  array<unsigned char, KEY_SIZE> sendKey;
+  array<unsigned char, KEY_SIZE> recvKey;
+  uint8_t status = FULL;
+  if (hello.front() == RESUME) {
+    array<unsigned char, TICKET_SIZE> sealed;
+    copy_n(hello.begin() + static_cast<ptrdiff_t>(prefix), TICKET_SIZE,
+           sealed.begin());
+    if (optional<array<unsigned char, TICKET_SECRET_SIZE>> secret =
+            ticketKey.open(sealed);
+        secret) {
+      deriveResumedKey(sendKey.data(), secret->data(), clientSalt,
+                       serverSalt, 's');
+      deriveResumedKey(recvKey.data(), secret->data(), clientSalt,
+                       serverSalt, 'c');
+      sodium_memzero(secret->data(), secret->size());
+      status = RESUME;
+    }
+  }
+  if (status == FULL)
+    derivePasswordKeys(password, clientSalt, serverSalt, recvKey.data(),
+                       sendKey.data());
+
+  // status, confirmation, and the next ticket all go in one flight
+  array<unsigned char, TRANSCRIPT_SIZE> transcript =
+      transcriptOf(hello, greeting, status);
+  vector<unsigned char> flight;
+  flight.push_back(status);
+  appendConfirmation(flight, sendKey.data(), transcript);
+  startRecordLayer(hello[1] & greeting[SALT_SIZE], sendKey.data(),
+                   recvKey.data());
+  exportDatagramKeys(sendKey.data(), recvKey.data(), recvKey.data());
+  array<unsigned char, TICKET_SIZE> sealed =
+      ticketKey.seal(resumptionSecret(recvKey.data(), sendKey.data()));
+  flight.insert(flight.end(), sealed.begin(), sealed.end());
+  sendTimed(flight.data(), flight.size());
+
+  if (!checkConfirmation(recvKey.data(), transcript) || decoyKey)
+    return nullopt;
+  return room;
+}
+
+DatagramKeys const &Connection::getDatagramKeys() const noexcept {
+  return datagramKeys;
+}
+
+bool Connection::isClosedByPeer() const noexcept { return peerClosed; }
+
+void Connection::exportDatagramKeys(unsigned char const *sendKey,
+                                    unsigned char const *recvKey,
+                                    unsigned char const *clientKey) {
+  crypto_kdf_derive_from_key(datagramKeys.sendKey.data(),
+                             datagramKeys.sendKey.size(), 2, "datagram",
+                             sendKey);
+  crypto_kdf_derive_from_key(datagramKeys.recvKey.data(),
+                             datagramKeys.recvKey.size(), 2, "datagram",
+                             recvKey);
+
+  // both ends derive the session id from the same (client-to-server) key
+  array<unsigned char, crypto_kdf_BYTES_MIN> session;
+  crypto_kdf_derive_from_key(session.data(), session.size(), 3, "datagram",
+                             clientKey);
+  datagramKeys.session = 0;
+  for (size_t cnt = 0; cnt < sizeof(uint64_t); ++cnt)
+    datagramKeys.session = datagramKeys.session << 8 | session[cnt];
+}
+
+void Connection::startRecordLayer(uint8_t capabilities,
+                                  unsigned char const *sendKey,
+                                  unsigned char const *recvKey) {
+  if ((capabilities & CAP_AES256GCM) == 0) {
+    cipher = Cipher::XCHACHA20POLY1305;
+    return;
+  }
+
+  // both ends have AES-NI - use separate subkeys for the faster record layer
+  array<unsigned char, crypto_aead_aes256gcm_KEYBYTES> aesKey;
+  crypto_kdf_derive_from_key(aesKey.data(), aesKey.size(), 1, "aes256gc",
+                             sendKey);
+  crypto_aead_aes256gcm_beforenm(&sendAesState, aesKey.data());
+  crypto_kdf_derive_from_key(aesKey.data(), aesKey.size(), 1, "aes256gc",
+                             recvKey);
+  crypto_aead_aes256gcm_beforenm(&recvAesState, aesKey.data());
+  sodium_memzero(aesKey.data(), aesKey.size());
+
+  cipher = Cipher::AES256GCM;
+  sendCounter = 0;
+  recvCounter = 0;
+}
+
+void Connection::appendConfirmation(
+    vector<unsigned char> &flight, unsigned char const *sendKey,
+    array<unsigned char, TRANSCRIPT_SIZE> const &transcript) {
+  size_t start = flight.size();
+  flight.resize(start + CONFIRMATION_SIZE);
+  unsigned char *header = flight.data() + start;
+  if (crypto_secretstream_xchacha20poly1305_init_push(&sendState, header,
+                                                      sendKey) != 0)
     throw SocketException("Failed to initialize sending state");
-  sendRaw(sendHeader.get(), crypto_secretstream_xchacha20poly1305_HEADERBYTES);
-
-  unique_ptr<unsigned char[]> recvSalt =
-      make_unique<unsigned char[]>(crypto_pwhash_SALTBYTES);
-  recvRaw(recvSalt.get(), crypto_pwhash_SALTBYTES);
-
-  unique_ptr<unsigned char[]> recvKey = make_unique<unsigned char[]>(
-      crypto_secretstream_xchacha20poly1305_KEYBYTES);
-  if (crypto_pwhash(
-          recvKey.get(), crypto_secretstream_xchacha20poly1305_KEYBYTES,
-          password.c_str(), password.length(), recvSalt.get(),
-          crypto_pwhash_OPSLIMIT_INTERACTIVE,
-          crypto_pwhash_MEMLIMIT_INTERACTIVE, crypto_pwhash_ALG_DEFAULT) != 0) {
-    throw SocketException("Failed to generate receiving key");
+
+  crypto_secretstream_xchacha20poly1305_push(
+      &sendState, header + crypto_secretstream_xchacha20poly1305_HEADERBYTES,
+      nullptr, transcript.data(), transcript.size(), nullptr, 0,
+      crypto_secretstream_xchacha20poly1305_TAG_MESSAGE);
+}
+
+bool Connection::checkConfirmation(
+    unsigned char const *recvKey,
+    array<unsigned char, TRANSCRIPT_SIZE> const &transcript) {
+  array<unsigned char, CONFIRMATION_SIZE> confirmation;
+  recvTimed(confirmation.data(), confirmation.size());
+  if (crypto_secretstream_xchacha20poly1305_init_pull(
+          &recvState, confirmation.data(), recvKey) != 0)
+    return false;
+
+  // a wrong password shows up here, as a confirmation we can't decrypt
+  array<unsigned char, TRANSCRIPT_SIZE> received;
+  if (crypto_secretstream_xchacha20poly1305_pull(
+          &recvState, received.data(), nullptr, nullptr,
+          confirmation.data() +
+              crypto_secretstream_xchacha20poly1305_HEADERBYTES,
+          confirmation.size() -
+              crypto_secretstream_xchacha20poly1305_HEADERBYTES,
+          nullptr, 0) != 0)
+    return false;
+  return sodium_memcmp(received.data(), transcript.data(), TRANSCRIPT_SIZE) ==
+         0;
+}
+
+vector<uint8_t> &Connection::sendBuf() noexcept {
+  return sendQueues[static_cast<size_t>(sendChannel)].tail;
+}
+
+size_t Connection::SendQueue::size() const noexcept {
+  return messageBytes + (tail.size() - tailPos);
+}
+
+bool Connection::SendQueue::empty() const noexcept { return size() == 0; }
+
+void Connection::SendQueue::push(Message message) {
+  if (message.empty()) return;
+
+  // close off what's been written so far, to keep it ahead of the message
+  if (tailPos != tail.size()) {
+    Message written(tailPos == 0 ? move(tail)
+                                 : vector<uint8_t>(tail.begin() + tailPos,
+                                                   tail.end()));
+    messageBytes += written.size();
+    messages.push_back(move(written));
   }
+  tail.clear();
+  tailPos = 0;
 
-  unique_ptr<unsigned char[]> recvHeader = make_unique<unsigned char[]>(
-      crypto_secretstream_xchacha20poly1305_HEADERBYTES);
-  recvRaw(recvHeader.get(), crypto_secretstream_xchacha20poly1305_HEADERBYTES);
-  return crypto_secretstream_xchacha20poly1305_init_pull(
-             &recvState, recvHeader.get(), recvKey.get()) == 0;
+  messageBytes += message.size();
+  messages.push_back(move(message));
+}
+
+void Connection::SendQueue::append(SendQueue &&other) {
+  if (empty()) {
+    *this = move(other);
+  } else {
+    // other is never partly sent - it's an offered or held back message
+    for (Message &message : other.messages) push(move(message));
+    tail.insert(tail.end(), other.tail.begin() + other.tailPos,
+                other.tail.end());
+  }
+  other = SendQueue();
+}
+
+size_t Connection::SendQueue::take(unsigned char *out, size_t n) noexcept {
+  size_t taken = 0;
+  while (taken != n && !messages.empty()) {
+    span<uint8_t const> bytes = messages.front().bytes();
+    size_t count = min(n - taken, bytes.size() - pos);
+    copy_n(bytes.begin() + pos, count, out + taken);
+    taken += count;
+    pos += count;
+    messageBytes -= count;
+    if (pos == bytes.size()) {
+      messages.pop_front();
+      pos = 0;
+    }
+  }
+
+  size_t count = min(n - taken, tail.size() - tailPos);
+  copy_n(tail.begin() + tailPos, count, out + taken);
+  taken += count;
+  tailPos += count;
+  if (tailPos == tail.size()) {
+    tail.clear();
+    tailPos = 0;
+  } else if (tailPos > tail.size() / 2) {
+    // keep the sent prefix from growing without bound
+    tail.erase(tail.begin(), tail.begin() + tailPos);
+    tailPos = 0;
+  }
+  return taken;
+}
+
+Connection::RecvBuffer &Connection::recvBuf() noexcept {
+  return recvBufs[static_cast<size_t>(recvChannel)];
 }
 
 void Connection::wait(size_t n) {
-  while (recvBuf.size() < n) recv();
+  while (recvBuf().data.size() - recvBuf().pos < n) {
+    if (!nonblocking)
+      recv();
+    else if (!pump())
+      throw WouldBlock();
+  }
+}
+
+void Connection::expect(uint8_t type, char const *message) {
+  // starting a new read - earlier views may now be invalidated, so this is
+  // when consumed bytes get dropped
+  RecvBuffer &buf = recvBuf();
+  if (buf.pos == buf.data.size()) {
+    buf.data.clear();
+    buf.pos = 0;
+  } else if (buf.pos >= PACKET_SIZE && buf.pos * 2 >= buf.data.size()) {
+    buf.data.erase(buf.data.begin(), buf.data.begin() + buf.pos);
+    buf.pos = 0;
+  }
+  buf.start = buf.pos;
+
+  if (*take(1) != type) throw FormatException(message);
+}
+
+uint8_t const *Connection::take(size_t n) {
+  wait(n);
+  RecvBuffer &buf = recvBuf();
+  uint8_t const *data = buf.data.data() + buf.pos;
+  buf.pos += n;
+  return data;
+}
+
+uint64_t Connection::takeUnsigned(size_t n) {
+  uint8_t const *bytes = take(n);
+  uint64_t data = 0;
+  for (size_t cnt = 0; cnt < n; ++cnt) data = data << 8 | bytes[cnt];
+  return data;
+}
+
+uint64_t Connection::takeLength(size_t elementSize) {
+  // checked before waiting, so a hostile length can't make us buffer forever
+  uint64_t size = takeUnsigned(8);
+  if (size > maxMessageSize / elementSize)
+    throw SocketException("Message too large");
+  return size;
 }
 
 #ifdef __linux__
@@ -702,9 +1274,72 @@ unique_ptr<Connection> Connection::makeClient(string const &host, uint16_t port,
 
 unique_ptr<Server> Server::makeServer(uint16_t port, string const &password,
                                       std::atomic_bool const &stop) {
-  return make_unique<linux::Server>(port, password, stop);
+  return make_unique<linux::Server>(port, password, stop, false);
+}
+
+vector<unique_ptr<Server>> Server::makeServers(uint16_t port, size_t count,
+                                               string const &password,
+                                               std::atomic_bool const &stop) {
+  vector<unique_ptr<Server>> servers;
+  for (size_t cnt = 0; cnt < count; ++cnt) {
+    servers.push_back(make_unique<linux::Server>(port, password, stop, true));
+    port = servers.front()->getPort();
+  }
+  return servers;
 }
 #elif
 #error "operating system not supported/recognized"
 #endif
+
+namespace {
+class SystemNetwork final : public Network {
+ public:
+  SystemNetwork() noexcept = default;
+  SystemNetwork(SystemNetwork const &) noexcept = delete;
+  SystemNetwork(SystemNetwork &&) noexcept = delete;
+
+  ~SystemNetwork() noexcept override = default;
+
+  SystemNetwork &operator=(SystemNetwork const &) noexcept = delete;
+  SystemNetwork &operator=(SystemNetwork &&) noexcept = delete;
+
+  unique_ptr<Connection> connect(string const &host, uint16_t port,
+                                 atomic_bool const &stop) override {
+    return Connection::makeClient(host, port, stop);
+  }
+  unique_ptr<Server> listen(uint16_t port, string const &password,
+                            atomic_bool const &stop) override {
+    return Server::makeServer(port, password, stop);
+  }
+  vector<unique_ptr<Server>> listenShared(uint16_t port, size_t count,
+                                          string const &password,
+                                          atomic_bool const &stop) override {
+    return Server::makeServers(port, count, password, stop);
+  }
+  unique_ptr<DatagramSocket> connectDatagrams(string const &host,
+                                              uint16_t port) override {
+    return DatagramSocket::makeClient(host, port);
+  }
+  unique_ptr<DatagramSocket> listenDatagrams(uint16_t port) override {
+    return DatagramSocket::makeServer(port);
+  }
+};
+}  // namespace
+
+vector<unique_ptr<Server>> Network::listenShared(uint16_t port, size_t,
+                                                 string const &password,
+                                                 atomic_bool const &stop) {
+  vector<unique_ptr<Server>> servers;
+  servers.push_back(listen(port, password, stop));
+  return servers;
+}
+
+unique_ptr<Reactor> Network::makeReactor(util::ThreadPool &workers) {
+  return Reactor::makeReactor(workers);
+}
+
+Network &Network::system() noexcept {
+  static SystemNetwork network;
+  return network;
+}
 }  // namespace airewar::game::networking
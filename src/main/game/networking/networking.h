@@ -22,22 +22,176 @@
 
 #include <sodium.h>
 
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <list>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "game/networking/datagram.h"
+#include "game/networking/message.h"
+#include "game/networking/reactor.h"
+#include "game/networking/task.h"
+#include "util/exceptions/socketException.h"
+#include "util/scopeGuard.h"
 
 namespace airewar::game::networking {
 constexpr uint16_t PORT = 10512;
 
+/** largest string or array a peer may send, unless changed per connection */
+constexpr size_t DEFAULT_MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+/** queued bytes above which a connection counts as congested */
+constexpr size_t DEFAULT_HIGH_WATERMARK = 1024 * 1024;
+/** queued bytes a congested connection must drain below to recover */
+constexpr size_t DEFAULT_LOW_WATERMARK = 256 * 1024;
+
+/** how long after issue a resumption ticket is accepted */
+constexpr std::chrono::seconds TICKET_LIFETIME = std::chrono::hours(1);
+
+/** longest the server side of a handshake may take, unless changed */
+constexpr std::chrono::milliseconds DEFAULT_HANDSHAKE_TIMEOUT =
+    std::chrono::seconds(10);
+
+/** size of the secret a resumption ticket stands in for */
+constexpr size_t TICKET_SECRET_SIZE = crypto_generichash_BYTES;
+
+/** size of a sealed ticket (nonce, mac, secret, expiry) */
+constexpr size_t TICKET_SIZE = crypto_secretbox_NONCEBYTES +
+                               crypto_secretbox_MACBYTES + TICKET_SECRET_SIZE +
+                               sizeof(uint64_t);
+
+/** longest room name a client may ask for */
+constexpr size_t MAX_ROOM_LENGTH = 255;
+
+/**
+ * traffic and timing for one connection, or summed over several
+ */
+struct Statistics final {
+  uint64_t connections = 0;
+
+  /** bytes on the wire, including the handshake */
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+
+  uint64_t framesSent = 0;
+  uint64_t framesReceived = 0;
+  /** bytes of frames sent that only filled the frame out to full size */
+  uint64_t paddingSent = 0;
+
+  std::chrono::nanoseconds encryptTime = std::chrono::nanoseconds(0);
+  std::chrono::nanoseconds decryptTime = std::chrono::nanoseconds(0);
+  /** time spent waiting on the socket in sendRaw/recvRaw */
+  std::chrono::nanoseconds sendBlockedTime = std::chrono::nanoseconds(0);
+  std::chrono::nanoseconds recvBlockedTime = std::chrono::nanoseconds(0);
+
+  /** offered messages dropped, or superseded while held back */
+  uint64_t messagesDropped = 0;
+
+  /** queue depths as of the last frame sent or received */
+  uint64_t sendQueued = 0;
+  uint64_t recvBuffered = 0;
+
+  /** smoothed round trip time - the mean, when summed */
+  std::chrono::microseconds rtt = std::chrono::microseconds(0);
+  std::chrono::microseconds maxRtt = std::chrono::microseconds(0);
+  /** connections with a round trip time estimate */
+  uint64_t rttSamples = 0;
+
+  Statistics &operator+=(Statistics const &other) noexcept;
+};
+
+std::ostream &operator<<(std::ostream &out, Statistics const &statistics);
+
+/**
+ * a session resumption ticket, as held by a client
+ *
+ * the sealed part is opaque to the client, and is presented to the server on
+ * reconnect; the secret is never sent and is used to derive fresh keys
+ */
+struct Ticket final {
+  std::array<unsigned char, TICKET_SIZE> sealed;
+  std::array<unsigned char, TICKET_SECRET_SIZE> secret;
+};
+
+/**
+ * server-side key used to seal and open resumption tickets
+ *
+ * tickets only survive as long as the key that sealed them
+ */
+class TicketKey final {
+ public:
+  TicketKey() noexcept;
+  TicketKey(TicketKey const &) noexcept = delete;
+  TicketKey(TicketKey &&) noexcept = delete;
+
+  ~TicketKey() noexcept;
+
+  TicketKey &operator=(TicketKey const &) noexcept = delete;
+  TicketKey &operator=(TicketKey &&) noexcept = delete;
+
+  /**
+   * seal a ticket's secret
+   *
+   * @param lifetime how long the ticket is accepted for
+   */
+  std::array<unsigned char, TICKET_SIZE> seal(
+      std::array<unsigned char, TICKET_SECRET_SIZE> const &secret,
+      std::chrono::seconds lifetime = TICKET_LIFETIME) const noexcept;
+
+  /**
+   * open a sealed ticket
+   *
+   * @return the secret, or nothing if the ticket is forged or expired
+   */
+  std::optional<std::array<unsigned char, TICKET_SECRET_SIZE>> open(
+      std::array<unsigned char, TICKET_SIZE> const &sealed) const noexcept;
+
+ private:
+  std::array<unsigned char, crypto_secretbox_KEYBYTES> key;
+};
+
+/** what the server side of a handshake checks a client against */
+struct Credentials final {
+  std::string const &password;
+  TicketKey const &ticketKey;
+};
+
 class Connection {
  public:
+  /**
+   * logical channels sharing the connection, highest priority first
+   *
+   * each frame carries data for one channel, and the next frame sent always
+   * goes to the highest-priority channel with anything queued, so small
+   * real-time messages don't wait behind bulk transfers
+   */
+  enum class Channel : uint8_t {
+    /** pings and other connection upkeep */
+    CONTROL,
+    /** inputs and state updates */
+    REALTIME,
+    /** everything else - selected until another channel is */
+    DEFAULT,
+    /** large transfers like map layers and replays */
+    BULK,
+  };
+  static constexpr size_t NUM_CHANNELS = 4;
+
   Connection() noexcept = default;
   Connection(Connection const &) noexcept = delete;
   Connection(Connection &&) noexcept = default;
 
-  virtual ~Connection() noexcept;
+  virtual ~Connection() noexcept = default;
 
   Connection &operator=(Connection const &) noexcept = delete;
   Connection &operator=(Connection &&) noexcept = default;
@@ -57,6 +211,14 @@ class Connection {
   Connection &operator<<(std::u8string data);
   Connection &operator<<(std::u32string data);
   Connection &operator<<(bool data);
+  Connection &operator<<(std::span<uint8_t const> data);
+  /**
+   * queue an already encoded message
+   *
+   * the bytes are shared, not copied, so one message can be queued on every
+   * connection that needs it
+   */
+  Connection &operator<<(Message const &message);
 
   Connection &operator>>(uint8_t &data);
   Connection &operator>>(uint16_t &data);
@@ -74,29 +236,413 @@ class Connection {
   Connection &operator>>(std::u32string &data);
   Connection &operator>>(bool &data);
 
+  /**
+   * read a string or byte array without copying it
+   *
+   * the view points into the receive buffer, and is only valid until the
+   * next read from this connection
+   */
+  Connection &operator>>(std::u8string_view &data);
+  Connection &operator>>(std::span<uint8_t const> &data);
+
+  /**
+   * set the largest string or array accepted from the peer
+   *
+   * a larger declared length fails the read before anything is buffered, and
+   * a channel holding more than this plus a frame unread fails the connection
+   */
+  void setMaxMessageSize(size_t size) noexcept;
+
+  enum class Pressure {
+    /** below the high watermark, or recovered below the low one */
+    NORMAL,
+    /** queued past the high watermark and not yet drained */
+    CONGESTED,
+  };
+
+  /** what to do with an offered message while congested */
+  enum class SlowConsumerAction {
+    /** discard it */
+    DROP,
+    /** hold it back, replacing any message already held on its channel */
+    COALESCE,
+    /** give up on the peer - offer throws */
+    DISCONNECT,
+  };
+
+  /** decides what happens to a message offered on a congested connection */
+  using SlowConsumerHook =
+      std::function<SlowConsumerAction(Channel channel, size_t queued)>;
+
+  void setWatermarks(size_t high, size_t low) noexcept;
+  void setSlowConsumerHook(SlowConsumerHook hook) noexcept;
+
+  /** queued bytes, including any partly sent frame */
+  size_t queued() const noexcept;
+  Pressure pressure() noexcept;
+
+  /**
+   * queue a message the peer can do without, like a snapshot the next one
+   * supersedes
+   *
+   * the message is written by calling write with this connection, on the
+   * given channel; if that leaves the connection congested, the slow
+   * consumer hook decides its fate
+   *
+   * @return false if the message was dropped
+   * @throws SocketException if the hook says to disconnect
+   */
+  template <typename F>
+  bool offer(Channel channel, F &&write) {
+    Channel previous = sendChannel;
+    sendChannel = channel;
+    // write into a queue of its own, so it can be held back whole
+    SendQueue message;
+    std::swap(message, sendQueues[static_cast<size_t>(channel)]);
+    // a throwing write discards the partial message, not the real queue
+    util::ScopeGuard restore([this, channel, previous, &message]() {
+      std::swap(message, sendQueues[static_cast<size_t>(channel)]);
+      sendChannel = previous;
+    });
+    write(*this);
+    restore.reset();
+    return enqueue(channel, std::move(message));
+  }
+
+  /**
+   * queue a message the peer can't do without, however congested the
+   * connection is
+   *
+   * the message is written by calling write with this connection, on the
+   * given channel; the selected channel is left as it was
+   */
+  template <typename F>
+  void put(Channel channel, F &&write) {
+    Channel previous = sendChannel;
+    sendChannel = channel;
+    util::ScopeGuard restore([this, previous]() { sendChannel = previous; });
+    write(*this);
+  }
+
+  /**
+   * send whatever the transport will take without blocking
+   *
+   * a server tick calls this instead of flush, so one slow peer can't stall
+   * it
+   */
+  Pressure trySend();
+
+  /**
+   * send what the transport takes right now and discard the rest, so
+   * destroying this connection never blocks
+   *
+   * for tearing down peers that may have stopped reading; a graceful
+   * shutdown leaves the destructor to flush everything
+   */
+  void abandon() noexcept;
+
+  /** select the channel that following writes are queued on */
+  Connection &operator<<(Channel channel);
+  /** select the channel that following reads come from */
+  Connection &operator>>(Channel channel);
+
   Connection &flush();
 
   static std::unique_ptr<Connection> makeClient(std::string const &host,
                                                 uint16_t port,
                                                 std::atomic_bool const &stop);
 
-  bool handshake(std::string const &password);
+  /**
+   * client side of the handshake
+   *
+   * resumes using the ticket if one is given and the server accepts it, and
+   * otherwise does the full password handshake; on success, ticket is
+   * replaced with a fresh ticket for the next connection
+   *
+   * both ends send their salts up front and then exchange one flight of key
+   * confirmations, so the handshake takes about one round trip plus one key
+   * derivation
+   *
+   * @return false if the password was wrong
+   */
+  bool handshake(std::string const &password, std::optional<Ticket> &ticket);
+
+  /**
+   * client side of the handshake, asking for a room on a server hosting
+   * several
+   *
+   * the room name is sent in the clear, but covered by the key confirmation
+   */
+  bool handshake(std::string const &room, std::string const &password,
+                 std::optional<Ticket> &ticket);
+
+  /**
+   * server side of the handshake
+   *
+   * accepts resumption tickets sealed by ticketKey, and issues a fresh one
+   */
+  bool handshake(std::string const &password, TicketKey const &ticketKey);
+
+  /**
+   * server side of the handshake, for a server hosting several rooms
+   *
+   * a room lookup finds nothing for is handshaken against a random password,
+   * so to the client an unknown room looks like a wrong password
+   *
+   * @return the room the client joined, or nothing if the password was wrong
+   * @throws SocketException if the client takes longer than the handshake
+   * timeout
+   */
+  std::optional<std::string> handshake(
+      std::function<std::optional<Credentials>(std::string const &room)> const
+          &lookup);
+
+  /**
+   * set how long the server side of the handshake may take in all, so a
+   * client trickling bytes can't hold on to the thread running it
+   */
+  void setHandshakeTimeout(std::chrono::milliseconds timeout) noexcept;
+
+  /** counters so far - safe to call while another thread uses the connection */
+  Statistics getStatistics() noexcept;
+
+  /** keys for a datagram session alongside this connection */
+  DatagramKeys const &getDatagramKeys() const noexcept;
+
+  /**
+   * whether the peer has hung up - a SocketException once this is set is the
+   * session ending, not an error
+   */
+  bool isClosedByPeer() const noexcept;
+
+  /** reactor that read and drain suspend on */
+  void setReactor(Reactor &reactor) noexcept;
+
+  /**
+   * awaitable read - suspends the session, not the thread, until the whole
+   * value has arrived
+   *
+   * @throws FormatException, SocketException as operator>> does
+   */
+  template <typename T>
+  Task<T> read() {
+    T data;
+    while (!tryRead(data))
+      co_await reactor->ready(*this, Reactor::Direction::READ);
+    co_return data;
+  }
+
+  /** awaitable write - writes only queue data, so this never suspends */
+  template <typename T>
+  Task<void> write(T data) {
+    *this << std::move(data);
+    co_return;
+  }
+
+  /** awaitable flush - suspends the session until everything is sent */
+  Task<void> drain();
 
  protected:
+  /**
+   * send anything still queued, ignoring errors - for implementations'
+   * destructors, since sendRaw can't be called from this one
+   */
+  void flushQuietly() noexcept;
+
+  /**
+   * for implementations to throw when operation finds the peer has hung up
+   */
+  util::exceptions::SocketException closedByPeer(
+      std::string const &operation);
+
+  /**
+   * blocking transfers - implementations call checkDeadline while they wait
+   */
   virtual void sendRaw(void const *data, size_t length) = 0;
   virtual void recvRaw(void *data, size_t length) = 0;
+  /** @throws SocketException if a handshake has run out of time */
+  void checkDeadline() const;
+
+  /**
+   * send as much as can be sent without blocking
+   *
+   * @return bytes sent - zero if the transport is full
+   */
+  virtual size_t trySendRaw(void const *data, size_t length) = 0;
+  /**
+   * receive whatever has already arrived, up to length
+   *
+   * @return bytes received - zero if nothing has arrived
+   * @throws SocketException if the peer has closed the connection
+   */
+  virtual size_t tryRecvRaw(void *data, size_t length) = 0;
+
+  /** transport's own round trip time estimate, if it has one */
+  virtual std::optional<std::chrono::microseconds> rtt() noexcept;
 
  private:
-  std::list<uint8_t> sendBuf;
-  std::list<uint8_t> recvBuf;
+  /** record layer negotiated during the handshake */
+  enum class Cipher {
+    XCHACHA20POLY1305,
+    AES256GCM,
+  };
+
+  /** updated by the connection's thread, read by anyone */
+  struct Counters final {
+    std::atomic<uint64_t> bytesSent = 0;
+    std::atomic<uint64_t> bytesReceived = 0;
+    std::atomic<uint64_t> framesSent = 0;
+    std::atomic<uint64_t> framesReceived = 0;
+    std::atomic<uint64_t> paddingSent = 0;
+    std::atomic<uint64_t> encryptNanos = 0;
+    std::atomic<uint64_t> decryptNanos = 0;
+    std::atomic<uint64_t> sendBlockedNanos = 0;
+    std::atomic<uint64_t> recvBlockedNanos = 0;
+    std::atomic<uint64_t> sendQueued = 0;
+    std::atomic<uint64_t> recvBuffered = 0;
+    std::atomic<uint64_t> messagesDropped = 0;
+  };
+
+  /** received bytes, read from pos onwards */
+  struct RecvBuffer final {
+    std::vector<uint8_t> data;
+    size_t pos = 0;
+    /** where the read in progress started, to rewind to if it would block */
+    size_t start = 0;
+  };
+
+  /** thrown by wait when a non-blocking read runs out of data */
+  struct WouldBlock final {};
+
+  /**
+   * bytes queued on a channel: shared messages, then the connection's own
+   * writes
+   */
+  struct SendQueue final {
+    /** queued messages; the first is sent up to pos */
+    std::deque<Message> messages;
+    size_t pos = 0;
+    /** unsent bytes in messages */
+    size_t messageBytes = 0;
+    /** bytes written since the last queued message, sent from tailPos */
+    std::vector<uint8_t> tail;
+    size_t tailPos = 0;
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    /** queue a message after everything already queued */
+    void push(Message message);
+    /** move everything queued on other to the end of this queue */
+    void append(SendQueue &&other);
+    /** copy out and dequeue up to n bytes; returns how many */
+    size_t take(unsigned char *out, size_t n) noexcept;
+  };
+
+  std::array<SendQueue, NUM_CHANNELS> sendQueues;
+  std::array<RecvBuffer, NUM_CHANNELS> recvBufs;
+  Channel sendChannel = Channel::DEFAULT;
+  Channel recvChannel = Channel::DEFAULT;
+  size_t maxMessageSize = DEFAULT_MAX_MESSAGE_SIZE;
+  std::chrono::milliseconds handshakeTimeout = DEFAULT_HANDSHAKE_TIMEOUT;
+  /** when the handshake in progress is abandoned - none outside one */
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  Cipher cipher = Cipher::XCHACHA20POLY1305;
 
   crypto_secretstream_xchacha20poly1305_state sendState;
   crypto_secretstream_xchacha20poly1305_state recvState;
 
+  crypto_aead_aes256gcm_state sendAesState;
+  crypto_aead_aes256gcm_state recvAesState;
+  uint64_t sendCounter = 0;
+  uint64_t recvCounter = 0;
+
+  DatagramKeys datagramKeys;
+
+  Counters counters;
+
+  size_t highWatermark = DEFAULT_HIGH_WATERMARK;
+  size_t lowWatermark = DEFAULT_LOW_WATERMARK;
+  bool congested = false;
+  SlowConsumerHook slowConsumerHook;
+  /** offered messages held back while congested, at most one per channel */
+  std::array<SendQueue, NUM_CHANNELS> heldBack;
+
+  Reactor *reactor = nullptr;
+  bool peerClosed = false;
+  bool nonblocking = false;
+  /** partly received frame, for non-blocking reads */
+  std::vector<uint8_t> inbox;
+  size_t inboxFill = 0;
+  /** partly sent frame, for non-blocking writes */
+  std::vector<uint8_t> outbox;
+  size_t outboxPos = 0;
+
+  size_t plaintextSize() const noexcept;
+
+  std::vector<uint8_t> &sendBuf() noexcept;
+  RecvBuffer &recvBuf() noexcept;
+
   void send();
   void recv();
 
+  /** encrypt the next frame into ciphertext; false if nothing is queued */
+  bool seal(unsigned char *ciphertext);
+  void open(unsigned char const *ciphertext);
+  /** receive without blocking; true if a whole frame was opened */
+  bool pump();
+  /** finish sending a partly sent frame, blocking */
+  void finishOutbox();
+
+  /** queue an offered message, unless that would congest the connection */
+  bool enqueue(Channel channel, SendQueue message);
+  /** pressure if depth bytes were queued */
+  Pressure pressure(size_t depth) noexcept;
+  /** apply the slow consumer hook to an offered message */
+  bool overloaded(Channel channel, SendQueue message);
+  /** queue held back messages once no longer congested */
+  void releaseHeldBack();
+
+  /** read without blocking; false, and nothing consumed, if it would block */
+  template <typename T>
+  bool tryRead(T &data) {
+    nonblocking = true;
+    try {
+      *this >> data;
+      nonblocking = false;
+      return true;
+    } catch (WouldBlock const &) {
+      nonblocking = false;
+      recvBuf().pos = recvBuf().start;
+      return false;
+    } catch (...) {
+      nonblocking = false;
+      throw;
+    }
+  }
+
+  void sendTimed(void const *data, size_t length);
+  void recvTimed(void *data, size_t length);
+  uint64_t queuedBytes() const noexcept;
+  uint64_t bufferedBytes() const noexcept;
+
   void wait(size_t n);
+  void expect(uint8_t type, char const *message);
+  uint8_t const *take(size_t n);
+  uint64_t takeUnsigned(size_t n);
+  uint64_t takeLength(size_t elementSize);
+
+  void exportDatagramKeys(unsigned char const *sendKey,
+                          unsigned char const *recvKey,
+                          unsigned char const *clientKey);
+  void startRecordLayer(uint8_t capabilities, unsigned char const *sendKey,
+                        unsigned char const *recvKey);
+  void appendConfirmation(
+      std::vector<unsigned char> &flight, unsigned char const *sendKey,
+      std::array<unsigned char, crypto_generichash_BYTES> const &transcript);
+  bool checkConfirmation(
+      unsigned char const *recvKey,
+      std::array<unsigned char, crypto_generichash_BYTES> const &transcript);
 };
 
 class Server {
@@ -110,11 +656,67 @@ class Server {
   Server &operator=(Server const &) noexcept = delete;
   Server &operator=(Server &&) noexcept = default;
 
+  /**
+   * accept a pending connection, waiting briefly for one
+   *
+   * @return nullptr if none arrived in time
+   */
   virtual std::unique_ptr<Connection> accept() = 0;
 
+  /** the port listened on - the one picked, if asked for port 0 */
+  virtual uint16_t getPort() const noexcept = 0;
+
   static std::unique_ptr<Server> makeServer(uint16_t port,
                                             std::string const &password,
                                             std::atomic_bool const &stop);
+  /**
+   * make count listeners sharing one port, to accept on as many threads
+   *
+   * the kernel spreads incoming connections between them; given port 0,
+   * they share whichever port the first is given
+   */
+  static std::vector<std::unique_ptr<Server>> makeServers(
+      uint16_t port, size_t count, std::string const &password,
+      std::atomic_bool const &stop);
+};
+
+/**
+ * where connections and datagram sockets come from - the operating system,
+ * or a simulation of it
+ */
+class Network {
+ public:
+  Network() noexcept = default;
+  Network(Network const &) noexcept = delete;
+  Network(Network &&) noexcept = delete;
+
+  virtual ~Network() noexcept = default;
+
+  Network &operator=(Network const &) noexcept = delete;
+  Network &operator=(Network &&) noexcept = delete;
+
+  virtual std::unique_ptr<Connection> connect(std::string const &host,
+                                              uint16_t port,
+                                              std::atomic_bool const &stop) = 0;
+  virtual std::unique_ptr<Server> listen(uint16_t port,
+                                         std::string const &password,
+                                         std::atomic_bool const &stop) = 0;
+  /**
+   * listen on a port with count listeners, to accept on as many threads
+   *
+   * networks that can't share a port return a single listener
+   */
+  virtual std::vector<std::unique_ptr<Server>> listenShared(
+      uint16_t port, size_t count, std::string const &password,
+      std::atomic_bool const &stop);
+  virtual std::unique_ptr<DatagramSocket> connectDatagrams(
+      std::string const &host, uint16_t port) = 0;
+  virtual std::unique_ptr<DatagramSocket> listenDatagrams(uint16_t port) = 0;
+  /** a reactor that can watch this network's connections */
+  virtual std::unique_ptr<Reactor> makeReactor(util::ThreadPool &workers);
+
+  /** the operating system's sockets */
+  static Network &system() noexcept;
 };
 }  // namespace airewar::game::networking
 
@@ -0,0 +1,153 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/reactor.h"
+
+#include <memory>
+#include <utility>
+
+#ifdef __linux__
+#include "game/networking/linux/reactor.h"
+#elif
+#error "operating system not supported/recognized"
+#endif
+
+using namespace std;
+
+namespace airewar::game::networking {
+Reactor::Reactor(util::ThreadPool &workers) noexcept
+    : postedMutex(),
+      postedTasks(),
+      postedHandles(),
+      workers(workers),
+      offloadMutex(),
+      offloadDone(),
+      offloads(0),
+      tasks(),
+      numTasks(0) {}
+
+Reactor::~Reactor() noexcept { waitForOffloads(); }
+
+void Reactor::spawn(Task<void> task) {
+  {
+    scoped_lock lock(postedMutex);
+    postedTasks.push_back(move(task));
+  }
+  ++numTasks;
+  wake();
+}
+
+void Reactor::run(atomic_bool const &stop) {
+  while (!stop) poll(POLL_TIMEOUT);
+}
+
+void Reactor::poll(chrono::milliseconds timeout) {
+  bool posted;
+  {
+    scoped_lock lock(postedMutex);
+    posted = !postedTasks.empty() || !postedHandles.empty();
+  }
+  vector<coroutine_handle<>> ready =
+      wait(posted ? chrono::milliseconds(0) : timeout);
+
+  vector<Task<void>> newTasks;
+  {
+    scoped_lock lock(postedMutex);
+    swap(newTasks, postedTasks);
+    ready.insert(ready.end(), postedHandles.begin(), postedHandles.end());
+    postedHandles.clear();
+  }
+
+  for (Task<void> &task : newTasks) {
+    tasks.push_back(move(task));
+    tasks.back().start();
+  }
+  for (coroutine_handle<> handle : ready) handle.resume();
+
+  for (auto task = tasks.begin(); task != tasks.end();) {
+    if (!task->done()) {
+      ++task;
+      continue;
+    }
+
+    Task<void> finished = move(*task);
+    task = tasks.erase(task);
+    --numTasks;
+    finished.check();
+  }
+}
+
+void Reactor::resume(coroutine_handle<> handle) {
+  {
+    scoped_lock lock(postedMutex);
+    postedHandles.push_back(handle);
+  }
+  wake();
+}
+
+size_t Reactor::size() const noexcept { return numTasks; }
+
+void Reactor::waitForOffloads() noexcept {
+  unique_lock lock(offloadMutex);
+  offloadDone.wait(lock, [this]() { return offloads == 0; });
+}
+
+void Reactor::beginOffload() noexcept {
+  scoped_lock lock(offloadMutex);
+  ++offloads;
+}
+
+void Reactor::endOffload(coroutine_handle<> handle) noexcept {
+  resume(handle);
+
+  // the reactor may be destroyed as soon as this is released
+  scoped_lock lock(offloadMutex);
+  --offloads;
+  offloadDone.notify_all();
+}
+
+Gate::Gate() noexcept : mutex(), opened(false), waiting() {}
+
+void Gate::open() {
+  scoped_lock lock(mutex);
+  opened = true;
+  for (auto [reactor, handle] : waiting) reactor->resume(handle);
+  waiting.clear();
+}
+
+bool Gate::isOpen() noexcept {
+  scoped_lock lock(mutex);
+  return opened;
+}
+
+bool Gate::enqueue(Reactor &reactor, coroutine_handle<> handle) {
+  scoped_lock lock(mutex);
+  if (opened) return false;
+  waiting.emplace_back(&reactor, handle);
+  return true;
+}
+
+#ifdef __linux__
+unique_ptr<Reactor> Reactor::makeReactor(util::ThreadPool &workers) {
+  return make_unique<linux::Reactor>(workers);
+}
+#elif
+#error "operating system not supported/recognized"
+#endif
+}  // namespace airewar::game::networking
@@ -0,0 +1,230 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_REACTOR_H_
+#define AIREWAR_GAME_NETWORKING_REACTOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "game/networking/task.h"
+#include "util/threadPool.h"
+
+namespace airewar::game::networking {
+class Connection;
+
+/**
+ * runs many coroutine sessions on one thread, resuming each when its
+ * connection can make progress
+ *
+ * everything but spawn must be called from the thread running the reactor
+ */
+class Reactor {
+ public:
+  enum class Direction {
+    READ,
+    WRITE,
+  };
+
+  /** longest a reactor sleeps before checking its stop flag */
+  static constexpr std::chrono::milliseconds POLL_TIMEOUT =
+      std::chrono::milliseconds(50);
+
+  /** @param workers where offloaded work runs - must outlive the reactor */
+  explicit Reactor(util::ThreadPool &workers) noexcept;
+  Reactor(Reactor const &) noexcept = delete;
+  Reactor(Reactor &&) noexcept = delete;
+
+  /** waits for offloaded work, then destroys any unfinished sessions */
+  virtual ~Reactor() noexcept;
+
+  Reactor &operator=(Reactor const &) noexcept = delete;
+  Reactor &operator=(Reactor &&) noexcept = delete;
+
+  /** start a session on the reactor's thread; may be called from any thread */
+  void spawn(Task<void> task);
+
+  /**
+   * resume a session suspended on this reactor, on the reactor's thread; may
+   * be called from any thread
+   */
+  void resume(std::coroutine_handle<> handle);
+
+  /**
+   * resume sessions as they become ready, until stop is set
+   *
+   * @throws whatever escapes a session
+   */
+  void run(std::atomic_bool const &stop);
+
+  /** wait up to timeout for ready sessions, and resume them */
+  void poll(std::chrono::milliseconds timeout);
+
+  /** sessions that haven't finished yet */
+  size_t size() const noexcept;
+
+  /** suspend until the connection can be read from or written to */
+  auto ready(Connection &connection, Direction direction) noexcept {
+    struct Awaiter final {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        reactor.watch(connection, direction, handle);
+      }
+      void await_resume() noexcept {}
+
+      Reactor &reactor;
+      Connection &connection;
+      Direction direction;
+    };
+    return Awaiter{*this, connection, direction};
+  }
+
+  /**
+   * run blocking work (key derivation, the handshake) on the worker pool,
+   * resuming the awaiting session here once it's done
+   */
+  template <typename F>
+  auto offload(F work) {
+    using Result = std::invoke_result_t<F>;
+    struct Awaiter final {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        reactor.beginOffload();
+        reactor.workers.post([this, handle]() {
+          try {
+            result.emplace(work());
+          } catch (...) {
+            exception = std::current_exception();
+          }
+          reactor.endOffload(handle);
+        });
+      }
+      Result await_resume() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*result);
+      }
+
+      Reactor &reactor;
+      F work;
+      std::optional<Result> result;
+      std::exception_ptr exception;
+    };
+    return Awaiter{*this, std::move(work), std::nullopt, nullptr};
+  }
+
+  static std::unique_ptr<Reactor> makeReactor(util::ThreadPool &workers);
+
+ protected:
+  /** resume handle once the connection is ready in that direction */
+  virtual void watch(Connection &connection, Direction direction,
+                     std::coroutine_handle<> handle) = 0;
+
+  /**
+   * wait up to timeout for connections to become ready
+   *
+   * @return the handles to resume
+   */
+  virtual std::vector<std::coroutine_handle<>> wait(
+      std::chrono::milliseconds timeout) = 0;
+
+  /** make a wait in progress on the reactor's thread return early */
+  virtual void wake() noexcept = 0;
+
+  /**
+   * block until no offloaded work is running - implementations call this
+   * first thing in their destructors, since finishing work calls wake
+   */
+  void waitForOffloads() noexcept;
+
+ private:
+  /** sessions and resumptions handed over from other threads */
+  std::mutex postedMutex;
+  std::vector<Task<void>> postedTasks;
+  std::vector<std::coroutine_handle<>> postedHandles;
+
+  util::ThreadPool &workers;
+  std::mutex offloadMutex;
+  std::condition_variable offloadDone;
+  size_t offloads;
+
+  std::list<Task<void>> tasks;
+  std::atomic<size_t> numTasks;
+
+  void beginOffload() noexcept;
+  void endOffload(std::coroutine_handle<> handle) noexcept;
+};
+
+/**
+ * a one-shot signal sessions on any reactor can wait for
+ *
+ * opening it resumes each waiting session on its own reactor, so the gate
+ * must be opened before those reactors go away, or not at all
+ */
+class Gate final {
+ public:
+  Gate() noexcept;
+  Gate(Gate const &) noexcept = delete;
+  Gate(Gate &&) noexcept = delete;
+
+  ~Gate() noexcept = default;
+
+  Gate &operator=(Gate const &) noexcept = delete;
+  Gate &operator=(Gate &&) noexcept = delete;
+
+  /** let waiting and later sessions through; may be called from any thread */
+  void open();
+  bool isOpen() noexcept;
+
+  /** suspend until the gate is open, resuming on reactor */
+  auto wait(Reactor &reactor) noexcept {
+    struct Awaiter final {
+      bool await_ready() noexcept { return gate.isOpen(); }
+      bool await_suspend(std::coroutine_handle<> handle) {
+        return gate.enqueue(reactor, handle);
+      }
+      void await_resume() noexcept {}
+
+      Gate &gate;
+      Reactor &reactor;
+    };
+    return Awaiter{*this, reactor};
+  }
+
+ private:
+  std::mutex mutex;
+  bool opened;
+  std::vector<std::pair<Reactor *, std::coroutine_handle<>>> waiting;
+
+  /** @return false if the gate opened first, so there's no need to suspend */
+  bool enqueue(Reactor &reactor, std::coroutine_handle<> handle);
+};
+}  // namespace airewar::game::networking
+
+#endif  // AIREWAR_GAME_NETWORKING_REACTOR_H_
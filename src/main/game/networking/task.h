@@ -0,0 +1,137 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_NETWORKING_TASK_H_
+#define AIREWAR_GAME_NETWORKING_TASK_H_
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace airewar::game::networking {
+/**
+ * a lazily started coroutine, producing a T
+ *
+ * awaiting a task runs it, and resumes the awaiter when it finishes;
+ * exceptions thrown inside are rethrown to the awaiter
+ */
+template <typename T = void>
+class [[nodiscard]] Task final {
+ private:
+  struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct FinalAwaiter final {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<>) noexcept {
+          return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+
+        std::coroutine_handle<> continuation;
+      };
+      return FinalAwaiter{continuation};
+    }
+    void unhandled_exception() noexcept {
+      exception = std::current_exception();
+    }
+  };
+
+  struct ValuePromise : PromiseBase {
+    std::optional<T> value;
+
+    Task get_return_object() noexcept {
+      return Task(std::coroutine_handle<promise_type>::from_promise(
+          static_cast<promise_type &>(*this)));
+    }
+    void return_value(T data) { value = std::move(data); }
+  };
+
+  struct VoidPromise : PromiseBase {
+    Task get_return_object() noexcept {
+      return Task(std::coroutine_handle<promise_type>::from_promise(
+          static_cast<promise_type &>(*this)));
+    }
+    void return_void() noexcept {}
+  };
+
+ public:
+  struct promise_type final
+      : std::conditional_t<std::is_void_v<T>, VoidPromise, ValuePromise> {};
+
+  Task() noexcept : handle() {}
+  Task(Task const &) noexcept = delete;
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+  ~Task() noexcept {
+    if (handle) handle.destroy();
+  }
+
+  Task &operator=(Task const &) noexcept = delete;
+  Task &operator=(Task &&other) noexcept {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+
+  bool done() const noexcept { return !handle || handle.done(); }
+
+  /** run until the first suspension, with nobody waiting on the result */
+  void start() { handle.resume(); }
+
+  /** rethrow anything that escaped a finished task */
+  void check() const {
+    if (handle && handle.promise().exception)
+      std::rethrow_exception(handle.promise().exception);
+  }
+
+  auto operator co_await() noexcept {
+    struct Awaiter final {
+      bool await_ready() noexcept { return handle.done(); }
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+      T await_resume() {
+        if (handle.promise().exception)
+          std::rethrow_exception(handle.promise().exception);
+        if constexpr (!std::is_void_v<T>)
+          return std::move(*handle.promise().value);
+      }
+
+      std::coroutine_handle<promise_type> handle;
+    };
+    return Awaiter{handle};
+  }
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Task(std::coroutine_handle<promise_type> handle_) noexcept
+      : handle(handle_) {}
+};
+}  // namespace airewar::game::networking
+
+#endif  // AIREWAR_GAME_NETWORKING_TASK_H_
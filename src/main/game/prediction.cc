@@ -0,0 +1,107 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/prediction.h"
+
+#include <cmath>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+using namespace std;
+using namespace glm;
+
+namespace airewar::game {
+namespace {
+/** prediction errors below this are quantization, not misprediction */
+constexpr float POSITION_TOLERANCE =
+    static_cast<float>(QuantizedState::POSITION_PRECISION) + 1.0f;
+constexpr float HEADING_TOLERANCE = 0.01f;
+constexpr float SPEED_TOLERANCE = 0.1f;
+
+/** is sequence number a after b, allowing for wraparound? */
+bool after(uint32_t a, uint32_t b) noexcept {
+  return static_cast<int32_t>(a - b) > 0;
+}
+
+bool close(EntityState const &a, EntityState const &b) noexcept {
+  float headingError = abs(remainder(a.heading - b.heading, two_pi<float>()));
+  return length(a.position - b.position) <= POSITION_TOLERANCE &&
+         headingError <= HEADING_TOLERANCE &&
+         abs(a.speed - b.speed) <= SPEED_TOLERANCE;
+}
+}  // namespace
+
+Predictor::Predictor(EntityState const &initial) noexcept
+    : history(),
+      predicted(initial),
+      nextSequence(0),
+      reconciled(),
+      correction(0.0f) {}
+
+Input Predictor::apply(Input input, float dt) noexcept {
+  input.sequence = nextSequence++;
+  predicted = simulate(predicted, input, dt);
+  history.push_back(Entry{input, dt, predicted});
+  return input;
+}
+
+void Predictor::reconcile(uint32_t acked,
+                          EntityState const &authoritative) noexcept {
+  // a stale or reordered ack would rewind the prediction
+  if (reconciled && !after(acked, *reconciled)) return;
+  reconciled = acked;
+
+  // forget inputs the server has applied, remembering what we predicted
+  bool matched = false;
+  while (!history.empty() && !after(history.front().input.sequence, acked)) {
+    if (history.front().input.sequence == acked)
+      matched = close(history.front().after, authoritative);
+    history.pop_front();
+  }
+
+  // the inputs right after acked were overwritten - replaying the rest from
+  // the server's state would skip them, so start over from it instead
+  if (!history.empty() && history.front().input.sequence != acked + 1) {
+    history.clear();
+    correction = length(authoritative.position - predicted.position);
+    predicted = authoritative;
+    return;
+  }
+
+  // a right prediction stays as it is
+  if (matched) {
+    correction = 0.0f;
+    return;
+  }
+
+  EntityState replayed = authoritative;
+  for (size_t cnt = 0; cnt < history.size(); ++cnt) {
+    Entry &entry = history[cnt];
+    replayed = simulate(replayed, entry.input, entry.dt);
+    entry.after = replayed;
+  }
+  correction = length(replayed.position - predicted.position);
+  predicted = replayed;
+}
+
+EntityState const &Predictor::state() const noexcept { return predicted; }
+
+float Predictor::lastCorrection() const noexcept { return correction; }
+}  // namespace airewar::game
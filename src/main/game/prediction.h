@@ -0,0 +1,90 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_PREDICTION_H_
+#define AIREWAR_GAME_PREDICTION_H_
+
+#include <cstdint>
+#include <optional>
+
+#include "game/movement.h"
+#include "game/snapshot.h"
+#include "util/ringBuffer.h"
+
+namespace airewar::game {
+/**
+ * predicts the local player's entity, so controls respond without waiting a
+ * round trip for the server
+ *
+ * inputs apply immediately to a predicted state; when the server's
+ * authoritative state arrives, the prediction rewinds to it and replays the
+ * inputs the server hadn't applied yet
+ */
+class Predictor final {
+ public:
+  /** unacknowledged inputs kept for replay (~2 s at 60 Hz) */
+  static constexpr size_t HISTORY_SIZE = 128;
+
+  explicit Predictor(EntityState const &initial) noexcept;
+  Predictor(Predictor const &) noexcept = default;
+  Predictor(Predictor &&) noexcept = default;
+
+  ~Predictor() noexcept = default;
+
+  Predictor &operator=(Predictor const &) noexcept = default;
+  Predictor &operator=(Predictor &&) noexcept = default;
+
+  /**
+   * apply a tick of input to the prediction
+   *
+   * @return the input, numbered - send this to the server
+   */
+  Input apply(Input input, float dt) noexcept;
+
+  /**
+   * correct the prediction with the server's state after it applied input
+   * acked
+   *
+   * acks no newer than the last one are ignored; one so far behind that the
+   * inputs after it are gone snaps the prediction to the server's state
+   */
+  void reconcile(uint32_t acked, EntityState const &authoritative) noexcept;
+
+  EntityState const &state() const noexcept;
+  /** how far the last reconciliation moved the prediction, in meters */
+  float lastCorrection() const noexcept;
+
+ private:
+  struct Entry final {
+    Input input;
+    float dt;
+    /** predicted state after the input */
+    EntityState after;
+  };
+
+  util::RingBuffer<Entry, HISTORY_SIZE> history;
+  EntityState predicted;
+  uint32_t nextSequence = 0;
+  /** the newest input reconciled against, if any */
+  std::optional<uint32_t> reconciled;
+  float correction = 0.0f;
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_PREDICTION_H_
@@ -0,0 +1,36 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_ROLE_H_
+#define AIREWAR_GAME_ROLE_H_
+
+#include <cstdint>
+
+namespace airewar::game {
+/** what a server let a client join as, sent once the handshake is done */
+enum class Role : uint8_t {
+  /** the match is full */
+  NONE,
+  PLAYER,
+  /** sees the match, but doesn't play in it */
+  SPECTATOR,
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_ROLE_H_
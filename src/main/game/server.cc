@@ -20,108 +20,289 @@
 #include "game/server.h"
 
 #include <algorithm>
+#include <chrono>
 #include <codecvt>
+#include <iostream>
 #include <locale>
 #include <utility>
 
-#include "options.h"
 #include "sodium.h"
+#include "util/exceptions/formatException.h"
 #include "util/exceptions/socketException.h"
 #include "util/exceptions/stopFlag.h"
+#include "util/scopeGuard.h"
 
 using namespace std;
+using namespace airewar::util;
 using namespace airewar::util::exceptions;
 using namespace airewar::game::networking;
 
 namespace airewar::game {
-Server::Connection::Connection(
-    Server &server, std::unique_ptr<networking::Connection> socket) noexcept
+namespace {
+/** listeners take no password - each room's is checked in the handshake */
+string const LISTENER_PASSWORD;
+
+/** a server's only room, when it isn't hosting several */
+vector<RoomSettings> defaultRoom(u32string const &password) {
+  RoomSettings room;
+  room.password = password;
+  return {room};
+}
+
+/** what a room's password becomes on the wire */
+string toBytes(u32string const &password) {
+  wstring_convert<codecvt_utf8<char32_t>, char32_t> converter;
+  return converter.to_bytes(password);
+}
+
+/** total sessions every room together may hold */
+size_t capacityOf(Server::Rooms const &rooms) noexcept {
+  size_t capacity = 0;
+  for (auto const &[name, room] : rooms)
+    capacity += room.settings.players + room.settings.spectators;
+  return capacity;
+}
+
+/** take one of limit slots, unless they're all taken */
+bool claim(atomic<size_t> &taken, size_t limit) noexcept {
+  size_t current = taken.load();
+  do {
+    if (current >= limit) return false;
+  } while (!taken.compare_exchange_weak(current, current + 1));
+  return true;
+}
+}  // namespace
+
+RoomSettings RoomSettings::clamped() const {
+  RoomSettings result = *this;
+  if (result.name.length() > MAX_ROOM_LENGTH)
+    result.name.resize(MAX_ROOM_LENGTH);
+  result.players = clamp(players, 1U, MAX_PLAYERS);
+  result.spectators = min(spectators, MAX_SPECTATORS);
+  return result;
+}
+
+ServerSettings ServerSettings::clamped() const noexcept {
+  ServerSettings result = *this;
+  result.tickRate = clamp(tickRate, 1U, MAX_TICK_RATE);
+  return result;
+}
+
+Server::Room::Room(RoomSettings const &settings, uint64_t seed)
+    : settings(settings),
+      password(toBytes(settings.password)),
+      ticketKey(),
+      seed(seed),
+      map(),
+      mapReady(),
+      players(0),
+      spectators(0) {}
+
+Server::Connection::Connection(Server &server, Reactor &reactor,
+                               unique_ptr<networking::Connection> socket)
     : state(State::STARTING),
       server(server),
+      reactor(reactor),
       connection(move(socket)),
-      thread([this]() { return run(); }) {}
+      datagram(),
+      clock(),
+      room(nullptr) {
+  connection->setReactor(reactor);
+  reactor.spawn(run());
+}
+
+Server::Connection::~Connection() {
+  if (datagram) server.datagrams->detach(*datagram);
+  // sessions drain what they must send; a reaped peer may have stopped
+  // reading, and flushing to it would hold a teardown thread indefinitely
+  if (connection) connection->abandon();
+}
 
-Server::Connection::~Connection() { thread.join(); }
+Statistics Server::Connection::getStatistics() noexcept {
+  return connection->getStatistics();
+}
 
-void Server::Connection::run() noexcept {
+Task<void> Server::Connection::run() {
+  // the server may reap this connection as soon as state is DONE, so setting
+  // it is the last thing a session does
   try {
-    if (!connection->handshake(server.password)) {
-      // incorrect password - kill connection
+    // the handshake is mostly key derivation - keep it off the reactor
+    optional<string> joined = co_await reactor.offload([this]() {
+      return connection->handshake(
+          [&rooms = server.rooms](string const &name) -> optional<Credentials> {
+            auto found = rooms.find(name);
+            if (found == rooms.end()) return nullopt;
+            return Credentials{found->second.password,
+                               found->second.ticketKey};
+          });
+    });
+    if (!joined) {
+      // incorrect password or no such room - kill connection
       state = State::DONE;
-      return;
+      co_return;
     }
+    room = &server.rooms.find(*joined)->second;
 
-    {
-      // check for number of players
-      scoped_lock lock(server.connectionMutex);
-      if (count_if(server.connections.begin(), server.connections.end(),
-                   [](Connection const &connection) {
-                     return connection.state == State::RUNNING;
-                   }) >= NUM_PLAYERS) {
-        // too many players
-        *connection << false;
-        connection->flush();
-        state = State::DONE;
-        return;
-      } else {
-        *connection << true;
-        connection->flush();
-        state = State::RUNNING;
-      }
+    datagram = make_unique<Datagram>(connection->getDatagramKeys());
+    server.datagrams->attach(*datagram);
+
+    // a slot is given back when the session ends, however it ends
+    Role role = Role::NONE;
+    ScopeGuard slotGuard;
+    if (claim(room->players, room->settings.players)) {
+      role = Role::PLAYER;
+      slotGuard.reset([&players = room->players]() { --players; });
+    } else if (claim(room->spectators, room->settings.spectators)) {
+      role = Role::SPECTATOR;
+      slotGuard.reset([&spectators = room->spectators]() { --spectators; });
     }
+    if (role != Role::NONE) state = State::RUNNING;
 
-    *connection << server.map.getSeed();
-    connection->flush();
+    *connection << static_cast<uint8_t>(role);
+    co_await connection->drain();
+    if (role == Role::NONE) {
+      // room is full
+      state = State::DONE;
+      co_return;
+    }
+
+    // the client can start on its copy of the map while we finish ours
+    *connection << room->seed;
+    co_await connection->drain();
+    co_await room->mapReady.wait(reactor);
 
-    // TODO: rest of game logic
+    // TODO: rest of game logic - until then, just keep the clocks in sync
+    try {
+      co_await clock.serve(*connection);
+    } catch (SocketException const &) {
+      // serving only ends when the client hangs up, which isn't an error
+      if (!connection->isClosedByPeer()) throw;
+    }
+    state = State::DONE;
   } catch (SocketException const &e) {
     errorMessage = static_cast<string>(e);
     state = State::ERROR;
-    return;
+  } catch (FormatException const &e) {
+    errorMessage = e.what();
+    state = State::ERROR;
   } catch (StopFlag const &) {
-    return;
   }
 }
 
-Server::Server(u32string const &password) noexcept
+Server::Server(vector<RoomSettings> const &rooms_,
+               networking::Network &network, ServerSettings const &settings)
     : state(State::STARTING),
       errorMessage(),
-      password([&password]() {
-        wstring_convert<codecvt_utf8<char32_t>, char32_t> converter;
-        return converter.to_bytes(password);
-      }()),
+      settings(settings.clamped()),
+      network(network),
       stop(false),
       server(),
+      datagrams(),
       rng(random_device()()),
-      map(),
+      rooms([this, &rooms_]() {
+        Rooms result;
+        for (RoomSettings const &room : rooms_) {
+          RoomSettings clamped = room.clamped();
+          uint64_t seed = clamped.seed.value_or(rng());
+          result.try_emplace(clamped.name, clamped, seed);
+        }
+        return result;
+      }()),
+      connections(capacityOf(rooms) + HANDSHAKE_SLOTS,
+                  [this](unique_ptr<Connection> connection) {
+                    // teardown can block - keep it off whoever let go last
+                    teardown.post(
+                        [dead = shared_ptr<Connection>(move(connection))]() {});
+                  }),
+      reapedMutex(),
+      reaped(),
+      teardown(),
+      workers(),
+      generators(1),
+      reactors(),
+      reactorThreads(),
+      ticks(this->settings.tickRate, {[this]() { datagrams->receive(); },
+                       [](uint64_t) {
+                         // TODO: game logic
+                       },
+                       [this]() { datagrams->send(); }}),
+      tickThread(),
       thread([this]() { return run(); }) {}
 
+Server::Server(u32string const &password, networking::Network &network,
+               ServerSettings const &settings)
+    : Server(defaultRoom(password), network, settings) {}
+
 Server::~Server() {
   stop = true;
   thread.join();
+  // a map finishing later would resume sessions on reactors that are gone
+  for (auto &[name, room] : rooms)
+    if (room.map.valid()) room.map.wait();
+  if (tickThread.joinable()) tickThread.join();
+  for (std::thread &reactorThread : reactorThreads) reactorThread.join();
+}
+
+ServerSettings const &Server::getSettings() const noexcept {
+  return settings;
+}
+
+Server::Rooms const &Server::getRooms() const noexcept { return rooms; }
+
+Statistics Server::getStatistics() noexcept {
+  scoped_lock lock(reapedMutex);
+  Statistics statistics = reaped;
+  connections.forEach([&statistics](Sessions::Handle, Connection &connection) {
+    statistics += connection.getStatistics();
+  });
+  return statistics;
+}
+
+TickStatistics Server::getTickStatistics() noexcept {
+  return ticks.getStatistics();
+}
+
+void Server::dumpStatistics(ostream &out) noexcept {
+  out << "server statistics: " << getStatistics() << endl;
+  out << "tick statistics: " << getTickStatistics() << endl;
+  for (auto &[name, room] : rooms)
+    out << "room \"" << name << "\": " << room.players << "/"
+        << room.settings.players << " players, " << room.spectators << "/"
+        << room.settings.spectators << " spectators, seed " << room.seed
+        << (room.mapReady.isOpen() ? "" : " (generating)") << endl;
 }
 
 void Server::run() noexcept {
   try {
-    map.generate(rng());
+    // rooms on the same seed get the same map, generated once - and while
+    // clients are already handshaking
+    for (auto &[name, room] : rooms)
+      room.map = MapCache::shared().request(
+          room.seed, generators, [&gate = room.mapReady]() { gate.open(); });
 
-    server = networking::Server::makeServer(networking::PORT, password, stop);
+    server = network.listen(settings.port, LISTENER_PASSWORD, stop);
+    datagrams = network.listenDatagrams(settings.port);
+    size_t numReactors = clamp(workers.size() / 2, size_t{1}, MAX_REACTORS);
+    for (size_t cnt = 0; cnt < numReactors; ++cnt) {
+      reactors.push_back(network.makeReactor(workers));
+      reactorThreads.emplace_back(
+          [this, &reactor = *reactors.back()]() { reactor.run(stop); });
+    }
+    tickThread = std::thread([this]() { runTicks(); });
     state = State::RUNNING;
 
+    chrono::steady_clock::time_point lastDump = chrono::steady_clock::now();
     while (true) {
-      unique_ptr<networking::Connection> accepted = server->accept();
-      if (accepted) {
-        scoped_lock lock(connectionMutex);
-        connections.emplace_back(*this, move(accepted));
+      if (chrono::steady_clock::now() - lastDump >= STATISTICS_INTERVAL) {
+        dumpStatistics(clog);
+        lastDump = chrono::steady_clock::now();
       }
 
-      {
-        // reap dead connections
-        scoped_lock lock(connectionMutex);
-        connections.remove_if([](Connection const &c) {
-          return c.state == Connection::State::DONE;
-        });
-      }
+      unique_ptr<networking::Connection> accepted = server->accept();
+      // a full registry drops the connection - the client sees it close
+      if (accepted) connections.emplace(*this, leastLoaded(), move(accepted));
+
+      reap();
     }
   } catch (SocketException const &e) {
     errorMessage = static_cast<string>(e);
@@ -132,5 +313,38 @@ void Server::run() noexcept {
   }
 }
 
+void Server::runTicks() noexcept {
+  try {
+    ticks.run(stop);
+  } catch (SocketException const &e) {
+    errorMessage = static_cast<string>(e);
+    state = State::ERROR;
+    // nothing gets sent without the simulation - shut everything down
+    stop = true;
+  }
+}
+
+Reactor &Server::leastLoaded() noexcept {
+  return **min_element(reactors.begin(), reactors.end(),
+                       [](auto const &a, auto const &b) {
+                         return a->size() < b->size();
+                       });
+}
+
+void Server::reap() {
+  connections.forEach([this](Sessions::Handle handle, Connection &connection) {
+    Connection::State state = connection.state;
+    if (state != Connection::State::DONE && state != Connection::State::ERROR)
+      return;
+    if (!connections.erase(handle)) return;
+
+    if (state == Connection::State::ERROR)
+      clog << "connection error: " << connection.errorMessage << endl;
+    // still referenced until forEach moves on, so this is safe
+    scoped_lock lock(reapedMutex);
+    reaped += connection.getStatistics();
+  });
+}
+
 unique_ptr<Server> server;
 }  // namespace airewar::game
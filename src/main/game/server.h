@@ -21,19 +21,101 @@
 #define AIREWAR_GAME_SERVER_H_
 
 #include <atomic>
-#include <list>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <ostream>
 #include <random>
 #include <string>
 #include <thread>
+#include <vector>
 
-#include "game/map.h"
+#include "game/mapCache.h"
+#include "game/networking/clockSync.h"
+#include "game/networking/datagram.h"
 #include "game/networking/networking.h"
+#include "game/networking/reactor.h"
+#include "game/networking/task.h"
+#include "game/role.h"
+#include "game/tickLoop.h"
+#include "util/slotMap.h"
+#include "util/threadPool.h"
 
 namespace airewar::game {
+/** how one match on a server is set up - fixed once the server starts */
+struct RoomSettings final {
+  static constexpr unsigned MAX_PLAYERS = 128;
+  static constexpr unsigned MAX_SPECTATORS = 128;
+
+  /** what clients ask for to join - the default room's is empty */
+  std::string name;
+  std::u32string password;
+  unsigned players = 2;
+  /** clients let in to watch once every player slot is taken */
+  unsigned spectators = 0;
+  /** picks the map - random if not given */
+  std::optional<uint64_t> seed;
+
+  /** with each setting brought into the range the server supports */
+  RoomSettings clamped() const;
+};
+
+/** how a server is set up - fixed once it starts */
+struct ServerSettings final {
+  static constexpr unsigned MAX_TICK_RATE = 240;
+
+  /** for both the TCP listener and the datagram socket */
+  uint16_t port = networking::PORT;
+  /** simulation ticks per second, shared by every room */
+  unsigned tickRate = 30;
+
+  /** with each setting brought into the range the server supports */
+  ServerSettings clamped() const noexcept;
+};
+
+/**
+ * hosts any number of rooms on one port
+ *
+ * each room is its own match, with its own password, slots, and map, but
+ * they all share the server's sessions, workers, and simulation thread, and
+ * rooms on the same seed share one map
+ */
 class Server final {
  public:
+  /** one match on the server */
+  struct Room final {
+    RoomSettings const settings;
+    /** the password as the handshake wants it */
+    std::string const password;
+    /** tickets only resume into the room that issued them */
+    networking::TicketKey const ticketKey;
+    uint64_t const seed;
+    /** requested as the server starts, and generated while it listens */
+    std::shared_future<MapCache::Handle> map;
+    /** opened once map is generated - sessions wait here to start playing */
+    networking::Gate mapReady;
+
+    /** sessions holding a player slot */
+    std::atomic<size_t> players;
+    /** sessions holding a spectator slot */
+    std::atomic<size_t> spectators;
+
+    Room(RoomSettings const &settings, uint64_t seed);
+    Room(Room const &) noexcept = delete;
+    Room(Room &&) noexcept = delete;
+
+    ~Room() noexcept = default;
+
+    Room &operator=(Room const &) noexcept = delete;
+    Room &operator=(Room &&) noexcept = delete;
+  };
+  using Rooms = std::map<std::string, Room, std::less<>>;
+
   class Connection final {
    public:
     enum class State {
@@ -45,9 +127,9 @@ class Server final {
     std::atomic<State> state;
     std::string errorMessage;
 
-    explicit Connection(
-        Server &server,
-        std::unique_ptr<networking::Connection> connection) noexcept;
+    /** @param reactor where the session runs */
+    explicit Connection(Server &server, networking::Reactor &reactor,
+                        std::unique_ptr<networking::Connection> connection);
     Connection(Connection const &) noexcept = delete;
     Connection(Connection &&) noexcept = default;
 
@@ -56,13 +138,19 @@ class Server final {
     Connection &operator=(Connection const &) noexcept = delete;
     Connection &operator=(Connection &&) noexcept = default;
 
+    networking::Statistics getStatistics() noexcept;
+
    private:
     Server &server;
+    networking::Reactor &reactor;
     std::unique_ptr<networking::Connection> connection;
+    std::unique_ptr<networking::Datagram> datagram;
+    networking::ClockSync clock;
+    /** set once the handshake says which room the client joined */
+    Room *room;
 
-    std::thread thread;
-
-    void run() noexcept;
+    /** the session, run on the server's reactor */
+    networking::Task<void> run();
   };
 
   enum class State {
@@ -73,7 +161,14 @@ class Server final {
   std::atomic<State> state;
   std::string errorMessage;
 
-  Server(std::u32string const &password) noexcept;
+  /** rooms after the first with the same name are left out */
+  Server(std::vector<RoomSettings> const &rooms,
+         networking::Network &network = networking::Network::system(),
+         ServerSettings const &settings = ServerSettings());
+  /** a server with just the default room */
+  explicit Server(std::u32string const &password,
+                  networking::Network &network = networking::Network::system(),
+                  ServerSettings const &settings = ServerSettings());
   Server(Server const &) noexcept = delete;
   Server(Server &&) noexcept = delete;
 
@@ -82,22 +177,76 @@ class Server final {
   Server &operator=(Server const &) noexcept = delete;
   Server &operator=(Server &&) noexcept = delete;
 
- private:
-  static constexpr size_t NUM_PLAYERS = 2;
+  ServerSettings const &getSettings() const noexcept;
+  /** fixed once constructed, so safe to read from any thread */
+  Rooms const &getRooms() const noexcept;
 
-  std::string password;
+  /** totals over every connection, live or reaped */
+  networking::Statistics getStatistics() noexcept;
+  TickStatistics getTickStatistics() noexcept;
+  void dumpStatistics(std::ostream &out) noexcept;
+
+ private:
+  /**
+   * sessions allowed beyond the player and spectator slots, for ones still
+   * handshaking or being turned away
+   */
+  static constexpr size_t HANDSHAKE_SLOTS = 64;
+  /** how often statistics are written to the log */
+  static constexpr std::chrono::seconds STATISTICS_INTERVAL =
+      std::chrono::seconds(60);
+  /** most reactor threads sessions are spread over, however many there are */
+  static constexpr size_t MAX_REACTORS = 4;
+
+  ServerSettings const settings;
+  networking::Network &network;
   std::atomic_bool stop;
   std::unique_ptr<networking::Server> server;
+  std::unique_ptr<networking::DatagramSocket> datagrams;
 
   std::mt19937_64 rng;
-  Map map;
-
-  std::mutex connectionMutex;
-  std::list<Connection> connections;
+  Rooms rooms;
+
+  using Sessions = util::SlotMap<Connection>;
+
+  /** sessions in every room share one registry */
+  Sessions connections;
+  /** guards only the totals of reaped connections */
+  std::mutex reapedMutex;
+  networking::Statistics reaped;
+
+  /**
+   * destroys reaped connections, kept apart so teardown never queues behind
+   * handshakes - drained before the connections it may still be destroying
+   * go away
+   */
+  util::ThreadPool teardown;
+  /** handshakes - each gives up after the handshake timeout */
+  util::ThreadPool workers;
+  /**
+   * map generation, kept apart so handshakes never queue behind it - one
+   * thread is enough, since each generation is parallel inside
+   */
+  util::ThreadPool generators;
+  /** run every session - destroyed before the connections they use */
+  std::vector<std::unique_ptr<networking::Reactor>> reactors;
+  std::vector<std::thread> reactorThreads;
+
+  /** the simulation - owns the datagram socket once running */
+  TickLoop ticks;
+  std::thread tickThread;
 
   std::thread thread;
 
   void run() noexcept;
+  void runTicks() noexcept;
+  /** the reactor with the fewest sessions */
+  networking::Reactor &leastLoaded() noexcept;
+  /**
+   * erase finished connections - they're destroyed in the teardown pool once
+   * nothing refers to them, so the caller never waits on it
+   */
+  void reap();
 };
 
 extern std::unique_ptr<Server> server;
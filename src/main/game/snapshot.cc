@@ -0,0 +1,314 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/snapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "util/bitPacking.h"
+#include "util/exceptions/formatException.h"
+#include "util/geometry.h"
+
+using namespace std;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace airewar::game {
+namespace {
+/** a changed field that moved less than this many steps costs few bits */
+constexpr unsigned SMALL_DELTA_BITS = 10;
+
+constexpr uint32_t mask(unsigned bits) noexcept {
+  return static_cast<uint32_t>((uint64_t{1} << bits) - 1);
+}
+
+/** map value from [min, max] onto [0, steps] */
+uint32_t toFixed(double value, double min, double max, uint32_t steps) {
+  return static_cast<uint32_t>(
+      lround(clamp((value - min) / (max - min), 0.0, 1.0) * steps));
+}
+
+double fromFixed(uint32_t value, double min, double max, uint32_t steps) {
+  return min + (max - min) * value / steps;
+}
+
+/**
+ * write a field as unchanged, a small step from the baseline, or in full
+ *
+ * steps wrap around, so a longitude crossing the date line is still small
+ */
+void writeField(BitWriter &out, uint32_t value, uint32_t base, unsigned bits) {
+  out.writeBool(value != base);
+  if (value == base) return;
+
+  uint32_t step = (value - base) & mask(bits);
+  // distance either way round, as a signed step
+  bool small = step < (1u << (SMALL_DELTA_BITS - 1)) ||
+               step > mask(bits) - (1u << (SMALL_DELTA_BITS - 1));
+  out.writeBool(small);
+  if (small)
+    out.write(step, SMALL_DELTA_BITS);
+  else
+    out.write(value, bits);
+}
+
+uint32_t readField(BitReader &in, uint32_t base, unsigned bits) {
+  if (!in.readBool()) return base;
+  if (!in.readBool()) return static_cast<uint32_t>(in.read(bits));
+
+  uint32_t step = static_cast<uint32_t>(in.read(SMALL_DELTA_BITS));
+  // sign-extend
+  if ((step >> (SMALL_DELTA_BITS - 1)) != 0) step |= ~mask(SMALL_DELTA_BITS);
+  return (base + step) & mask(bits);
+}
+
+void writeState(BitWriter &out, QuantizedState const &state,
+                QuantizedState const &base) {
+  writeField(out, state.latitude, base.latitude, QuantizedState::LATITUDE_BITS);
+  writeField(out, state.longitude, base.longitude,
+             QuantizedState::LONGITUDE_BITS);
+  writeField(out, state.heading, base.heading, QuantizedState::HEADING_BITS);
+  writeField(out, state.speed, base.speed, QuantizedState::SPEED_BITS);
+}
+
+QuantizedState readState(BitReader &in, QuantizedState const &base) {
+  QuantizedState state;
+  state.latitude = readField(in, base.latitude, QuantizedState::LATITUDE_BITS);
+  state.longitude =
+      readField(in, base.longitude, QuantizedState::LONGITUDE_BITS);
+  state.heading = readField(in, base.heading, QuantizedState::HEADING_BITS);
+  state.speed = readField(in, base.speed, QuantizedState::SPEED_BITS);
+  return state;
+}
+
+/** write ascending ids as gaps from the previous one */
+void writeIds(BitWriter &out, vector<uint32_t> const &ids) {
+  out.writeVarint(ids.size());
+  uint32_t previous = 0;
+  for (uint32_t id : ids) {
+    out.writeVarint(id - previous);
+    previous = id;
+  }
+}
+}  // namespace
+
+QuantizedState QuantizedState::quantize(EntityState const &state) noexcept {
+  // in double - a float angle can't resolve POSITION_PRECISION
+  double x = state.position.x;
+  double y = state.position.y;
+  double z = state.position.z;
+  double latitude = atan2(y, sqrt(x * x + z * z));
+  double longitude = atan2(x, z);
+  double heading = fmod(static_cast<double>(state.heading),
+                        glm::two_pi<double>());
+
+  QuantizedState quantized;
+  quantized.latitude = toFixed(latitude, -glm::half_pi<double>(),
+                               glm::half_pi<double>(), mask(LATITUDE_BITS));
+  // angles wrap, so 2 pi is the same step as 0
+  quantized.longitude =
+      toFixed(longitude, -glm::pi<double>(), glm::pi<double>(),
+              mask(LONGITUDE_BITS) + 1) &
+      mask(LONGITUDE_BITS);
+  quantized.heading = toFixed(heading < 0 ? heading + glm::two_pi<double>()
+                                          : heading,
+                              0.0, glm::two_pi<double>(),
+                              mask(HEADING_BITS) + 1) &
+                      mask(HEADING_BITS);
+  quantized.speed = toFixed(state.speed, 0.0, MAX_SPEED, mask(SPEED_BITS));
+  return quantized;
+}
+
+EntityState QuantizedState::dequantize() const noexcept {
+  float lat = static_cast<float>(fromFixed(latitude, -glm::half_pi<double>(),
+                                           glm::half_pi<double>(),
+                                           mask(LATITUDE_BITS)));
+  float lon = static_cast<float>(fromFixed(longitude, -glm::pi<double>(),
+                                           glm::pi<double>(),
+                                           mask(LONGITUDE_BITS) + 1));
+  return EntityState{
+      sphericalToCartesian(lat, lon, Map::RADIUS),
+      static_cast<float>(fromFixed(heading, 0.0, glm::two_pi<double>(),
+                                   mask(HEADING_BITS) + 1)),
+      static_cast<float>(fromFixed(speed, 0.0, MAX_SPEED, mask(SPEED_BITS))),
+  };
+}
+
+SnapshotBroadcast::SnapshotBroadcast(Snapshot snapshot_) noexcept
+    : snapshot(make_shared<Snapshot const>(move(snapshot_))), encodings() {}
+
+shared_ptr<Snapshot const> const &SnapshotBroadcast::getSnapshot()
+    const noexcept {
+  return snapshot;
+}
+
+networking::Message const &SnapshotBroadcast::encoded(
+    Snapshot const *baseline) {
+  optional<uint32_t> key;
+  if (baseline) key = baseline->tick;
+  auto found = encodings.find(key);
+  if (found != encodings.end()) return found->second;
+
+  vector<uint8_t> bytes = SnapshotEncoder::delta(*snapshot, baseline);
+  networking::MessageBuilder builder;
+  builder << span<uint8_t const>(bytes);
+  return encodings.emplace(key, builder.build()).first->second;
+}
+
+size_t SnapshotBroadcast::size() const noexcept { return encodings.size(); }
+
+vector<uint8_t> SnapshotEncoder::encode(Snapshot const &snapshot) {
+  expire(snapshot.tick);
+  vector<uint8_t> encoded = delta(snapshot, baseline.get());
+  sent(make_shared<Snapshot const>(snapshot));
+  return encoded;
+}
+
+networking::Message const &SnapshotEncoder::encode(
+    SnapshotBroadcast &broadcast) {
+  expire(broadcast.getSnapshot()->tick);
+  networking::Message const &encoded = broadcast.encoded(baseline.get());
+  sent(broadcast.getSnapshot());
+  return encoded;
+}
+
+vector<uint8_t> SnapshotEncoder::delta(Snapshot const &snapshot,
+                                       Snapshot const *baseline) {
+  static Snapshot const empty;
+  Snapshot const &base = baseline ? *baseline : empty;
+
+  vector<uint32_t> removed;
+  for (auto const &[id, state] : base.entities)
+    if (!snapshot.entities.contains(id)) removed.push_back(id);
+
+  vector<uint32_t> changed;
+  for (auto const &[id, state] : snapshot.entities) {
+    auto old = base.entities.find(id);
+    if (old == base.entities.end() || old->second != state)
+      changed.push_back(id);
+  }
+
+  BitWriter out;
+  out.write(snapshot.tick, 32);
+  out.writeBool(baseline != nullptr);
+  if (baseline) out.writeVarint(snapshot.tick - baseline->tick);
+  writeIds(out, removed);
+  writeIds(out, changed);
+  for (uint32_t id : changed) {
+    auto old = base.entities.find(id);
+    writeState(out, snapshot.entities.at(id),
+               old == base.entities.end() ? QuantizedState{} : old->second);
+  }
+  return out.bytes();
+}
+
+void SnapshotEncoder::send(networking::Connection &connection,
+                           Snapshot const &snapshot) {
+  vector<uint8_t> encoded = encode(snapshot);
+  connection.offer(networking::Connection::Channel::REALTIME,
+                   [&encoded](networking::Connection &writer) {
+                     writer << span<uint8_t const>(encoded);
+                   });
+}
+
+void SnapshotEncoder::send(networking::Connection &connection,
+                           SnapshotBroadcast &broadcast) {
+  networking::Message const &encoded = encode(broadcast);
+  connection.offer(networking::Connection::Channel::REALTIME,
+                   [&encoded](networking::Connection &writer) {
+                     writer << encoded;
+                   });
+}
+
+void SnapshotEncoder::acknowledge(uint32_t tick) noexcept {
+  auto acked = find_if(pending.begin(), pending.end(),
+                       [tick](shared_ptr<Snapshot const> const &sent) {
+                         return sent->tick == tick;
+                       });
+  if (acked == pending.end()) return;
+
+  baseline = move(*acked);
+  pending.erase(pending.begin(), next(acked));
+}
+
+void SnapshotEncoder::expire(uint32_t tick) noexcept {
+  // the decoder only remembers HISTORY_SIZE snapshots, and it has received at
+  // most one per tick since the baseline
+  if (baseline && tick - baseline->tick >= HISTORY_SIZE) baseline.reset();
+}
+
+void SnapshotEncoder::sent(shared_ptr<Snapshot const> snapshot) {
+  pending.push_back(move(snapshot));
+  if (pending.size() > HISTORY_SIZE) pending.pop_front();
+}
+
+Snapshot const &SnapshotDecoder::decode(span<uint8_t const> data) {
+  static Snapshot const empty;
+  BitReader in(data);
+
+  Snapshot snapshot;
+  snapshot.tick = static_cast<uint32_t>(in.read(32));
+  Snapshot const *base = &empty;
+  if (in.readBool()) {
+    uint32_t baseTick = snapshot.tick - static_cast<uint32_t>(in.readVarint());
+    auto found = find_if(history.begin(), history.end(),
+                         [baseTick](Snapshot const &received) {
+                           return received.tick == baseTick;
+                         });
+    if (found == history.end())
+      throw FormatException("snapshot based on one we no longer have");
+    base = &*found;
+  }
+  snapshot.entities = base->entities;
+
+  auto readIds = [&in]() {
+    uint64_t count = in.readVarint();
+    vector<uint32_t> ids;
+    uint32_t previous = 0;
+    for (uint64_t cnt = 0; cnt < count; ++cnt) {
+      previous += static_cast<uint32_t>(in.readVarint());
+      ids.push_back(previous);
+    }
+    return ids;
+  };
+  for (uint32_t id : readIds()) snapshot.entities.erase(id);
+  for (uint32_t id : readIds()) {
+    auto old = base->entities.find(id);
+    snapshot.entities.insert_or_assign(
+        id, readState(in, old == base->entities.end() ? QuantizedState{}
+                                                      : old->second));
+  }
+
+  history.push_back(move(snapshot));
+  if (history.size() > HISTORY_SIZE) history.pop_front();
+  return history.back();
+}
+
+Snapshot const &SnapshotDecoder::receive(networking::Connection &connection) {
+  span<uint8_t const> data;
+  connection >> networking::Connection::Channel::REALTIME >> data;
+  return decode(data);
+}
+}  // namespace airewar::game
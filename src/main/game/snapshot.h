@@ -0,0 +1,197 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_SNAPSHOT_H_
+#define AIREWAR_GAME_SNAPSHOT_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "game/map.h"
+#include "game/networking/message.h"
+#include "game/networking/networking.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+namespace airewar::game {
+/** what clients see of an entity */
+struct EntityState final {
+  /** position on the surface, as a cartesian point at Map::RADIUS */
+  glm::vec3 position;
+  /** radians clockwise from north */
+  float heading;
+  /** meters per second along the heading */
+  float speed;
+};
+
+/** an entity's state in fixed point, as it goes over the wire */
+struct QuantizedState final {
+  static constexpr unsigned LATITUDE_BITS = 25;
+  static constexpr unsigned LONGITUDE_BITS = 26;
+  static constexpr unsigned HEADING_BITS = 12;
+  static constexpr unsigned SPEED_BITS = 16;
+
+  /** distance along the equator between adjacent longitudes (~0.6 m) */
+  static constexpr double POSITION_PRECISION =
+      glm::two_pi<double>() * Map::RADIUS / (uint64_t{1} << LONGITUDE_BITS);
+  /** fastest representable speed, in meters per second */
+  static constexpr float MAX_SPEED = 1024.0f;
+
+  uint32_t latitude = 0;
+  uint32_t longitude = 0;
+  uint32_t heading = 0;
+  uint32_t speed = 0;
+
+  static QuantizedState quantize(EntityState const &state) noexcept;
+  EntityState dequantize() const noexcept;
+
+  bool operator==(QuantizedState const &) const noexcept = default;
+};
+
+/** every entity's state at one server tick */
+struct Snapshot final {
+  uint32_t tick = 0;
+  std::map<uint32_t, QuantizedState> entities;
+};
+
+/**
+ * one tick's snapshot, encoded at most once per baseline however many clients
+ * it goes to
+ *
+ * clients that keep up acknowledge the same ticks, so a large lobby mostly
+ * shares one or two encodings between everyone
+ */
+class SnapshotBroadcast final {
+ public:
+  explicit SnapshotBroadcast(Snapshot snapshot) noexcept;
+  SnapshotBroadcast(SnapshotBroadcast const &) noexcept = delete;
+  SnapshotBroadcast(SnapshotBroadcast &&) noexcept = default;
+
+  ~SnapshotBroadcast() noexcept = default;
+
+  SnapshotBroadcast &operator=(SnapshotBroadcast const &) noexcept = delete;
+  SnapshotBroadcast &operator=(SnapshotBroadcast &&) noexcept = default;
+
+  std::shared_ptr<Snapshot const> const &getSnapshot() const noexcept;
+  /**
+   * the snapshot as a delta against a baseline, or in full if there isn't one
+   *
+   * baselines are told apart by tick alone, so every client must be sent the
+   * same snapshot stream
+   */
+  networking::Message const &encoded(Snapshot const *baseline);
+  /** distinct encodings made so far */
+  size_t size() const noexcept;
+
+ private:
+  std::shared_ptr<Snapshot const> snapshot;
+  /** by baseline tick, with the full encoding under no tick */
+  std::map<std::optional<uint32_t>, networking::Message> encodings;
+};
+
+/**
+ * encodes snapshots for one client, as deltas against the last snapshot it
+ * acknowledged
+ *
+ * only entities that changed since then are sent, and only their changed
+ * fields, bit-packed
+ */
+class SnapshotEncoder final {
+ public:
+  /** sent snapshots kept waiting for an acknowledgement */
+  static constexpr size_t HISTORY_SIZE = 32;
+
+  SnapshotEncoder() noexcept = default;
+  SnapshotEncoder(SnapshotEncoder const &) noexcept = default;
+  SnapshotEncoder(SnapshotEncoder &&) noexcept = default;
+
+  ~SnapshotEncoder() noexcept = default;
+
+  SnapshotEncoder &operator=(SnapshotEncoder const &) noexcept = default;
+  SnapshotEncoder &operator=(SnapshotEncoder &&) noexcept = default;
+
+  std::vector<uint8_t> encode(Snapshot const &snapshot);
+  /** encode through a broadcast, sharing the result with other encoders */
+  networking::Message const &encode(SnapshotBroadcast &broadcast);
+  /** the snapshot as a delta against base, which may be null */
+  static std::vector<uint8_t> delta(Snapshot const &snapshot,
+                                    Snapshot const *base);
+  /**
+   * offer a snapshot on the realtime channel
+   *
+   * a congested connection may drop it, which is fine - the next one is
+   * encoded against what the client actually has
+   */
+  void send(networking::Connection &connection, Snapshot const &snapshot);
+  /** offer a snapshot, sharing its encoding with other clients' encoders */
+  void send(networking::Connection &connection, SnapshotBroadcast &broadcast);
+
+  /** the client has the snapshot for tick; later ones are based on it */
+  void acknowledge(uint32_t tick) noexcept;
+
+ private:
+  /** shared between every client's encoder, and the broadcast it came from */
+  std::shared_ptr<Snapshot const> baseline;
+  /** sent since the baseline, oldest first */
+  std::deque<std::shared_ptr<Snapshot const>> pending;
+
+  /** forget a baseline the decoder may no longer have by tick */
+  void expire(uint32_t tick) noexcept;
+  void sent(std::shared_ptr<Snapshot const> snapshot);
+};
+
+/** rebuilds snapshots from what a SnapshotEncoder sent */
+class SnapshotDecoder final {
+ public:
+  /** received snapshots kept as possible baselines */
+  static constexpr size_t HISTORY_SIZE = SnapshotEncoder::HISTORY_SIZE;
+
+  SnapshotDecoder() noexcept = default;
+  SnapshotDecoder(SnapshotDecoder const &) noexcept = default;
+  SnapshotDecoder(SnapshotDecoder &&) noexcept = default;
+
+  ~SnapshotDecoder() noexcept = default;
+
+  SnapshotDecoder &operator=(SnapshotDecoder const &) noexcept = default;
+  SnapshotDecoder &operator=(SnapshotDecoder &&) noexcept = default;
+
+  /**
+   * @throws FormatException if the data is malformed, or based on a
+   * snapshot we no longer have
+   */
+  Snapshot const &decode(std::span<uint8_t const> data);
+  /**
+   * read and decode a snapshot from the realtime channel
+   *
+   * the caller acknowledges its tick to the server
+   */
+  Snapshot const &receive(networking::Connection &connection);
+
+ private:
+  /** oldest first */
+  std::deque<Snapshot> history;
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_SNAPSHOT_H_
@@ -0,0 +1,91 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/tickLoop.h"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace airewar::game {
+ostream &operator<<(ostream &out, TickStatistics const &statistics) {
+  return out << "ticks=" << statistics.ticks
+             << " overruns=" << statistics.overruns
+             << " skipped=" << statistics.skipped << " lateness("
+             << statistics.lateness << ") input(" << statistics.input
+             << ") simulate(" << statistics.simulate << ") broadcast("
+             << statistics.broadcast << ") total(" << statistics.total << ")";
+}
+
+TickLoop::TickLoop(unsigned rate, Phases phases_) noexcept
+    : period(chrono::duration_cast<Clock::duration>(chrono::seconds(1)) /
+             max(rate, 1U)),
+      phases(move(phases_)),
+      statisticsMutex(),
+      statistics() {}
+
+void TickLoop::run(atomic_bool const &stop) {
+  Clock::time_point deadline = Clock::now();
+  for (uint64_t tick = 0; !stop; ++tick) {
+    this_thread::sleep_until(deadline);
+    Clock::time_point due = deadline;
+
+    Clock::time_point started = Clock::now();
+    phases.input();
+    Clock::time_point collected = Clock::now();
+    phases.simulate(tick);
+    Clock::time_point simulated = Clock::now();
+    phases.broadcast();
+    Clock::time_point finished = Clock::now();
+
+    deadline += period;
+    bool overrun = finished > deadline;
+    uint64_t skipped = 0;
+    if (overrun) {
+      // whole periods past the next deadline - ticks that are already late
+      uint64_t behind = static_cast<uint64_t>((finished - deadline) / period);
+      if (behind > MAX_CATCH_UP) {
+        skipped = behind;
+        deadline += static_cast<Clock::rep>(behind) * period;
+      }
+    }
+
+    scoped_lock lock(statisticsMutex);
+    ++statistics.ticks;
+    if (overrun) ++statistics.overruns;
+    statistics.skipped += skipped;
+    statistics.lateness.record(started - due);
+    statistics.input.record(collected - started);
+    statistics.simulate.record(simulated - collected);
+    statistics.broadcast.record(finished - simulated);
+    statistics.total.record(finished - started);
+  }
+}
+
+TickLoop::Clock::duration TickLoop::getPeriod() const noexcept {
+  return period;
+}
+
+TickStatistics TickLoop::getStatistics() noexcept {
+  scoped_lock lock(statisticsMutex);
+  return statistics;
+}
+}  // namespace airewar::game
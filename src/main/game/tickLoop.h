@@ -0,0 +1,97 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_GAME_TICKLOOP_H_
+#define AIREWAR_GAME_TICKLOOP_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+
+#include "util/histogram.h"
+
+namespace airewar::game {
+struct TickStatistics final {
+  uint64_t ticks = 0;
+  /** ticks that finished after the next one was due */
+  uint64_t overruns = 0;
+  /** ticks given up on to get back on schedule */
+  uint64_t skipped = 0;
+
+  /** how long after its deadline each tick started */
+  util::Histogram lateness;
+  util::Histogram input;
+  util::Histogram simulate;
+  util::Histogram broadcast;
+  /** all three phases */
+  util::Histogram total;
+};
+std::ostream &operator<<(std::ostream &out, TickStatistics const &statistics);
+
+/**
+ * fixed-timestep loop - each tick collects input, advances the simulation by
+ * one period, then broadcasts the result
+ *
+ * tick n is due at start + n * period, so time spent in a tick or oversleeping
+ * never accumulates into drift. A tick that ends after the next deadline is an
+ * overrun, and the ticks it delayed run back to back; a loop more than
+ * MAX_CATCH_UP ticks behind skips the rest instead
+ */
+class TickLoop final {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint64_t MAX_CATCH_UP = 5;
+
+  struct Phases final {
+    std::function<void()> input;
+    /** advance by one period - called with the tick's number */
+    std::function<void(uint64_t)> simulate;
+    std::function<void()> broadcast;
+  };
+
+  /** @param rate ticks per second */
+  TickLoop(unsigned rate, Phases phases) noexcept;
+  TickLoop(TickLoop const &) noexcept = delete;
+  TickLoop(TickLoop &&) noexcept = delete;
+
+  ~TickLoop() noexcept = default;
+
+  TickLoop &operator=(TickLoop const &) noexcept = delete;
+  TickLoop &operator=(TickLoop &&) noexcept = delete;
+
+  /** run ticks until stop is set; exceptions from a phase end the loop */
+  void run(std::atomic_bool const &stop);
+
+  Clock::duration getPeriod() const noexcept;
+  TickStatistics getStatistics() noexcept;
+
+ private:
+  Clock::duration period;
+  Phases phases;
+
+  std::mutex statisticsMutex;
+  TickStatistics statistics;
+};
+}  // namespace airewar::game
+
+#endif  // AIREWAR_GAME_TICKLOOP_H_
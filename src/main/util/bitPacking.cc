@@ -0,0 +1,83 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/bitPacking.h"
+
+#include "util/exceptions/formatException.h"
+
+using namespace std;
+using namespace airewar::util::exceptions;
+
+namespace airewar::util {
+namespace {
+/** payload bits per varint group - the remaining bit says more follow */
+constexpr unsigned VARINT_GROUP_BITS = 7;
+/** a 64 bit value never needs more groups than this */
+constexpr unsigned MAX_VARINT_GROUPS = 10;
+}  // namespace
+
+void BitWriter::write(uint64_t value, unsigned bits) {
+  for (unsigned bit = bits; bit-- > 0;) {
+    if (bitCount % 8 == 0) buf.push_back(0);
+    if ((value >> bit & 1) != 0)
+      buf.back() |= static_cast<uint8_t>(0x80 >> bitCount % 8);
+    ++bitCount;
+  }
+}
+
+void BitWriter::writeBool(bool value) { write(value ? 1 : 0, 1); }
+
+void BitWriter::writeVarint(uint64_t value) {
+  while (value >> VARINT_GROUP_BITS != 0) {
+    write(1, 1);
+    write(value, VARINT_GROUP_BITS);
+    value >>= VARINT_GROUP_BITS;
+  }
+  write(0, 1);
+  write(value, VARINT_GROUP_BITS);
+}
+
+vector<uint8_t> const &BitWriter::bytes() const noexcept { return buf; }
+
+size_t BitWriter::bitSize() const noexcept { return bitCount; }
+
+BitReader::BitReader(span<uint8_t const> data_) noexcept : data(data_) {}
+
+uint64_t BitReader::read(unsigned bits) {
+  if (bits > data.size() * 8 - bitPos)
+    throw FormatException("packed data ended early");
+
+  uint64_t value = 0;
+  for (unsigned cnt = 0; cnt < bits; ++cnt, ++bitPos)
+    value = value << 1 | (data[bitPos / 8] >> (7 - bitPos % 8) & 1);
+  return value;
+}
+
+bool BitReader::readBool() { return read(1) != 0; }
+
+uint64_t BitReader::readVarint() {
+  uint64_t value = 0;
+  for (unsigned group = 0; group < MAX_VARINT_GROUPS; ++group) {
+    bool more = readBool();
+    value |= read(VARINT_GROUP_BITS) << (group * VARINT_GROUP_BITS);
+    if (!more) return value;
+  }
+  throw FormatException("varint too long");
+}
+}  // namespace airewar::util
@@ -0,0 +1,79 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_UTIL_BITPACKING_H_
+#define AIREWAR_UTIL_BITPACKING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace airewar::util {
+/** packs values into a byte buffer using only as many bits as each needs */
+class BitWriter final {
+ public:
+  BitWriter() noexcept = default;
+  BitWriter(BitWriter const &) noexcept = default;
+  BitWriter(BitWriter &&) noexcept = default;
+
+  ~BitWriter() noexcept = default;
+
+  BitWriter &operator=(BitWriter const &) noexcept = default;
+  BitWriter &operator=(BitWriter &&) noexcept = default;
+
+  /** write the low bits of value, most significant first; bits <= 64 */
+  void write(uint64_t value, unsigned bits);
+  void writeBool(bool value);
+  /** write a value in seven bit groups, so small values stay small */
+  void writeVarint(uint64_t value);
+
+  /** the packed bytes, with the last byte zero-padded */
+  std::vector<uint8_t> const &bytes() const noexcept;
+  size_t bitSize() const noexcept;
+
+ private:
+  std::vector<uint8_t> buf;
+  size_t bitCount = 0;
+};
+
+/** unpacks values written by a BitWriter */
+class BitReader final {
+ public:
+  explicit BitReader(std::span<uint8_t const> data) noexcept;
+  BitReader(BitReader const &) noexcept = default;
+  BitReader(BitReader &&) noexcept = default;
+
+  ~BitReader() noexcept = default;
+
+  BitReader &operator=(BitReader const &) noexcept = default;
+  BitReader &operator=(BitReader &&) noexcept = default;
+
+  /** @throws FormatException if the data runs out */
+  uint64_t read(unsigned bits);
+  bool readBool();
+  uint64_t readVarint();
+
+ private:
+  std::span<uint8_t const> data;
+  size_t bitPos = 0;
+};
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_BITPACKING_H_
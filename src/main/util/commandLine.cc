@@ -0,0 +1,92 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+
+#include "util/commandLine.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__linux__)
+#include <signal.h>
+#elif
+#error "operating system not supported/recognized"
+#endif
+
+using namespace std;
+
+namespace airewar::util {
+namespace {
+volatile sig_atomic_t interruptedFlag = 0;
+
+void onSignal(int) { interruptedFlag = 1; }
+}  // namespace
+
+optional<int> parseOptions(int argc, char const *const argv[],
+                           Usage const &usage, OptionHandler const &handler) {
+  for (int idx = 1; idx < argc; ++idx) {
+    string_view option = argv[idx];
+    if (option == "--help") {
+      usage(cout, argv[0]);
+      return EXIT_SUCCESS;
+    }
+    if (idx + 1 == argc) {
+      cerr << argv[0] << ": missing value for " << option << endl;
+      usage(cerr, argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    string_view value = argv[++idx];
+    switch (handler(option, value)) {
+      case OptionStatus::VALID: {
+        break;
+      }
+      case OptionStatus::INVALID: {
+        cerr << argv[0] << ": invalid value for " << option << ": " << value
+             << endl;
+        return EXIT_FAILURE;
+      }
+      case OptionStatus::UNKNOWN: {
+        cerr << argv[0] << ": unknown option " << option << endl;
+        usage(cerr, argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return nullopt;
+}
+
+void catchSignals() noexcept {
+#if defined(__linux__)
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &act, nullptr);
+  act.sa_handler = onSignal;
+  sigaction(SIGINT, &act, nullptr);
+  sigaction(SIGTERM, &act, nullptr);
+#elif
+#error "operating system not supported/recognized"
+#endif
+}
+
+bool interrupted() noexcept { return interruptedFlag != 0; }
+}  // namespace airewar::util
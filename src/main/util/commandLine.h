@@ -0,0 +1,79 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+
+#ifndef AIREWAR_UTIL_COMMANDLINE_H_
+#define AIREWAR_UTIL_COMMANDLINE_H_
+
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <system_error>
+
+namespace airewar::util {
+/** how often a program waiting to be interrupted checks */
+constexpr std::chrono::milliseconds INTERRUPT_POLL_INTERVAL =
+    std::chrono::milliseconds(100);
+
+/** what an option handler made of an option and its value */
+enum class OptionStatus {
+  VALID,
+  INVALID,
+  UNKNOWN,
+};
+
+/** prints how to use the program called name */
+using Usage = std::function<void(std::ostream &out, char const *name)>;
+/** applies one option and its value */
+using OptionHandler = std::function<OptionStatus(std::string_view option,
+                                                 std::string_view value)>;
+
+/**
+ * go through a command line of options that each take a value, stopping at
+ * the first bad one
+ *
+ * --help prints the usage; anything wrong is reported with it
+ *
+ * @return the status to exit with, or nothing to carry on
+ */
+std::optional<int> parseOptions(int argc, char const *const argv[],
+                                Usage const &usage,
+                                OptionHandler const &handler);
+
+/** @return nothing unless all of text is a number no larger than max */
+template <typename T>
+std::optional<T> parseNumber(std::string_view text, T max) {
+  T value;
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end != text.data() + text.size() || value > max)
+    return std::nullopt;
+  return value;
+}
+
+/** turn off SIGPIPE, and note SIGINT and SIGTERM instead of dying on them */
+void catchSignals() noexcept;
+/** whether SIGINT or SIGTERM has arrived since catchSignals */
+bool interrupted() noexcept;
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_COMMANDLINE_H_
@@ -0,0 +1,92 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+using namespace std;
+
+namespace airewar::util {
+Histogram::Histogram() noexcept : buckets(), total(0), sum(0), maximum(0) {}
+
+void Histogram::record(chrono::nanoseconds duration) noexcept {
+  duration = std::max(duration, chrono::nanoseconds(0));
+  uint64_t micros = static_cast<uint64_t>(
+      chrono::duration_cast<chrono::microseconds>(duration).count());
+  ++buckets[std::min<size_t>(bit_width(micros), NUM_BUCKETS - 1)];
+  ++total;
+  sum += duration;
+  maximum = std::max(maximum, duration);
+}
+
+Histogram &Histogram::operator+=(Histogram const &other) noexcept {
+  for (size_t idx = 0; idx < NUM_BUCKETS; ++idx)
+    buckets[idx] += other.buckets[idx];
+  total += other.total;
+  sum += other.sum;
+  maximum = std::max(maximum, other.maximum);
+  return *this;
+}
+
+uint64_t Histogram::count() const noexcept { return total; }
+
+chrono::nanoseconds Histogram::max() const noexcept { return maximum; }
+
+chrono::nanoseconds Histogram::mean() const noexcept {
+  if (total == 0) return chrono::nanoseconds(0);
+  return sum / total;
+}
+
+chrono::microseconds Histogram::percentile(double fraction) const noexcept {
+  if (total == 0) return chrono::microseconds(0);
+
+  uint64_t rank = static_cast<uint64_t>(
+      ceil(clamp(fraction, 0.0, 1.0) * static_cast<double>(total)));
+  rank = std::max(rank, uint64_t{1});
+  uint64_t seen = 0;
+  for (size_t idx = 0; idx < NUM_BUCKETS - 1; ++idx) {
+    seen += buckets[idx];
+    if (seen >= rank)
+      return std::min(chrono::microseconds(uint64_t{1} << idx),
+                      chrono::duration_cast<chrono::microseconds>(maximum));
+  }
+  // the overflow bucket has no upper bound - the largest sample is the best
+  // answer there is
+  return chrono::duration_cast<chrono::microseconds>(maximum);
+}
+
+array<uint64_t, Histogram::NUM_BUCKETS> const &Histogram::getBuckets()
+    const noexcept {
+  return buckets;
+}
+
+ostream &operator<<(ostream &out, Histogram const &histogram) {
+  auto micros = [](chrono::nanoseconds time) {
+    return chrono::duration_cast<chrono::microseconds>(time).count();
+  };
+  return out << "n=" << histogram.count()
+             << " meanUs=" << micros(histogram.mean())
+             << " p50Us=" << histogram.percentile(0.5).count()
+             << " p99Us=" << histogram.percentile(0.99).count()
+             << " maxUs=" << micros(histogram.max());
+}
+}  // namespace airewar::util
@@ -0,0 +1,77 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_UTIL_HISTOGRAM_H_
+#define AIREWAR_UTIL_HISTOGRAM_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace airewar::util {
+/**
+ * counts of durations in power-of-two microsecond buckets
+ *
+ * cheap enough to record into every tick; percentiles are only as precise as
+ * the bucket they land in
+ */
+class Histogram final {
+ public:
+  /** bucket n holds durations under 2^n microseconds; the last has the rest */
+  static constexpr size_t NUM_BUCKETS = 24;
+
+  Histogram() noexcept;
+  Histogram(Histogram const &) noexcept = default;
+  Histogram(Histogram &&) noexcept = default;
+
+  ~Histogram() noexcept = default;
+
+  Histogram &operator=(Histogram const &) noexcept = default;
+  Histogram &operator=(Histogram &&) noexcept = default;
+
+  void record(std::chrono::nanoseconds duration) noexcept;
+  Histogram &operator+=(Histogram const &other) noexcept;
+
+  uint64_t count() const noexcept;
+  std::chrono::nanoseconds max() const noexcept;
+  std::chrono::nanoseconds mean() const noexcept;
+  /**
+   * upper bound of the bucket holding the given fraction of samples, or the
+   * largest sample if that's lower
+   *
+   * @param fraction in [0, 1]
+   */
+  std::chrono::microseconds percentile(double fraction) const noexcept;
+
+  std::array<uint64_t, NUM_BUCKETS> const &getBuckets() const noexcept;
+
+ private:
+  std::array<uint64_t, NUM_BUCKETS> buckets;
+  uint64_t total;
+  std::chrono::nanoseconds sum;
+  std::chrono::nanoseconds maximum;
+};
+
+/** summary line - count, mean, p50, p99, max, all in microseconds */
+std::ostream &operator<<(std::ostream &out, Histogram const &histogram);
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_HISTOGRAM_H_
@@ -0,0 +1,78 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_UTIL_RINGBUFFER_H_
+#define AIREWAR_UTIL_RINGBUFFER_H_
+
+#include <array>
+#include <cstddef>
+
+namespace airewar::util {
+/**
+ * fixed-capacity queue that overwrites its oldest element when full
+ *
+ * elements are indexed from the oldest
+ */
+template <typename T, size_t N>
+class RingBuffer final {
+ public:
+  RingBuffer() noexcept = default;
+  RingBuffer(RingBuffer const &) noexcept = default;
+  RingBuffer(RingBuffer &&) noexcept = default;
+
+  ~RingBuffer() noexcept = default;
+
+  RingBuffer &operator=(RingBuffer const &) noexcept = default;
+  RingBuffer &operator=(RingBuffer &&) noexcept = default;
+
+  void push_back(T const &value) noexcept {
+    elements[(head + count) % N] = value;
+    if (count == N)
+      head = (head + 1) % N;
+    else
+      ++count;
+  }
+  void pop_front() noexcept {
+    head = (head + 1) % N;
+    --count;
+  }
+  void clear() noexcept { head = count = 0; }
+
+  T &operator[](size_t index) noexcept { return elements[(head + index) % N]; }
+  T const &operator[](size_t index) const noexcept {
+    return elements[(head + index) % N];
+  }
+  T &front() noexcept { return (*this)[0]; }
+  T const &front() const noexcept { return (*this)[0]; }
+  T &back() noexcept { return (*this)[count - 1]; }
+  T const &back() const noexcept { return (*this)[count - 1]; }
+
+  size_t size() const noexcept { return count; }
+  bool empty() const noexcept { return count == 0; }
+  bool full() const noexcept { return count == N; }
+  static constexpr size_t capacity() noexcept { return N; }
+
+ private:
+  std::array<T, N> elements = {};
+  size_t head = 0;
+  size_t count = 0;
+};
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_RINGBUFFER_H_
@@ -0,0 +1,279 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_UTIL_SLOTMAP_H_
+#define AIREWAR_UTIL_SLOTMAP_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace airewar::util {
+/**
+ * fixed-capacity lock-free map from handles to heap-allocated values
+ *
+ * a handle carries its slot's generation, so a handle to an erased value
+ * never finds whatever was put in the slot next. Values are reached through
+ * Refs, and an erased value is only reclaimed once the last Ref to it is gone
+ */
+template <typename T>
+class SlotMap final {
+ public:
+  struct Handle final {
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(Handle const &) const noexcept = default;
+  };
+
+  /** keeps a value from being reclaimed while held */
+  class Ref final {
+   public:
+    Ref() noexcept : map(nullptr), handle(), value(nullptr) {}
+    Ref(Ref const &) noexcept = delete;
+    Ref(Ref &&other) noexcept
+        : map(std::exchange(other.map, nullptr)),
+          handle(other.handle),
+          value(std::exchange(other.value, nullptr)) {}
+
+    ~Ref() noexcept { reset(); }
+
+    Ref &operator=(Ref const &) noexcept = delete;
+    Ref &operator=(Ref &&other) noexcept {
+      if (this != &other) {
+        reset();
+        map = std::exchange(other.map, nullptr);
+        handle = other.handle;
+        value = std::exchange(other.value, nullptr);
+      }
+      return *this;
+    }
+
+    explicit operator bool() const noexcept { return value != nullptr; }
+    T &operator*() const noexcept { return *value; }
+    T *operator->() const noexcept { return value; }
+    Handle getHandle() const noexcept { return handle; }
+
+    void reset() noexcept {
+      if (map) map->release(handle.index);
+      map = nullptr;
+      value = nullptr;
+    }
+
+   private:
+    friend class SlotMap;
+
+    Ref(SlotMap &map_, Handle handle_, T *value_) noexcept
+        : map(&map_), handle(handle_), value(value_) {}
+
+    SlotMap *map;
+    Handle handle;
+    T *value;
+  };
+
+  /**
+   * @param reclaim given each erased value once nothing refers to it - by
+   * default, values are destroyed by whichever thread let go last
+   */
+  explicit SlotMap(
+      size_t capacity,
+      std::function<void(std::unique_ptr<T>)> reclaim_ = nullptr) noexcept
+      : slots(std::make_unique<Slot[]>(capacity)),
+        numSlots(capacity),
+        next(0),
+        count(0),
+        reclaim(std::move(reclaim_)) {}
+  SlotMap(SlotMap const &) noexcept = delete;
+  SlotMap(SlotMap &&) noexcept = delete;
+
+  /** destroys every value left; no Refs may be held */
+  ~SlotMap() noexcept {
+    for (size_t idx = 0; idx < numSlots; ++idx) delete slots[idx].value;
+  }
+
+  SlotMap &operator=(SlotMap const &) noexcept = delete;
+  SlotMap &operator=(SlotMap &&) noexcept = delete;
+
+  /**
+   * construct a value in a free slot
+   *
+   * @return nothing if every slot is taken
+   */
+  template <typename... Args>
+  std::optional<Handle> emplace(Args &&...args) {
+    size_t start = next.fetch_add(1, std::memory_order_relaxed);
+    for (size_t cnt = 0; cnt < numSlots; ++cnt) {
+      uint32_t index = static_cast<uint32_t>((start + cnt) % numSlots);
+      Slot &slot = slots[index];
+      uint64_t control = slot.control.load(std::memory_order_acquire);
+      if (stateOf(control) != FREE) continue;
+
+      uint32_t generation = generationOf(control) + 1;
+      if (!slot.control.compare_exchange_strong(
+              control, pack(generation, CLAIMED, 0),
+              std::memory_order_acq_rel))
+        continue;
+
+      try {
+        slot.value = new T(std::forward<Args>(args)...);
+      } catch (...) {
+        slot.control.store(pack(generation, FREE, 0),
+                           std::memory_order_release);
+        throw;
+      }
+      count.fetch_add(1, std::memory_order_relaxed);
+      slot.control.store(pack(generation, LIVE, 0), std::memory_order_release);
+      return Handle{index, generation};
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * remove a value - it's reclaimed now if nothing refers to it, else when
+   * the last Ref is released
+   *
+   * @return whether the handle still referred to something
+   */
+  bool erase(Handle handle) noexcept {
+    Slot &slot = slots[handle.index];
+    uint64_t control = slot.control.load(std::memory_order_acquire);
+    do {
+      if (stateOf(control) != LIVE ||
+          generationOf(control) != handle.generation)
+        return false;
+    } while (!slot.control.compare_exchange_weak(
+        control, pack(handle.generation, RETIRED, refsOf(control)),
+        std::memory_order_acq_rel));
+
+    count.fetch_sub(1, std::memory_order_relaxed);
+    // nobody can take a new Ref to a retired value, so if there aren't any,
+    // this is the last chance to reclaim it
+    if (refsOf(control) == 0) reclaimSlot(handle.index, handle.generation);
+    return true;
+  }
+
+  /** @return an empty Ref if the handle's value was erased */
+  Ref get(Handle handle) noexcept {
+    T *value = acquire(handle.index, handle.generation);
+    if (!value) return Ref();
+    return Ref(*this, handle, value);
+  }
+
+  /**
+   * call f(handle, value) for each value present when its slot is visited;
+   * values may be erased, even by f, while this runs
+   */
+  template <typename F>
+  void forEach(F f) {
+    for (size_t idx = 0; idx < numSlots; ++idx) {
+      uint32_t index = static_cast<uint32_t>(idx);
+      uint64_t control = slots[idx].control.load(std::memory_order_acquire);
+      if (stateOf(control) != LIVE) continue;
+
+      Handle handle{index, generationOf(control)};
+      T *value = acquire(index, handle.generation);
+      if (!value) continue;
+
+      Ref ref(*this, handle, value);
+      f(handle, *value);
+    }
+  }
+
+  /** values not yet erased */
+  size_t size() const noexcept {
+    return count.load(std::memory_order_relaxed);
+  }
+  size_t capacity() const noexcept { return numSlots; }
+
+ private:
+  /** generation, then state, then reference count, from the top bit down */
+  enum State : uint64_t {
+    FREE = 0,
+    /** being filled by emplace */
+    CLAIMED = 1,
+    LIVE = 2,
+    /** erased, waiting for Refs to be released */
+    RETIRED = 3,
+  };
+  static constexpr int STATE_SHIFT = 30;
+  static constexpr int GENERATION_SHIFT = 32;
+  static constexpr uint64_t REFS_MASK = (uint64_t{1} << STATE_SHIFT) - 1;
+
+  static constexpr uint64_t pack(uint32_t generation, State state,
+                                 uint64_t refs) noexcept {
+    return uint64_t{generation} << GENERATION_SHIFT |
+           static_cast<uint64_t>(state) << STATE_SHIFT | refs;
+  }
+  static constexpr uint32_t generationOf(uint64_t control) noexcept {
+    return static_cast<uint32_t>(control >> GENERATION_SHIFT);
+  }
+  static constexpr State stateOf(uint64_t control) noexcept {
+    return static_cast<State>(control >> STATE_SHIFT & 0b11);
+  }
+  static constexpr uint64_t refsOf(uint64_t control) noexcept {
+    return control & REFS_MASK;
+  }
+
+  struct Slot final {
+    std::atomic<uint64_t> control = 0;
+    /** written before the slot goes LIVE, taken after it's retired */
+    T *value = nullptr;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t numSlots;
+  /** where the next emplace starts looking, so slots get reused evenly */
+  std::atomic<size_t> next;
+  std::atomic<size_t> count;
+  std::function<void(std::unique_ptr<T>)> reclaim;
+
+  /** take a reference if the slot holds that generation's value */
+  T *acquire(uint32_t index, uint32_t generation) noexcept {
+    Slot &slot = slots[index];
+    uint64_t control = slot.control.load(std::memory_order_acquire);
+    do {
+      if (stateOf(control) != LIVE || generationOf(control) != generation ||
+          refsOf(control) == REFS_MASK)
+        return nullptr;
+    } while (!slot.control.compare_exchange_weak(control, control + 1,
+                                                 std::memory_order_acq_rel));
+    return slot.value;
+  }
+
+  void release(uint32_t index) noexcept {
+    uint64_t prior =
+        slots[index].control.fetch_sub(1, std::memory_order_acq_rel);
+    if (stateOf(prior) == RETIRED && refsOf(prior) == 1)
+      reclaimSlot(index, generationOf(prior));
+  }
+
+  void reclaimSlot(uint32_t index, uint32_t generation) noexcept {
+    Slot &slot = slots[index];
+    std::unique_ptr<T> value(std::exchange(slot.value, nullptr));
+    slot.control.store(pack(generation, FREE, 0), std::memory_order_release);
+    if (reclaim) reclaim(std::move(value));
+  }
+};
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_SLOTMAP_H_
@@ -0,0 +1,77 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/threadPool.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace airewar::util {
+ThreadPool::ThreadPool(size_t numThreads)
+    : mutex(), available(), jobs(), stopping(false), threads() {
+  numThreads = max(numThreads, size_t{1});
+  threads.reserve(numThreads);
+  for (size_t cnt = 0; cnt < numThreads; ++cnt)
+    threads.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool() noexcept {
+  {
+    scoped_lock lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (thread &worker : threads) worker.join();
+}
+
+void ThreadPool::post(function<void()> job) {
+  {
+    scoped_lock lock(mutex);
+    jobs.push_back(move(job));
+  }
+  available.notify_one();
+}
+
+size_t ThreadPool::size() const noexcept { return threads.size(); }
+
+size_t ThreadPool::pending() noexcept {
+  scoped_lock lock(mutex);
+  return jobs.size();
+}
+
+size_t ThreadPool::defaultSize() noexcept {
+  return max(thread::hardware_concurrency(), 1U);
+}
+
+void ThreadPool::work() noexcept {
+  while (true) {
+    function<void()> job;
+    {
+      unique_lock lock(mutex);
+      available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) return;
+      job = move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+}  // namespace airewar::util
@@ -0,0 +1,73 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef AIREWAR_UTIL_THREADPOOL_H_
+#define AIREWAR_UTIL_THREADPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace airewar::util {
+/**
+ * a fixed number of threads running queued jobs in order
+ *
+ * jobs must not throw - anything that can fail should catch and report
+ * through whatever it captured
+ */
+class ThreadPool final {
+ public:
+  /** @param numThreads at least one thread is always started */
+  explicit ThreadPool(size_t numThreads = defaultSize());
+  ThreadPool(ThreadPool const &) noexcept = delete;
+  ThreadPool(ThreadPool &&) noexcept = delete;
+
+  /** runs every job still queued, then joins */
+  ~ThreadPool() noexcept;
+
+  ThreadPool &operator=(ThreadPool const &) noexcept = delete;
+  ThreadPool &operator=(ThreadPool &&) noexcept = delete;
+
+  /** queue a job; may be called from any thread, including a job */
+  void post(std::function<void()> job);
+
+  /** number of threads */
+  size_t size() const noexcept;
+  /** jobs queued but not yet started */
+  size_t pending() noexcept;
+
+  /** one thread per hardware thread */
+  static size_t defaultSize() noexcept;
+
+ private:
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<std::function<void()>> jobs;
+  bool stopping;
+  std::vector<std::thread> threads;
+
+  void work() noexcept;
+};
+}  // namespace airewar::util
+
+#endif  // AIREWAR_UTIL_THREADPOOL_H_
@@ -0,0 +1,175 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include <sodium.h>
+
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <cstdlib>
+#include <iostream>
+#include <locale>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "game/server.h"
+#include "util/commandLine.h"
+#include "version.h"
+
+using namespace std;
+using namespace airewar;
+using namespace airewar::game;
+using namespace airewar::util;
+
+namespace {
+void usage(ostream &out, char const *name) {
+  out << "Usage: " << name << " [options]\n"
+      << "Hosts AireWar matches without a display.\n\n"
+      << "  --port PORT           TCP and UDP port (default "
+      << networking::PORT << ")\n"
+      << "  --tick-rate N         simulation ticks per second, 1 to "
+      << ServerSettings::MAX_TICK_RATE << " (default "
+      << ServerSettings().tickRate << ")\n"
+      << "  --help                show this message\n\n"
+      << "Without --room, there is one room, which clients join by host.\n"
+      << "  --room NAME           start a room, joined as host/NAME; the\n"
+      << "                        options below apply to the latest room\n"
+      << "  --password PASSWORD   password clients must give; defaults to\n"
+      << "                        $AIREWAR_PASSWORD, or no password\n"
+      << "  --players N           player slots, 1 to "
+      << RoomSettings::MAX_PLAYERS << " (default " << RoomSettings().players
+      << ")\n"
+      << "  --spectators N        spectator slots, 0 to "
+      << RoomSettings::MAX_SPECTATORS << " (default "
+      << RoomSettings().spectators << ")\n"
+      << "  --seed N              map seed (default random); rooms with the\n"
+      << "                        same seed share one map" << endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  cout << "AireWar dedicated server version " << VERSION_MAJOR << "."
+       << VERSION_MINOR << "." << VERSION_PATCH << endl;
+  cout << "Copyright 2022 Justin Hu" << endl;
+  cout << "This is free software; see the source for copying conditions. There "
+          "is NO"
+       << endl;
+  cout << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR "
+          "PURPOSE."
+       << endl;
+
+  wstring_convert<codecvt_utf8<char32_t>, char32_t> converter;
+  ServerSettings settings;
+  RoomSettings defaults;
+  if (char const *fromEnvironment = getenv("AIREWAR_PASSWORD");
+      fromEnvironment) {
+    try {
+      defaults.password = converter.from_bytes(fromEnvironment);
+    } catch (range_error const &) {
+      cerr << "ERROR: $AIREWAR_PASSWORD is not valid UTF-8" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  vector<RoomSettings> rooms = {defaults};
+  bool named = false;
+
+  optional<int> exitStatus = parseOptions(
+      argc, argv, usage, [&](string_view option, string_view value) {
+        bool valid = true;
+        if (option == "--room") {
+          valid = value.length() <= networking::MAX_ROOM_LENGTH;
+          for (RoomSettings const &room : rooms)
+            valid = valid && (!named || room.name != value);
+          // the first --room names the default room instead of adding one
+          if (valid && named) rooms.push_back(defaults);
+          if (valid) rooms.back().name = value;
+          named = true;
+        } else if (option == "--password") {
+          try {
+            rooms.back().password = converter.from_bytes(
+                value.data(), value.data() + value.size());
+          } catch (range_error const &) {
+            // not valid UTF-8
+            valid = false;
+          }
+        } else if (option == "--port") {
+          optional<uint16_t> port = parseNumber<uint16_t>(value, UINT16_MAX);
+          valid = port.has_value();
+          if (valid) settings.port = *port;
+        } else if (option == "--players") {
+          optional<unsigned> players =
+              parseNumber(value, RoomSettings::MAX_PLAYERS);
+          valid = players.has_value() && *players != 0;
+          if (valid) rooms.back().players = *players;
+        } else if (option == "--spectators") {
+          optional<unsigned> spectators =
+              parseNumber(value, RoomSettings::MAX_SPECTATORS);
+          valid = spectators.has_value();
+          if (valid) rooms.back().spectators = *spectators;
+        } else if (option == "--seed") {
+          rooms.back().seed = parseNumber<uint64_t>(value, UINT64_MAX);
+          valid = rooms.back().seed.has_value();
+        } else if (option == "--tick-rate") {
+          optional<unsigned> tickRate =
+              parseNumber(value, ServerSettings::MAX_TICK_RATE);
+          valid = tickRate.has_value() && *tickRate != 0;
+          if (valid) settings.tickRate = *tickRate;
+        } else {
+          return OptionStatus::UNKNOWN;
+        }
+        return valid ? OptionStatus::VALID : OptionStatus::INVALID;
+      });
+  if (exitStatus) return *exitStatus;
+
+  if (sodium_init() == -1) {
+    cerr << "ERROR: Could not initialize libsodium" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // shut down cleanly on SIGINT and SIGTERM
+  catchSignals();
+
+  server = make_unique<Server>(rooms, networking::Network::system(), settings);
+
+  bool announced = false;
+  while (!interrupted() && server->state != Server::State::ERROR) {
+    if (!announced && server->state == Server::State::RUNNING) {
+      ServerSettings const &running = server->getSettings();
+      cout << "Listening on port " << running.port << " at "
+           << running.tickRate << " ticks per second" << endl;
+      for (auto const &[name, room] : server->getRooms())
+        cout << "Room \"" << name << "\": " << room.settings.players
+             << " player and " << room.settings.spectators
+             << " spectator slots, map seed " << room.seed << endl;
+      announced = true;
+    }
+    this_thread::sleep_for(INTERRUPT_POLL_INTERVAL);
+  }
+
+  bool failed = server->state == Server::State::ERROR;
+  if (failed) cerr << "ERROR: " << server->errorMessage << endl;
+  server->dumpStatistics(clog);
+  server.reset();
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/interpolation.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <map>
+
+#include "glm/glm.hpp"
+#include "util/geometry.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace airewar::game;
+using namespace airewar::util;
+using namespace glm;
+
+namespace {
+constexpr Interpolator::Clock::duration TICK = 100ms;
+
+/** an entity heading east along the equator at 100 m/s */
+Snapshot snapshotAt(uint32_t tick) {
+  float lon = 100.0f * 0.1f * static_cast<float>(tick) / Map::RADIUS;
+  Snapshot snapshot;
+  snapshot.tick = tick;
+  snapshot.entities[7] = QuantizedState::quantize(EntityState{
+      sphericalToCartesian(0.0f, lon, Map::RADIUS), half_pi<float>(), 100.0f});
+  return snapshot;
+}
+
+float distanceFrom(EntityState const &state, uint32_t tick) {
+  return length(state.position -
+                snapshotAt(tick).entities.at(7).dequantize().position);
+}
+}  // namespace
+
+TEST_CASE("interpolation renders between snapshots", "[game][interpolation]") {
+  Interpolator interpolator(TICK);
+  Interpolator::Clock::time_point epoch{};
+  for (uint32_t tick = 0; tick <= 5; ++tick)
+    interpolator.push(snapshotAt(tick), epoch + tick * TICK + 30ms);
+  REQUIRE(interpolator.jitter() == 0ms);
+  REQUIRE(interpolator.delay() == TICK);
+
+  // one interval behind the newest snapshot, then halfway to the next
+  Interpolator::Clock::time_point now = epoch + 5 * TICK + 30ms;
+  REQUIRE(distanceFrom(interpolator.sample(now).at(7), 4) < 1.0f);
+  EntityState halfway = interpolator.sample(now + 50ms).at(7);
+  REQUIRE(abs(distanceFrom(halfway, 4) - 5.0f) < 1.0f);
+  REQUIRE(abs(distanceFrom(halfway, 5) - 5.0f) < 1.0f);
+
+  // nothing newer arrives, so it keeps going, but not forever
+  REQUIRE(abs(distanceFrom(interpolator.sample(now + 200ms).at(7), 5) -
+              10.0f) < 1.0f);
+  REQUIRE(abs(distanceFrom(interpolator.sample(now + 10s).at(7), 5) -
+              25.0f) < 1.0f);
+}
+
+TEST_CASE("interpolation delay adapts to jitter", "[game][interpolation]") {
+  Interpolator interpolator(TICK);
+  Interpolator::Clock::time_point epoch{};
+  for (uint32_t tick = 0; tick <= 50; ++tick)
+    interpolator.push(snapshotAt(tick),
+                      epoch + tick * TICK + (tick % 2 == 0 ? 10ms : 70ms));
+  REQUIRE(interpolator.jitter() > 40ms);
+  REQUIRE(interpolator.delay() > TICK + 100ms);
+  REQUIRE(interpolator.delay() <= Interpolator::MAX_DELAY);
+}
@@ -0,0 +1,61 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/mapCache.h"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <thread>
+
+#include "util/threadPool.h"
+
+using namespace std;
+using namespace airewar::game;
+using namespace airewar::util;
+
+TEST_CASE("map cache shares maps until they're dropped",
+          "[game][mapCache][.long]") {
+  MapCache cache;
+  MapCache::Handle map;
+  {
+    ThreadPool workers(2);
+    atomic<size_t> ready = 0;
+
+    shared_future<MapCache::Handle> first =
+        cache.request(1, workers, [&ready]() { ++ready; });
+    shared_future<MapCache::Handle> second =
+        cache.request(1, workers, [&ready]() { ++ready; });
+    REQUIRE(cache.size() == 1);
+
+    map = first.get();
+    REQUIRE(map != nullptr);
+    // callbacks run just after the future is ready
+    while (ready != 2) this_thread::yield();
+    REQUIRE(second.get() == map);
+    REQUIRE(cache.get(1) == map);
+    REQUIRE(cache.request(1, workers, [&ready]() { ++ready; }).get() == map);
+    REQUIRE(ready == 3);
+  }
+
+  // the workers are done with it, so only we keep the map alive
+  REQUIRE(cache.size() == 1);
+  map.reset();
+  REQUIRE(cache.size() == 0);
+}
@@ -0,0 +1,119 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/datagram.h"
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "util/exceptions/socketException.h"
+
+using namespace std;
+using namespace airewar::game::networking;
+using namespace airewar::util::exceptions;
+
+namespace {
+DatagramKeys randomKeys() {
+  DatagramKeys keys;
+  randombytes_buf(keys.sendKey.data(), keys.sendKey.size());
+  randombytes_buf(keys.recvKey.data(), keys.recvKey.size());
+  keys.session = 42;
+  return keys;
+}
+
+void putBigEndian(vector<uint8_t> &buf, uint64_t data, size_t bytes) {
+  for (size_t cnt = 0; cnt < bytes; ++cnt)
+    buf.push_back(data >> (8 * (bytes - 1 - cnt)) & 0xff);
+}
+
+/** a message as laid out in a packet's plaintext */
+void putMessage(vector<uint8_t> &plaintext, uint8_t channel,
+                uint32_t sequence, vector<uint8_t> const &message) {
+  plaintext.push_back(channel);
+  putBigEndian(plaintext, sequence, sizeof(uint32_t));
+  putBigEndian(plaintext, message.size(), sizeof(uint16_t));
+  plaintext.insert(plaintext.end(), message.begin(), message.end());
+}
+
+/** seal a hand-made plaintext the way the peer would */
+vector<uint8_t> seal(DatagramKeys const &keys, uint64_t number,
+                     vector<uint8_t> const &plaintext) {
+  vector<uint8_t> packet;
+  putBigEndian(packet, keys.session, sizeof(uint64_t));
+  putBigEndian(packet, number, sizeof(uint64_t));
+  size_t header = packet.size();
+
+  array<unsigned char, crypto_aead_chacha20poly1305_ietf_NPUBBYTES> nonce = {};
+  vector<uint8_t> numberBytes;
+  putBigEndian(numberBytes, number, sizeof(uint64_t));
+  copy(numberBytes.begin(), numberBytes.end(),
+       nonce.end() - sizeof(uint64_t));
+
+  packet.resize(header + plaintext.size() +
+                crypto_aead_chacha20poly1305_ietf_ABYTES);
+  crypto_aead_chacha20poly1305_ietf_encrypt(
+      packet.data() + header, nullptr, plaintext.data(), plaintext.size(),
+      packet.data(), header, nullptr, nonce.data(), keys.recvKey.data());
+  return packet;
+}
+}  // namespace
+
+TEST_CASE("datagram packets are processed whole or not at all",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  DatagramKeys keys = randomKeys();
+  Datagram session(keys);
+
+  vector<uint8_t> valid;
+  putBigEndian(valid, 0, sizeof(uint32_t));
+  putMessage(valid, 0, 0, {7});
+
+  // authentic, but the second message is on a channel that doesn't exist
+  vector<uint8_t> malformed = valid;
+  putMessage(malformed, 9, 0, {});
+  vector<uint8_t> packet = seal(keys, 1, malformed);
+  REQUIRE(!session.incoming(packet.data(), packet.size()));
+  REQUIRE(!session.receive());
+
+  // so the packet number wasn't used up either
+  packet = seal(keys, 1, valid);
+  REQUIRE(session.incoming(packet.data(), packet.size()));
+  optional<pair<Datagram::Channel, vector<uint8_t>>> received =
+      session.receive();
+  REQUIRE(received);
+  REQUIRE(received->second == vector<uint8_t>{7});
+}
+
+TEST_CASE("datagram sessions stop queueing for a silent peer",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  Datagram session(randomKeys());
+  for (size_t cnt = 0; cnt < Datagram::MAX_UNACKED; ++cnt)
+    session.send(Datagram::Channel::RELIABLE_ORDERED, {});
+  REQUIRE_THROWS_AS(session.send(Datagram::Channel::RELIABLE_ORDERED, {}),
+                    SocketException);
+  session.send(Datagram::Channel::UNRELIABLE_SEQUENCED, {});
+}
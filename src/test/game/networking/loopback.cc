@@ -0,0 +1,198 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/loopback/networking.h"
+
+#include <sodium.h>
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game/networking/reactor.h"
+#include "game/networking/task.h"
+#include "util/exceptions/socketException.h"
+#include "util/threadPool.h"
+
+using namespace std;
+using namespace airewar::game::networking;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace {
+/** what our players see on a bad day */
+loopback::Conditions badConditions() {
+  loopback::Conditions conditions;
+  conditions.latency = chrono::milliseconds(150);
+  conditions.jitter = chrono::milliseconds(20);
+  conditions.loss = 0.02;
+  conditions.reorder = 0.02;
+  conditions.seed = 1;
+  return conditions;
+}
+
+/** answer each number with its successor, as a coroutine */
+Task<void> echo(Connection &connection, size_t numbers, bool &finished) {
+  for (size_t cnt = 0; cnt < numbers; ++cnt) {
+    uint32_t number = co_await connection.read<uint32_t>();
+    co_await connection.write(number + 1);
+    co_await connection.drain();
+  }
+  finished = true;
+}
+}  // namespace
+
+TEST_CASE("loopback stream delivers in order despite loss",
+          "[game][networking][loopback]") {
+  REQUIRE(sodium_init() >= 0);
+
+  loopback::Network network(badConditions());
+  atomic_bool stop(false);
+  unique_ptr<Server> server = network.listen(PORT, "password", stop);
+  TicketKey ticketKey;
+
+  bool serverHandshaken = false;
+  thread serverThread([&server, &ticketKey, &serverHandshaken]() {
+    unique_ptr<Connection> accepted;
+    while (!accepted) accepted = server->accept();
+    serverHandshaken = accepted->handshake("password", ticketKey);
+    if (!serverHandshaken) return;
+    for (uint32_t cnt = 0; cnt < 10000; ++cnt) *accepted << cnt;
+    accepted->flush();
+    bool done;
+    *accepted >> done;
+  });
+
+  unique_ptr<Connection> client = network.connect("localhost", PORT, stop);
+  optional<Ticket> ticket;
+  REQUIRE(client->handshake("password", ticket));
+  for (uint32_t cnt = 0; cnt < 10000; ++cnt) {
+    uint32_t received;
+    *client >> received;
+    REQUIRE(received == cnt);
+  }
+  *client << true;
+  client->flush();
+  serverThread.join();
+  REQUIRE(serverHandshaken);
+
+  REQUIRE(client->getStatistics().rtt >= chrono::milliseconds(300));
+}
+
+TEST_CASE("loopback refuses connections nobody listens for",
+          "[game][networking][loopback]") {
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  REQUIRE_THROWS_AS(network.connect("localhost", PORT, stop), SocketException);
+
+  unique_ptr<Server> server = network.listen(PORT, "password", stop);
+  REQUIRE_THROWS_AS(network.listen(PORT, "password", stop), SocketException);
+}
+
+TEST_CASE("loopback datagrams survive loss and reordering",
+          "[game][networking][loopback]") {
+  REQUIRE(sodium_init() >= 0);
+
+  loopback::Conditions conditions;
+  conditions.latency = chrono::milliseconds(5);
+  conditions.jitter = chrono::milliseconds(5);
+  conditions.loss = 0.3;
+  conditions.reorder = 0.3;
+  conditions.seed = 2;
+  loopback::Network network(conditions);
+
+  DatagramKeys clientKeys;
+  randombytes_buf(clientKeys.sendKey.data(), clientKeys.sendKey.size());
+  randombytes_buf(clientKeys.recvKey.data(), clientKeys.recvKey.size());
+  clientKeys.session = 42;
+  DatagramKeys serverKeys = clientKeys;
+  swap(serverKeys.sendKey, serverKeys.recvKey);
+
+  unique_ptr<DatagramSocket> serverSocket = network.listenDatagrams(PORT);
+  unique_ptr<DatagramSocket> clientSocket =
+      network.connectDatagrams("localhost", PORT);
+  Datagram serverSession(serverKeys);
+  Datagram clientSession(clientKeys);
+  serverSocket->attach(serverSession);
+  clientSocket->attach(clientSession);
+
+  for (uint8_t cnt = 0; cnt < 100; ++cnt)
+    clientSession.send(Datagram::Channel::RELIABLE_ORDERED, {cnt});
+
+  vector<uint8_t> received;
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + chrono::seconds(30);
+  while (received.size() < 100 && chrono::steady_clock::now() < deadline) {
+    clientSocket->update();
+    serverSocket->update();
+    while (auto message = serverSession.receive())
+      received.push_back(message->second.at(0));
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+
+  REQUIRE(received.size() == 100);
+  for (uint8_t cnt = 0; cnt < 100; ++cnt) REQUIRE(received[cnt] == cnt);
+
+  serverSocket->detach(serverSession);
+  clientSocket->detach(clientSession);
+}
+
+TEST_CASE("loopback reactors wake as packets arrive",
+          "[game][networking][loopback]") {
+  REQUIRE(sodium_init() >= 0);
+  constexpr size_t NUM_NUMBERS = 20;
+
+  loopback::Conditions conditions;
+  conditions.latency = chrono::milliseconds(5);
+  loopback::Network network(conditions);
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  ThreadPool workers(1);
+  unique_ptr<Reactor> reactor = network.makeReactor(workers);
+  server->setReactor(*reactor);
+  bool finished = false;
+  reactor->spawn(echo(*server, NUM_NUMBERS, finished));
+
+  size_t answered = 0;
+  thread peer([&client, &answered]() {
+    for (uint32_t cnt = 0; cnt < NUM_NUMBERS; ++cnt) {
+      *client << cnt;
+      client->flush();
+      uint32_t answer;
+      *client >> answer;
+      if (answer == cnt + 1) ++answered;
+    }
+  });
+
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + chrono::seconds(10);
+  while (!finished && chrono::steady_clock::now() < deadline)
+    reactor->poll(Reactor::POLL_TIMEOUT);
+  peer.join();
+
+  REQUIRE(finished);
+  REQUIRE(answered == NUM_NUMBERS);
+  REQUIRE(reactor->size() == 0);
+}
@@ -0,0 +1,781 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/networking/networking.h"
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "game/networking/clockSync.h"
+#include "game/networking/loopback/link.h"
+#include "game/networking/loopback/networking.h"
+#include "game/networking/reactor.h"
+#include "game/networking/task.h"
+#include "util/exceptions/socketException.h"
+#include "util/threadPool.h"
+
+using namespace std;
+using namespace airewar::game::networking;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+namespace {
+/** answer each number with its successor, as a coroutine */
+Task<void> echoSession(Reactor &reactor, unique_ptr<Connection> connection,
+                       TicketKey const &ticketKey, size_t numbers,
+                       size_t &finished) {
+  connection->setReactor(reactor);
+  bool handshaken = co_await reactor.offload([&connection, &ticketKey]() {
+    return connection->handshake("password", ticketKey);
+  });
+  if (handshaken) {
+    for (size_t cnt = 0; cnt < numbers; ++cnt) {
+      uint32_t number = co_await connection->read<uint32_t>();
+      co_await connection->write(number + 1);
+      co_await connection->drain();
+    }
+  }
+  ++finished;
+}
+
+/** count a session through the gate */
+Task<void> waitAtGate(Reactor &reactor, Gate &gate, size_t &passed) {
+  co_await gate.wait(reactor);
+  ++passed;
+}
+
+/** answer clock pings until the peer hangs up */
+Task<void> serveClock(ClockSync &clock, Connection &connection,
+                      atomic_bool &closed) {
+  try {
+    co_await clock.serve(connection);
+  } catch (SocketException const &) {
+  }
+  closed = true;
+}
+
+/**
+ * a loopback client and server whose traffic passes through a relay, which
+ * records what the client sends and may tamper with it first
+ */
+class Relay final {
+ public:
+  explicit Relay(function<void(vector<uint8_t> &packet)> tamper)
+      : stop(false),
+        clientUp(make_shared<loopback::Link>(loopback::Conditions{}, true)),
+        serverUp(make_shared<loopback::Link>(loopback::Conditions{}, true)),
+        down(make_shared<loopback::Link>(loopback::Conditions{}, true)),
+        client(make_unique<loopback::Connection>(clientUp, down,
+                                                 chrono::microseconds(0),
+                                                 stop)),
+        server(make_unique<loopback::Connection>(down, serverUp,
+                                                 chrono::microseconds(0),
+                                                 stop)),
+        packetsMutex(),
+        packets(),
+        relay([this, tamper = move(tamper)]() mutable {
+          while (!stop) {
+            optional<vector<uint8_t>> packet =
+                clientUp->pop(chrono::milliseconds(10));
+            if (!packet) {
+              if (clientUp->drained()) break;
+              continue;
+            }
+            tamper(*packet);
+            {
+              scoped_lock lock(packetsMutex);
+              packets.push_back(*packet);
+            }
+            serverUp->push(move(*packet));
+          }
+          serverUp->close();
+        }) {}
+  Relay(Relay const &) noexcept = delete;
+  Relay(Relay &&) noexcept = delete;
+
+  ~Relay() noexcept {
+    client.reset();
+    server.reset();
+    stop = true;
+    relay.join();
+  }
+
+  Relay &operator=(Relay const &) noexcept = delete;
+  Relay &operator=(Relay &&) noexcept = delete;
+
+  /** @return whether both ends completed the handshake */
+  bool handshake() {
+    TicketKey ticketKey;
+    bool serverHandshaken = false;
+    thread serverThread([this, &ticketKey, &serverHandshaken]() {
+      try {
+        serverHandshaken = server->handshake("password", ticketKey);
+      } catch (...) {
+        // any failure is a failed handshake
+      }
+    });
+
+    optional<Ticket> ticket;
+    bool clientHandshaken = false;
+    try {
+      clientHandshaken = client->handshake("password", ticket);
+    } catch (SocketException const &) {
+    }
+    // a failed client leaves the server waiting - hang up to unblock it
+    if (!clientHandshaken) client.reset();
+    serverThread.join();
+    return clientHandshaken && serverHandshaken;
+  }
+
+  /** packets the client sent, as they were before tampering */
+  vector<vector<uint8_t>> sent() {
+    scoped_lock lock(packetsMutex);
+    return packets;
+  }
+
+  atomic_bool stop;
+  shared_ptr<loopback::Link> clientUp;
+  shared_ptr<loopback::Link> serverUp;
+  shared_ptr<loopback::Link> down;
+  unique_ptr<Connection> client;
+  unique_ptr<Connection> server;
+
+ private:
+  mutex packetsMutex;
+  vector<vector<uint8_t>> packets;
+  thread relay;
+};
+}  // namespace
+
+TEST_CASE("connection round trips every type", "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  *client << uint8_t{0x12} << uint16_t{0x1234} << uint32_t{0x12345678}
+          << uint64_t{0x123456789abcdef0} << int8_t{-12} << int16_t{-1234}
+          << int32_t{-12345678} << int64_t{-0x123456789abcdef0} << 1.5f
+          << -2.25 << char8_t{u8'x'} << U'é' << u8string(u8"héllo")
+          << u32string(U"wörld") << true << false;
+  client->flush();
+
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  int8_t i8;
+  int16_t i16;
+  int32_t i32;
+  int64_t i64;
+  float f;
+  double d;
+  char8_t c8;
+  char32_t c32;
+  u8string s8;
+  u32string s32;
+  bool t;
+  bool fa;
+  *server >> u8 >> u16 >> u32 >> u64 >> i8 >> i16 >> i32 >> i64 >> f >> d >>
+      c8 >> c32 >> s8 >> s32 >> t >> fa;
+
+  REQUIRE(u8 == 0x12);
+  REQUIRE(u16 == 0x1234);
+  REQUIRE(u32 == 0x12345678);
+  REQUIRE(u64 == 0x123456789abcdef0);
+  REQUIRE(i8 == -12);
+  REQUIRE(i16 == -1234);
+  REQUIRE(i32 == -12345678);
+  REQUIRE(i64 == -0x123456789abcdef0);
+  REQUIRE(f == 1.5f);
+  REQUIRE(d == -2.25);
+  REQUIRE(c8 == u8'x');
+  REQUIRE(c32 == U'é');
+  REQUIRE(s8 == u8"héllo");
+  REQUIRE(s32 == U"wörld");
+  REQUIRE(t);
+  REQUIRE(!fa);
+}
+
+TEST_CASE("connection carries messages larger than a frame",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  vector<uint8_t> big(100'000);
+  randombytes_buf(big.data(), big.size());
+  *client << span<uint8_t const>(big);
+  client->flush();
+
+  span<uint8_t const> received;
+  *server >> received;
+  REQUIRE(vector<uint8_t>(received.begin(), received.end()) == big);
+
+  server->setMaxMessageSize(1000);
+  *client << span<uint8_t const>(big);
+  client->flush();
+  REQUIRE_THROWS_AS(*server >> received, SocketException);
+}
+
+TEST_CASE("encoded messages are shared between connections",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [firstClient, firstServer] = network.connectedPair(stop);
+  auto [secondClient, secondServer] = network.connectedPair(stop);
+
+  MessageBuilder builder;
+  for (uint32_t cnt = 0; cnt < 1'000; ++cnt) builder << cnt;
+  builder << u8string(u8"end");
+  Message message = builder.build();
+  REQUIRE(builder.build().empty());
+
+  for (Connection *server : {firstServer.get(), secondServer.get()}) {
+    *server << uint8_t{1} << message << uint8_t{2};
+    server->flush();
+  }
+
+  for (Connection *client : {firstClient.get(), secondClient.get()}) {
+    uint8_t before;
+    *client >> before;
+    REQUIRE(before == 1);
+    for (uint32_t cnt = 0; cnt < 1'000; ++cnt) {
+      uint32_t received;
+      *client >> received;
+      REQUIRE(received == cnt);
+    }
+    u8string_view end;
+    uint8_t after;
+    *client >> end >> after;
+    REQUIRE(end == u8"end");
+    REQUIRE(after == 2);
+  }
+}
+
+TEST_CASE("connection channels overtake bulk data", "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  *client << Connection::Channel::BULK;
+  for (uint32_t cnt = 0; cnt < 10'000; ++cnt) *client << cnt;
+  *client << Connection::Channel::CONTROL << u8string(u8"urgent");
+  client->flush();
+
+  u8string_view urgent;
+  *server >> Connection::Channel::CONTROL >> urgent;
+  REQUIRE(urgent == u8"urgent");
+  *server >> Connection::Channel::BULK;
+  for (uint32_t cnt = 0; cnt < 10'000; ++cnt) {
+    uint32_t received;
+    *server >> received;
+    REQUIRE(received == cnt);
+  }
+}
+
+TEST_CASE("channels nobody reads can't buffer without bound",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+  server->setMaxMessageSize(1024);
+
+  *client << Connection::Channel::BULK;
+  for (uint32_t cnt = 0; cnt < 10'000; ++cnt) *client << cnt;
+  client->flush();
+  // sent after the bulk data, so it can't overtake it
+  *client << Connection::Channel::CONTROL << true;
+  client->flush();
+
+  bool received;
+  *server >> Connection::Channel::CONTROL;
+  REQUIRE_THROWS_AS(*server >> received, SocketException);
+}
+
+TEST_CASE("handshake negotiates aes-256-gcm when both ends have it",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  // nothing to negotiate without AES-NI
+  if (crypto_aead_aes256gcm_is_available() != 1) return;
+
+  Relay relay([](vector<uint8_t> &) {});
+  REQUIRE(relay.handshake());
+  *relay.client << u8string(u8"over gcm");
+  relay.client->flush();
+  u8string message;
+  *relay.server >> message;
+  REQUIRE(message == u8"over gcm");
+
+  // an AES-256-GCM frame starts with its counter in the clear - zero for
+  // the first, where an XChaCha20-Poly1305 frame is all ciphertext
+  vector<vector<uint8_t>> sent = relay.sent();
+  REQUIRE(sent.back().size() >= crypto_aead_aes256gcm_NPUBBYTES);
+  REQUIRE(all_of(sent.back().begin(),
+                 sent.back().begin() + crypto_aead_aes256gcm_NPUBBYTES,
+                 [](uint8_t byte) { return byte == 0; }));
+}
+
+TEST_CASE("handshake fails if the capabilities are tampered with",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  // flip the client's AES-256-GCM bit in its hello, the first packet it sends
+  Relay relay([first = true](vector<uint8_t> &packet) mutable {
+    if (first && packet.size() > 1) packet[1] ^= 1;
+    first = false;
+  });
+  REQUIRE(!relay.handshake());
+}
+
+TEST_CASE("handshake rejects the wrong password", "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  unique_ptr<Server> server = network.listen(PORT, "password", stop);
+  TicketKey ticketKey;
+  bool serverHandshaken = true;
+  thread serverThread([&server, &ticketKey, &serverHandshaken]() {
+    unique_ptr<Connection> accepted;
+    while (!accepted) accepted = server->accept();
+    serverHandshaken = accepted->handshake("password", ticketKey);
+  });
+
+  unique_ptr<Connection> client = network.connect("localhost", PORT, stop);
+  optional<Ticket> ticket;
+  bool clientHandshaken = client->handshake("not the password", ticket);
+  serverThread.join();
+  REQUIRE(!clientHandshaken);
+  REQUIRE(!serverHandshaken);
+}
+
+TEST_CASE("handshake checks the password of the room asked for",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  unique_ptr<Server> server = network.listen(PORT, "password", stop);
+  string const redPassword = "red password";
+  string const bluePassword = "blue password";
+  TicketKey ticketKey;
+  auto lookup = [&](string const &room) -> optional<Credentials> {
+    if (room == "red") return Credentials{redPassword, ticketKey};
+    if (room == "blue") return Credentials{bluePassword, ticketKey};
+    return nullopt;
+  };
+
+  auto attempt = [&](string const &room, string const &password) {
+    optional<string> joined = "unset";
+    thread serverThread([&server, &lookup, &joined]() {
+      unique_ptr<Connection> accepted;
+      while (!accepted) accepted = server->accept();
+      joined = accepted->handshake(lookup);
+    });
+
+    unique_ptr<Connection> client = network.connect("localhost", PORT, stop);
+    optional<Ticket> ticket;
+    bool clientHandshaken = client->handshake(room, password, ticket);
+    serverThread.join();
+    REQUIRE(clientHandshaken == joined.has_value());
+    return joined;
+  };
+
+  REQUIRE(attempt("blue", "blue password") == "blue");
+  REQUIRE(attempt("red", "red password") == "red");
+  REQUIRE(!attempt("red", "blue password"));
+  REQUIRE(!attempt("green", "red password"));
+}
+
+TEST_CASE("handshake resumes with an earlier connection's ticket",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  unique_ptr<Server> server = network.listen(PORT, "password", stop);
+  TicketKey ticketKey;
+
+  auto attempt = [&](string const &password, optional<Ticket> &ticket) {
+    bool serverHandshaken = false;
+    thread serverThread([&server, &ticketKey, &serverHandshaken]() {
+      unique_ptr<Connection> accepted;
+      while (!accepted) accepted = server->accept();
+      serverHandshaken = accepted->handshake("password", ticketKey);
+    });
+
+    unique_ptr<Connection> client = network.connect("localhost", PORT, stop);
+    bool clientHandshaken = client->handshake(password, ticket);
+    serverThread.join();
+    REQUIRE(clientHandshaken == serverHandshaken);
+    return clientHandshaken;
+  };
+
+  optional<Ticket> ticket;
+  REQUIRE(attempt("password", ticket));
+  REQUIRE(ticket);
+  Ticket first = *ticket;
+
+  // a resumed handshake never derives keys from the password
+  REQUIRE(attempt("wrong password", ticket));
+  REQUIRE(ticket->sealed != first.sealed);
+  REQUIRE(ticket->secret != first.secret);
+
+  SECTION("expired tickets fall back to the password") {
+    ticket->sealed = ticketKey.seal(ticket->secret, chrono::seconds(0));
+    optional<Ticket> expired = ticket;
+    REQUIRE(!attempt("wrong password", expired));
+    REQUIRE(attempt("password", ticket));
+  }
+
+  SECTION("tickets from another room fall back to the password") {
+    TicketKey otherKey;
+    ticket->sealed = otherKey.seal(ticket->secret);
+    optional<Ticket> foreign = ticket;
+    REQUIRE(!attempt("wrong password", foreign));
+    REQUIRE(attempt("password", ticket));
+  }
+}
+
+TEST_CASE("closed tcp connections throw instead of hanging",
+          "[game][networking]") {
+  atomic_bool stop(false);
+  unique_ptr<Server> server = Server::makeServer(0, "password", stop);
+  unique_ptr<Connection> client =
+      Connection::makeClient("localhost", server->getPort(), stop);
+  unique_ptr<Connection> accepted;
+  while (!accepted) accepted = server->accept();
+  client.reset();
+
+  bool data;
+  REQUIRE_THROWS_AS(*accepted >> data, SocketException);
+}
+
+TEST_CASE("handshakes give up on clients that stall", "[game][networking]") {
+  atomic_bool stop(false);
+  unique_ptr<Server> server = Server::makeServer(0, "password", stop);
+  unique_ptr<Connection> client =
+      Connection::makeClient("localhost", server->getPort(), stop);
+  unique_ptr<Connection> accepted;
+  while (!accepted) accepted = server->accept();
+
+  // the client never says hello
+  TicketKey ticketKey;
+  accepted->setHandshakeTimeout(chrono::milliseconds(200));
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  REQUIRE_THROWS_AS(accepted->handshake("password", ticketKey),
+                    SocketException);
+  REQUIRE(chrono::steady_clock::now() - start < chrono::seconds(2));
+}
+
+TEST_CASE("tcp listeners accept every waiting connection",
+          "[game][networking]") {
+  constexpr size_t NUM_CLIENTS = 8;
+  atomic_bool stop(false);
+
+  {
+    unique_ptr<Server> server = Server::makeServer(0, "password", stop);
+    vector<unique_ptr<Connection>> clients;
+    for (size_t cnt = 0; cnt < NUM_CLIENTS; ++cnt)
+      clients.push_back(
+          Connection::makeClient("localhost", server->getPort(), stop));
+
+    // one wake-up drains the listen queue, so none of these wait
+    size_t accepted = 0;
+    for (size_t cnt = 0; cnt < NUM_CLIENTS; ++cnt)
+      if (server->accept()) ++accepted;
+    REQUIRE(accepted == NUM_CLIENTS);
+  }
+
+  vector<unique_ptr<Server>> servers =
+      Network::system().listenShared(0, 2, "password", stop);
+  REQUIRE(servers.size() == 2);
+  REQUIRE(servers.back()->getPort() == servers.front()->getPort());
+  vector<unique_ptr<Connection>> clients;
+  for (size_t cnt = 0; cnt < NUM_CLIENTS; ++cnt)
+    clients.push_back(
+        Connection::makeClient("localhost", servers.front()->getPort(), stop));
+
+  size_t accepted = 0;
+  for (size_t round = 0; round < 10 && accepted != NUM_CLIENTS; ++round)
+    for (unique_ptr<Server> &server : servers)
+      while (server->accept()) ++accepted;
+  REQUIRE(accepted == NUM_CLIENTS);
+}
+
+TEST_CASE("reactor runs many sessions on one thread", "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  constexpr size_t NUM_CLIENTS = 3;
+  constexpr size_t NUM_NUMBERS = 100;
+
+  atomic_bool stop(false);
+  ThreadPool workers(1);
+  unique_ptr<Reactor> reactor = Reactor::makeReactor(workers);
+  unique_ptr<Server> server = Server::makeServer(0, "password", stop);
+  TicketKey ticketKey;
+
+  vector<uint32_t> answered(NUM_CLIENTS, 0);
+  vector<thread> clients;
+  for (size_t client = 0; client < NUM_CLIENTS; ++client) {
+    clients.emplace_back([&stop, &answered, client,
+                          port = server->getPort()]() {
+      unique_ptr<Connection> connection =
+          Connection::makeClient("localhost", port, stop);
+      optional<Ticket> ticket;
+      if (!connection->handshake("password", ticket)) return;
+      for (uint32_t cnt = 0; cnt < NUM_NUMBERS; ++cnt) {
+        *connection << cnt;
+        connection->flush();
+        uint32_t answer;
+        *connection >> answer;
+        if (answer == cnt + 1) ++answered[client];
+      }
+    });
+  }
+
+  size_t accepted = 0;
+  size_t finished = 0;
+  while (finished != NUM_CLIENTS) {
+    if (accepted != NUM_CLIENTS) {
+      if (unique_ptr<Connection> connection = server->accept(); connection) {
+        reactor->spawn(echoSession(*reactor, move(connection), ticketKey,
+                                   NUM_NUMBERS, finished));
+        ++accepted;
+      }
+    }
+    reactor->poll(chrono::milliseconds(10));
+  }
+  for (thread &client : clients) client.join();
+
+  REQUIRE(reactor->size() == 0);
+  for (uint32_t count : answered) REQUIRE(count == NUM_NUMBERS);
+}
+
+TEST_CASE("gate holds sessions until it's opened", "[game][networking]") {
+  ThreadPool workers(1);
+  unique_ptr<Reactor> reactor = Reactor::makeReactor(workers);
+  Gate gate;
+  size_t passed = 0;
+
+  for (size_t cnt = 0; cnt < 3; ++cnt)
+    reactor->spawn(waitAtGate(*reactor, gate, passed));
+  reactor->poll(chrono::milliseconds(10));
+  REQUIRE(passed == 0);
+  REQUIRE(reactor->size() == 3);
+
+  thread opener([&gate]() { gate.open(); });
+  while (reactor->size() != 0) reactor->poll(Reactor::POLL_TIMEOUT);
+  opener.join();
+  REQUIRE(passed == 3);
+
+  // once open, sessions don't wait at all
+  reactor->spawn(waitAtGate(*reactor, gate, passed));
+  reactor->poll(chrono::milliseconds(0));
+  REQUIRE(passed == 4);
+}
+
+TEST_CASE("clock sync measures the round trip both ways",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  atomic_bool stop(false);
+  ThreadPool workers(1);
+  unique_ptr<Reactor> reactor = Reactor::makeReactor(workers);
+  unique_ptr<Server> server = Server::makeServer(0, "password", stop);
+  TicketKey ticketKey;
+
+  ClockSync clientClock;
+  thread client([&stop, &clientClock, port = server->getPort()]() {
+    unique_ptr<Connection> connection =
+        Connection::makeClient("localhost", port, stop);
+    optional<Ticket> ticket;
+    if (!connection->handshake("password", ticket)) return;
+    for (size_t cnt = 0; cnt < 5; ++cnt) {
+      clientClock.ping(*connection);
+      connection->flush();
+      while (clientClock.receive(*connection) != ClockSync::Message::PONG)
+        connection->flush();
+    }
+  });
+
+  unique_ptr<Connection> accepted;
+  while (!accepted) accepted = server->accept();
+  REQUIRE(accepted->handshake("password", ticketKey));
+  accepted->setReactor(*reactor);
+  ClockSync serverClock;
+  atomic_bool closed(false);
+  reactor->spawn(serveClock(serverClock, *accepted, closed));
+  thread reactorThread([&reactor, &stop]() { reactor->run(stop); });
+  client.join();
+  while (!closed) this_thread::yield();
+  stop = true;
+  reactorThread.join();
+
+  // both ends share a clock here, so the offset is just measurement error
+  for (ClockSync const *clock : {&clientClock, &serverClock}) {
+    REQUIRE(clock->rtt().has_value());
+    REQUIRE(*clock->rtt() < chrono::milliseconds(100));
+    REQUIRE(chrono::abs(*clock->offset()) <= *clock->rtt());
+    REQUIRE(clock->peerTime(ClockSync::Clock::now()).has_value());
+  }
+}
+
+TEST_CASE("congested connections coalesce offered messages",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  auto snapshotOf = [](uint32_t snapshot) {
+    return [snapshot](Connection &connection) {
+      connection << snapshot << u8string(u8"state");
+    };
+  };
+
+  // nothing is sent between offers, so the queue only grows - two snapshots
+  // fit under the high watermark, and the rest coalesce into the newest
+  REQUIRE(client->offer(Connection::Channel::REALTIME, snapshotOf(0)));
+  size_t snapshotSize = client->queued();
+  client->setWatermarks(2 * snapshotSize, snapshotSize);
+  for (uint32_t snapshot = 1; snapshot < 10; ++snapshot)
+    REQUIRE(client->offer(Connection::Channel::REALTIME, snapshotOf(snapshot)));
+  REQUIRE(client->pressure() == Connection::Pressure::CONGESTED);
+  client->flush();
+  REQUIRE(client->pressure() == Connection::Pressure::NORMAL);
+
+  *server >> Connection::Channel::REALTIME;
+  for (uint32_t expected : {0u, 1u, 9u}) {
+    uint32_t snapshot;
+    u8string state;
+    *server >> snapshot >> state;
+    REQUIRE(snapshot == expected);
+    REQUIRE(state == u8"state");
+  }
+  REQUIRE(client->getStatistics().messagesDropped == 7);
+
+  client->setSlowConsumerHook(
+      [](Connection::Channel, size_t) {
+        return Connection::SlowConsumerAction::DISCONNECT;
+      });
+  client->offer(Connection::Channel::REALTIME,
+                [](Connection &connection) { connection << uint32_t{0}; });
+  REQUIRE_THROWS_AS(
+      client->offer(Connection::Channel::REALTIME,
+                    [](Connection &connection) {
+                      connection << u8string(100, u8'x');
+                    }),
+      SocketException);
+}
+
+TEST_CASE("offers that fail to write leave the connection as it was",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  *client << Connection::Channel::REALTIME << uint32_t{1};
+  *client << Connection::Channel::CONTROL;
+  REQUIRE_THROWS_AS(client->offer(Connection::Channel::REALTIME,
+                                  [](Connection &connection) {
+                                    connection << uint32_t{2};
+                                    throw runtime_error("can't write");
+                                  }),
+                    runtime_error);
+  // still on the control channel
+  *client << uint32_t{3};
+  REQUIRE(client->offer(Connection::Channel::REALTIME,
+                        [](Connection &connection) {
+                          connection << uint32_t{4};
+                        }));
+  client->flush();
+
+  uint32_t number;
+  *server >> Connection::Channel::REALTIME >> number;
+  REQUIRE(number == 1);
+  *server >> number;
+  REQUIRE(number == 4);
+  *server >> Connection::Channel::CONTROL >> number;
+  REQUIRE(number == 3);
+}
+
+TEST_CASE("abandoned connections discard what they couldn't send",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  client->setWatermarks(1, 0);
+  *client << Connection::Channel::BULK << u8string(100000, u8'x');
+  client->offer(Connection::Channel::REALTIME,
+                [](Connection &connection) { connection << uint32_t{1}; });
+  REQUIRE(client->queued() != 0);
+  client->abandon();
+  REQUIRE(client->queued() == 0);
+  // nothing left to flush, so this can't wait on the server
+  client.reset();
+}
+
+TEST_CASE("clock sync messages get through congestion",
+          "[game][networking]") {
+  REQUIRE(sodium_init() >= 0);
+  loopback::Network network(loopback::Conditions{});
+  atomic_bool stop(false);
+  auto [client, server] = network.connectedPair(stop);
+
+  // everything offered would be held back or dropped
+  server->setWatermarks(1, 0);
+  client->setWatermarks(1, 0);
+  client->setSlowConsumerHook([](Connection::Channel, size_t) {
+    return Connection::SlowConsumerAction::DROP;
+  });
+
+  ClockSync clientClock;
+  ClockSync serverClock;
+  clientClock.ping(*client);
+  client->flush();
+
+  // the answer and the server's own ping share a channel, and both arrive
+  REQUIRE(serverClock.receive(*server) == ClockSync::Message::PING);
+  serverClock.ping(*server);
+  server->flush();
+  REQUIRE(clientClock.receive(*client) == ClockSync::Message::PONG);
+  REQUIRE(clientClock.receive(*client) == ClockSync::Message::PING);
+  client->flush();
+  REQUIRE(serverClock.receive(*server) == ClockSync::Message::PONG);
+  REQUIRE(clientClock.rtt());
+  REQUIRE(serverClock.rtt());
+}
@@ -0,0 +1,123 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/prediction.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <vector>
+
+#include "game/movement.h"
+#include "glm/glm.hpp"
+#include "util/exceptions/formatException.h"
+#include "util/geometry.h"
+
+using namespace std;
+using namespace airewar::game;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+using namespace glm;
+
+namespace {
+constexpr float DT = 1.0f / 60.0f;
+
+EntityState start() noexcept {
+  return EntityState{sphericalToCartesian(0.3f, 1.2f, Map::RADIUS), 0.5f,
+                     200.0f};
+}
+}  // namespace
+
+TEST_CASE("movement follows the surface", "[game][prediction]") {
+  EntityState state = start();
+  for (size_t cnt = 0; cnt < 60; ++cnt) state = simulate(state, Input{}, DT);
+  REQUIRE(abs(length(state.position) - Map::RADIUS) < 1.0f);
+  REQUIRE(abs(length(state.position - start().position) - 200.0f) < 2.0f);
+}
+
+TEST_CASE("inputs round trip in a few bytes", "[game][prediction]") {
+  Input input{70000, -0.5f, 1.0f};
+  vector<uint8_t> encoded = encodeInput(input);
+  REQUIRE(encoded.size() == 5);
+
+  Input decoded = decodeInput(encoded);
+  REQUIRE(decoded.sequence == input.sequence);
+  REQUIRE(abs(decoded.turn - input.turn) <= 0.5f / INPUT_STEPS);
+  REQUIRE(decoded.throttle == 1.0f);
+
+  encoded.pop_back();
+  REQUIRE_THROWS_AS(decodeInput(encoded), FormatException);
+}
+
+TEST_CASE("prediction replays unacknowledged inputs", "[game][prediction]") {
+  Predictor predictor(start());
+  vector<Input> sent;
+  for (size_t cnt = 0; cnt < 10; ++cnt)
+    sent.push_back(predictor.apply(Input{0, 0.5f, 1.0f}, DT));
+  EntityState predicted = predictor.state();
+
+  // the server agrees about the first four inputs
+  EntityState server = start();
+  for (size_t cnt = 0; cnt < 4; ++cnt) server = simulate(server, sent[cnt], DT);
+  predictor.reconcile(sent[3].sequence, server);
+  REQUIRE(predictor.lastCorrection() == 0.0f);
+  REQUIRE(length(predictor.state().position - predicted.position) == 0.0f);
+
+  // then something the client didn't know about pushed us
+  for (size_t cnt = 4; cnt < 6; ++cnt) server = simulate(server, sent[cnt], DT);
+  server.position = sphericalToCartesian(0.3f, 1.2001f, Map::RADIUS);
+  predictor.reconcile(sent[5].sequence, server);
+
+  EntityState replayed = server;
+  for (size_t cnt = 6; cnt < 10; ++cnt)
+    replayed = simulate(replayed, sent[cnt], DT);
+  REQUIRE(predictor.lastCorrection() > 100.0f);
+  REQUIRE(length(predictor.state().position - replayed.position) < 0.01f);
+  REQUIRE(predictor.state().speed == replayed.speed);
+}
+
+TEST_CASE("prediction ignores stale acks and snaps past lost inputs",
+          "[game][prediction]") {
+  Predictor predictor(start());
+  vector<Input> sent;
+  for (size_t cnt = 0; cnt < 10; ++cnt)
+    sent.push_back(predictor.apply(Input{0, 0.5f, 1.0f}, DT));
+
+  EntityState server = start();
+  for (size_t cnt = 0; cnt < 6; ++cnt) server = simulate(server, sent[cnt], DT);
+  predictor.reconcile(sent[5].sequence, server);
+  EntityState predicted = predictor.state();
+
+  // an older ack arriving late changes nothing
+  predictor.reconcile(sent[2].sequence, start());
+  REQUIRE(length(predictor.state().position - predicted.position) == 0.0f);
+
+  // the server fell so far behind that the inputs after its ack are gone
+  for (size_t cnt = 10; cnt < 10 + 2 * Predictor::HISTORY_SIZE; ++cnt)
+    sent.push_back(predictor.apply(Input{0, 0.5f, 1.0f}, DT));
+  for (size_t cnt = 6; cnt < 8; ++cnt) server = simulate(server, sent[cnt], DT);
+  predictor.reconcile(sent[7].sequence, server);
+  REQUIRE(predictor.lastCorrection() > 0.0f);
+  REQUIRE(length(predictor.state().position - server.position) == 0.0f);
+
+  // and later inputs replay from there as usual
+  Input next = predictor.apply(Input{0, 0.5f, 1.0f}, DT);
+  EntityState expected = simulate(server, next, DT);
+  predictor.reconcile(sent.back().sequence, server);
+  REQUIRE(length(predictor.state().position - expected.position) < 0.01f);
+}
@@ -0,0 +1,97 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/server.h"
+
+#include <sodium.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game/client.h"
+#include "game/networking/loopback/networking.h"
+#include "util/scopeGuard.h"
+
+using namespace std;
+using namespace airewar::game;
+using namespace airewar::util;
+
+namespace {
+/** wait for a client to get as far as it will */
+void settle(Client &client) {
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + chrono::minutes(1);
+  while (client.state != Client::State::ERROR && !client.map &&
+         chrono::steady_clock::now() < deadline)
+    this_thread::sleep_for(chrono::milliseconds(10));
+}
+}  // namespace
+
+TEST_CASE("server runs sessions over a loopback network",
+          "[game][server][.long]") {
+  REQUIRE(sodium_init() >= 0);
+  networking::loopback::Conditions conditions;
+  conditions.latency = chrono::milliseconds(5);
+  networking::loopback::Network network(conditions);
+
+  RoomSettings room;
+  room.password = U"password";
+  room.players = 1;
+  room.seed = 1;
+
+  // the server logs sessions that end in an error
+  ostringstream log;
+  streambuf *original = clog.rdbuf(log.rdbuf());
+  ScopeGuard restore([original]() { clog.rdbuf(original); });
+
+  Server host(vector<RoomSettings>{room}, network, ServerSettings{});
+  while (host.state == Server::State::STARTING)
+    this_thread::sleep_for(chrono::milliseconds(10));
+  REQUIRE(host.state == Server::State::RUNNING);
+
+  // gets through the clock sync, which the server only answers on a reactor
+  auto player = make_unique<Client>(U"localhost", U"password", network);
+  settle(*player);
+  REQUIRE(player->state == Client::State::GENERATING_MAP);
+  REQUIRE(player->role == Role::PLAYER);
+  REQUIRE(player->map == MapCache::shared().get(1));
+
+  Client late(U"localhost", U"password", network);
+  settle(late);
+  REQUIRE(late.state == Client::State::ERROR);
+  REQUIRE(late.errorMessage == "No slot available");
+
+  // hanging up gives the slot back without counting as an error
+  player.reset();
+  Server::Room const &joined = host.getRooms().begin()->second;
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + chrono::seconds(10);
+  while (joined.players != 0 && chrono::steady_clock::now() < deadline)
+    this_thread::sleep_for(chrono::milliseconds(10));
+  REQUIRE(joined.players == 0);
+  // reaped on the server's next pass
+  this_thread::sleep_for(chrono::milliseconds(500));
+  REQUIRE(log.str().find("connection error") == string::npos);
+}
@@ -0,0 +1,153 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/snapshot.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "util/exceptions/formatException.h"
+#include "util/geometry.h"
+
+using namespace std;
+using namespace airewar::game;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+using namespace glm;
+
+namespace {
+EntityState entityAt(float lat, float lon, float heading, float speed) {
+  return EntityState{sphericalToCartesian(lat, lon, Map::RADIUS), heading,
+                     speed};
+}
+}  // namespace
+
+TEST_CASE("quantized entity states round trip", "[game][snapshot]") {
+  vector<EntityState> states = {
+      entityAt(0.0f, 0.0f, 0.0f, 0.0f),
+      entityAt(0.7f, -2.9f, 1.0f, 250.0f),
+      entityAt(-1.5f, 3.1f, 6.2f, 1000.0f),
+      entityAt(half_pi<float>(), 0.0f, 3.0f, 12.5f),
+  };
+  for (EntityState const &state : states) {
+    EntityState back = QuantizedState::quantize(state).dequantize();
+    // float positions are only good to about half a meter at this radius
+    REQUIRE(length(back.position - state.position) <
+            QuantizedState::POSITION_PRECISION + 1.0);
+    REQUIRE(abs(back.heading - state.heading) < 0.002f);
+    REQUIRE(abs(back.speed - state.speed) < 0.02f);
+  }
+}
+
+TEST_CASE("snapshots only carry what changed", "[game][snapshot]") {
+  constexpr uint32_t NUM_ENTITIES = 1000;
+  SnapshotEncoder encoder;
+  SnapshotDecoder decoder;
+
+  Snapshot snapshot;
+  snapshot.tick = 1;
+  for (uint32_t id = 0; id < NUM_ENTITIES; ++id)
+    snapshot.entities[id] = QuantizedState::quantize(
+        entityAt(0.001f * id, -0.002f * id, 0.5f, 200.0f));
+  vector<uint8_t> full = encoder.encode(snapshot);
+  REQUIRE(decoder.decode(full).entities == snapshot.entities);
+  encoder.acknowledge(1);
+
+  // nothing changed - just the header
+  snapshot.tick = 2;
+  vector<uint8_t> idle = encoder.encode(snapshot);
+  REQUIRE(idle.size() <= 8);
+  REQUIRE(decoder.decode(idle).entities == snapshot.entities);
+
+  // one entity moved a little, one left, and one arrived
+  snapshot.tick = 3;
+  snapshot.entities[10].longitude += 17;
+  snapshot.entities.erase(20);
+  snapshot.entities[NUM_ENTITIES] = snapshot.entities[30];
+  vector<uint8_t> delta = encoder.encode(snapshot);
+  REQUIRE(delta.size() < 32);
+  REQUIRE(full.size() > 100 * delta.size());
+  REQUIRE(decoder.decode(delta).entities == snapshot.entities);
+
+  // tick 2 was never acknowledged, so this is still based on tick 1
+  encoder.acknowledge(3);
+  snapshot.tick = 4;
+  snapshot.entities[10].longitude -= 1000;
+  REQUIRE(decoder.decode(encoder.encode(snapshot)).entities ==
+          snapshot.entities);
+
+  SnapshotDecoder fresh;
+  snapshot.tick = 5;
+  REQUIRE_THROWS_AS(fresh.decode(encoder.encode(snapshot)), FormatException);
+}
+
+TEST_CASE("snapshots survive acknowledgements lagging past the history",
+          "[game][snapshot]") {
+  SnapshotEncoder encoder;
+  SnapshotDecoder decoder;
+
+  Snapshot snapshot;
+  snapshot.tick = 1;
+  for (uint32_t id = 0; id < 16; ++id)
+    snapshot.entities[id] = QuantizedState::quantize(
+        entityAt(0.01f * id, 0.02f * id, 1.0f, 150.0f));
+  REQUIRE(decoder.decode(encoder.encode(snapshot)).entities ==
+          snapshot.entities);
+  encoder.acknowledge(1);
+
+  // no acks get through for a while
+  for (uint32_t tick = 2; tick < 2 + 3 * SnapshotDecoder::HISTORY_SIZE;
+       ++tick) {
+    snapshot.tick = tick;
+    snapshot.entities[tick % 16].longitude += tick;
+    REQUIRE(decoder.decode(encoder.encode(snapshot)).entities ==
+            snapshot.entities);
+  }
+
+  // and a late one still leaves the stream decodable
+  encoder.acknowledge(snapshot.tick);
+  ++snapshot.tick;
+  snapshot.entities[0].speed += 1;
+  vector<uint8_t> delta = encoder.encode(snapshot);
+  REQUIRE(delta.size() < 16);
+  REQUIRE(decoder.decode(delta).entities == snapshot.entities);
+}
+
+TEST_CASE("broadcast snapshots are encoded once per baseline",
+          "[game][snapshot]") {
+  Snapshot first;
+  first.tick = 1;
+  for (uint32_t id = 0; id < 64; ++id)
+    first.entities[id] = QuantizedState::quantize(
+        entityAt(0.01f * id, 0.02f * id, 1.0f, 150.0f));
+  Snapshot second = first;
+  second.tick = 2;
+  second.entities[3].longitude += 5;
+
+  SnapshotBroadcast broadcast(second);
+  networking::Message const &delta = broadcast.encoded(&first);
+  REQUIRE(&broadcast.encoded(&first) == &delta);
+  REQUIRE(broadcast.size() == 1);
+  REQUIRE(broadcast.encoded(nullptr).size() > delta.size());
+  REQUIRE(broadcast.size() == 2);
+  REQUIRE(broadcast.getSnapshot()->entities == second.entities);
+}
@@ -0,0 +1,81 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "game/tickLoop.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace airewar::game;
+
+TEST_CASE("tick loop keeps to its schedule", "[game][tickLoop]") {
+  atomic_bool stop = false;
+  uint64_t inputs = 0;
+  uint64_t lastTick = 0;
+  uint64_t broadcasts = 0;
+  TickLoop::Clock::time_point start;
+  TickLoop::Clock::time_point end;
+  TickLoop loop(100, {[&]() {
+                        if (inputs++ == 0) start = TickLoop::Clock::now();
+                      },
+                      [&](uint64_t tick) {
+                        lastTick = tick;
+                        // one slow tick, which the next few catch up after
+                        if (tick == 10) this_thread::sleep_for(35ms);
+                      },
+                      [&]() {
+                        if (++broadcasts == 50) {
+                          end = TickLoop::Clock::now();
+                          stop = true;
+                        }
+                      }});
+  REQUIRE(loop.getPeriod() == 10ms);
+  loop.run(stop);
+
+  REQUIRE(inputs == 50);
+  REQUIRE(lastTick == 49);
+  // ticks are due at fixed times, so the slow one doesn't push the rest back
+  REQUIRE(end - start >= 490ms);
+  REQUIRE(end - start < 560ms);
+
+  TickStatistics statistics = loop.getStatistics();
+  REQUIRE(statistics.ticks == 50);
+  REQUIRE(statistics.overruns >= 1);
+  REQUIRE(statistics.skipped == 0);
+  REQUIRE(statistics.total.count() == 50);
+  REQUIRE(statistics.simulate.max() >= 35ms);
+  REQUIRE(statistics.lateness.max() >= 25ms);
+}
+
+TEST_CASE("tick loop skips ticks it can't catch up on", "[game][tickLoop]") {
+  atomic_bool stop = false;
+  TickLoop loop(1000, {[]() {},
+                       [&](uint64_t tick) {
+                         if (tick == 0) this_thread::sleep_for(50ms);
+                         if (tick == 10) stop = true;
+                       },
+                       []() {}});
+  loop.run(stop);
+
+  TickStatistics statistics = loop.getStatistics();
+  REQUIRE(statistics.ticks == 11);
+  REQUIRE(statistics.skipped >= 40);
+}
@@ -0,0 +1,53 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/bitPacking.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+#include "util/exceptions/formatException.h"
+
+using namespace std;
+using namespace airewar::util;
+using namespace airewar::util::exceptions;
+
+TEST_CASE("bit packing round trips", "[util][bitPacking]") {
+  BitWriter out;
+  out.write(5, 3);
+  out.writeBool(true);
+  out.write(0x123456789abcdef0, 64);
+  out.writeVarint(0);
+  out.writeVarint(300);
+  out.writeVarint(UINT64_MAX);
+  out.write(1, 1);
+  REQUIRE(out.bytes().size() == (out.bitSize() + 7) / 8);
+
+  BitReader in(out.bytes());
+  REQUIRE(in.read(3) == 5);
+  REQUIRE(in.readBool());
+  REQUIRE(in.read(64) == 0x123456789abcdef0);
+  REQUIRE(in.readVarint() == 0);
+  REQUIRE(in.readVarint() == 300);
+  REQUIRE(in.readVarint() == UINT64_MAX);
+  REQUIRE(in.read(1) == 1);
+  // padding is there, but nothing past it
+  in.read(static_cast<unsigned>(out.bytes().size() * 8 - out.bitSize()));
+  REQUIRE_THROWS_AS(in.read(1), FormatException);
+}
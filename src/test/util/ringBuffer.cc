@@ -0,0 +1,40 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/ringBuffer.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace airewar::util;
+
+TEST_CASE("ring buffer overwrites its oldest element", "[util][ringBuffer]") {
+  RingBuffer<int, 3> buffer;
+  REQUIRE(buffer.empty());
+  for (int cnt = 0; cnt < 5; ++cnt) buffer.push_back(cnt);
+  REQUIRE(buffer.full());
+  REQUIRE(buffer.front() == 2);
+  REQUIRE(buffer[1] == 3);
+  REQUIRE(buffer.back() == 4);
+
+  buffer.pop_front();
+  buffer.push_back(5);
+  REQUIRE(buffer.size() == 3);
+  REQUIRE(buffer.front() == 3);
+  REQUIRE(buffer.back() == 5);
+}
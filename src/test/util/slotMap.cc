@@ -0,0 +1,121 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/slotMap.h"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace airewar::util;
+
+namespace {
+struct Counted final {
+  explicit Counted(atomic<int> &live_) noexcept : live(live_) { ++live; }
+  Counted(Counted const &) noexcept = delete;
+  Counted(Counted &&) noexcept = delete;
+
+  ~Counted() noexcept { --live; }
+
+  Counted &operator=(Counted const &) noexcept = delete;
+  Counted &operator=(Counted &&) noexcept = delete;
+
+  atomic<int> &live;
+};
+}  // namespace
+
+TEST_CASE("slot map handles go stale when their slot is reused",
+          "[util][slotMap]") {
+  SlotMap<int> map(2);
+  optional<SlotMap<int>::Handle> first = map.emplace(1);
+  optional<SlotMap<int>::Handle> second = map.emplace(2);
+  REQUIRE(first);
+  REQUIRE(second);
+  REQUIRE(!map.emplace(3));
+  REQUIRE(map.size() == 2);
+
+  REQUIRE(map.erase(*first));
+  REQUIRE(!map.erase(*first));
+  optional<SlotMap<int>::Handle> third = map.emplace(3);
+  REQUIRE(third);
+  REQUIRE(third->index == first->index);
+  REQUIRE(!map.get(*first));
+  REQUIRE(*map.get(*third) == 3);
+  REQUIRE(*map.get(*second) == 2);
+}
+
+TEST_CASE("slot map reclaims erased values once unreferenced",
+          "[util][slotMap]") {
+  atomic<int> live = 0;
+  int reclaimed = 0;
+  SlotMap<Counted> map(4, [&reclaimed](unique_ptr<Counted> value) {
+    ++reclaimed;
+    value.reset();
+  });
+  SlotMap<Counted>::Handle handle = *map.emplace(live);
+  map.emplace(live);
+
+  SlotMap<Counted>::Ref ref = map.get(handle);
+  REQUIRE(map.erase(handle));
+  REQUIRE(map.size() == 1);
+  // still referenced - can't be reclaimed, or reached afresh
+  REQUIRE(live == 2);
+  REQUIRE(!map.get(handle));
+  ref.reset();
+  REQUIRE(live == 1);
+  REQUIRE(reclaimed == 1);
+
+  int visited = 0;
+  map.forEach([&map, &visited](SlotMap<Counted>::Handle visiting, Counted &) {
+    ++visited;
+    map.erase(visiting);
+  });
+  REQUIRE(visited == 1);
+  REQUIRE(live == 0);
+  REQUIRE(map.size() == 0);
+}
+
+TEST_CASE("slot map survives concurrent use", "[util][slotMap]") {
+  constexpr size_t NUM_THREADS = 4;
+  constexpr size_t NUM_ROUNDS = 20000;
+  atomic<int> live = 0;
+  atomic<size_t> failures = 0;
+  {
+    SlotMap<Counted> map(16);
+    vector<thread> threads;
+    for (size_t cnt = 0; cnt < NUM_THREADS; ++cnt) {
+      threads.emplace_back([&map, &live, &failures]() {
+        for (size_t round = 0; round < NUM_ROUNDS; ++round) {
+          optional<SlotMap<Counted>::Handle> handle = map.emplace(live);
+          map.forEach([&failures](SlotMap<Counted>::Handle, Counted &counted) {
+            if (counted.live <= 0) ++failures;
+          });
+          if (handle && !map.erase(*handle)) ++failures;
+        }
+      });
+    }
+    for (thread &worker : threads) worker.join();
+    REQUIRE(map.size() == 0);
+  }
+  REQUIRE(failures == 0);
+  REQUIRE(live == 0);
+}
@@ -0,0 +1,55 @@
+// Copyright 2022 Justin Hu
+//
+// This file is part of AireWar.
+//
+// AireWar is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// AireWar is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with AireWar. If not, see <https://www.gnu.org/licenses/>.
+//
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "util/threadPool.h"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace airewar::util;
+
+TEST_CASE("thread pool runs every job on its own threads",
+          "[util][threadPool]") {
+  constexpr size_t NUM_JOBS = 1000;
+  atomic<size_t> done = 0;
+  mutex idsMutex;
+  set<thread::id> ids;
+  {
+    ThreadPool pool(3);
+    REQUIRE(pool.size() == 3);
+    for (size_t cnt = 0; cnt < NUM_JOBS; ++cnt) {
+      pool.post([&]() {
+        {
+          scoped_lock lock(idsMutex);
+          ids.insert(this_thread::get_id());
+        }
+        ++done;
+      });
+    }
+    // destroying the pool finishes what's queued
+  }
+  REQUIRE(done == NUM_JOBS);
+  REQUIRE(ids.size() <= 3);
+  REQUIRE(!ids.contains(this_thread::get_id()));
+}